@@ -0,0 +1,164 @@
+#include "AcquisitionQueue.h"
+#include "FrameAverager.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// The queue step of the frame whose callbacks are in progress on this thread
+static __declspec(thread) const uint32_t *currentStep;
+
+
+static const char *SkipSpace(const char *p)
+{
+	while (isspace((unsigned char)*p))
+		++p;
+	return p;
+}
+
+
+static bool ParseNumber(const char **p, double *value)
+{
+	const char *start = SkipSpace(*p);
+	if (*start == '\0' || *start == ',' || *start == ';')
+		return false;
+	char *end;
+	errno = 0;
+	*value = strtod(start, &end);
+	if (end == start || errno != 0)
+		return false;
+	*p = SkipSpace(end);
+	return true;
+}
+
+
+static bool IsWholeNumberInRange(double value, double min, double max)
+{
+	return value >= min && value <= max && value == (double)(uint32_t)value;
+}
+
+
+static bool SetStepValue(struct AcquisitionStep *step, const char *key, size_t keyLength,
+	double value)
+{
+	if (keyLength == strlen("resolution") && strncmp(key, "resolution", keyLength) == 0)
+	{
+		if (value != 256 && value != 512 && value != 1024 && value != 2048)
+			return false;
+		step->resolution = (uint32_t)value;
+	}
+	else if (keyLength == strlen("zoom") && strncmp(key, "zoom", keyLength) == 0)
+	{
+		if (!(value >= 0.5 && value <= 40.0))
+			return false;
+		step->zoomFactor = value;
+	}
+	else if (keyLength == strlen("rate") && strncmp(key, "rate", keyLength) == 0)
+	{
+		if (!(value >= 100.0 && value <= 500000.0))
+			return false;
+		step->pixelRateHz = value;
+	}
+	else if (keyLength == strlen("frames") && strncmp(key, "frames", keyLength) == 0)
+	{
+		if (!IsWholeNumberInRange(value, 1, INT32_MAX))
+			return false;
+		step->numberOfFrames = (uint32_t)value;
+	}
+	else if (keyLength == strlen("average") && strncmp(key, "average", keyLength) == 0)
+	{
+		if (!IsWholeNumberInRange(value, 1, FRAME_AVERAGER_MAX_FRAMES))
+			return false;
+		step->framesToAverage = (uint32_t)value;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+
+// Parse "key=value,..." up to the next ';' or the end
+static bool ParseStep(const char **p, struct AcquisitionStep *step)
+{
+	memset(step, 0, sizeof(struct AcquisitionStep));
+	for (;;)
+	{
+		const char *key = SkipSpace(*p);
+		const char *keyEnd = key;
+		while (isalpha((unsigned char)*keyEnd))
+			++keyEnd;
+		const char *q = SkipSpace(keyEnd);
+		if (keyEnd == key || *q != '=')
+			return false;
+		++q;
+
+		double value;
+		if (!ParseNumber(&q, &value) ||
+			!SetStepValue(step, key, keyEnd - key, value))
+			return false;
+
+		*p = q;
+		if (*q != ',')
+			return *q == ';' || *q == '\0';
+		++*p;
+	}
+}
+
+
+OScDev_Error AcquisitionQueue_Parse(struct AcquisitionQueue *queue, const char *text)
+{
+	struct AcquisitionQueue parsed;
+	parsed.stepCount = 0;
+
+	const char *p = SkipSpace(text);
+	while (*p != '\0')
+	{
+		if (parsed.stepCount == ACQUISITION_QUEUE_MAX_STEPS)
+			return OScDev_Error_Illegal_Argument;
+		if (!ParseStep(&p, &parsed.steps[parsed.stepCount]))
+			return OScDev_Error_Illegal_Argument;
+		++parsed.stepCount;
+
+		// Allow a trailing separator
+		if (*p == ';')
+			p = SkipSpace(p + 1);
+	}
+
+	*queue = parsed;
+	return OScDev_OK;
+}
+
+
+void AcquisitionStep_Resolve(struct AcquisitionStep *step,
+	const struct AcquisitionStep *defaults)
+{
+	if (step->resolution == 0)
+		step->resolution = defaults->resolution;
+	if (step->zoomFactor == 0.0)
+		step->zoomFactor = defaults->zoomFactor;
+	if (step->pixelRateHz == 0.0)
+		step->pixelRateHz = defaults->pixelRateHz;
+	if (step->numberOfFrames == 0)
+		step->numberOfFrames = defaults->numberOfFrames;
+	if (step->framesToAverage == 0)
+		step->framesToAverage = defaults->framesToAverage;
+}
+
+
+void AcquisitionQueue_SetCurrentStep(const uint32_t *step)
+{
+	currentStep = step;
+}
+
+
+bool OScNIFPGA_GetQueueStep(uint32_t *step)
+{
+	if (currentStep == NULL)
+		return false;
+	*step = *currentStep;
+	return true;
+}
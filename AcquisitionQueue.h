@@ -0,0 +1,41 @@
+#pragma once
+
+#include "OScNIFPGAQueue.h"
+
+#include "OpenScanDeviceLib.h"
+
+#include <stdint.h>
+
+
+// Parsing of the AcquisitionQueue setting (see OScNIFPGAQueue.h)
+
+#define ACQUISITION_QUEUE_MAX_STEPS 32
+
+// Parameters of one acquisition. As parsed, 0 stands for a value to be
+// taken from the armed acquisition.
+struct AcquisitionStep
+{
+	uint32_t resolution;
+	double zoomFactor;
+	double pixelRateHz;
+	uint32_t numberOfFrames;
+	uint32_t framesToAverage;
+};
+
+struct AcquisitionQueue
+{
+	uint32_t stepCount; // 0 for no queue
+	struct AcquisitionStep steps[ACQUISITION_QUEUE_MAX_STEPS];
+};
+
+// Returns OScDev_Error_Illegal_Argument, leaving queue unchanged, if text
+// is malformed or a value is out of range
+OScDev_Error AcquisitionQueue_Parse(struct AcquisitionQueue *queue, const char *text);
+
+// Fill in the values that step leaves to the acquisition from defaults
+void AcquisitionStep_Resolve(struct AcquisitionStep *step,
+	const struct AcquisitionStep *defaults);
+
+// Make step the one reported by OScNIFPGA_GetQueueStep() on this thread;
+// null when no frame callback is in progress
+void AcquisitionQueue_SetCurrentStep(const uint32_t *step);
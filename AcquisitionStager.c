@@ -0,0 +1,180 @@
+#include "AcquisitionStager.h"
+#include "FrameCorrection.h"
+#include "Log.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Windows.h>
+
+
+struct AcquisitionStager
+{
+	OScDev_Device *device;
+	HANDLE thread;
+
+	CRITICAL_SECTION mutex;
+	CONDITION_VARIABLE requested;
+	CONDITION_VARIABLE prepared;
+	uint64_t generation; // Incremented for each request
+	struct StagedAcquisitionRequest request; // Latest
+	bool hasRequest;
+	bool stopRequested;
+
+	struct StagedAcquisition *ready; // Of readyGeneration; may be null
+	uint64_t readyGeneration;
+};
+
+
+static bool IsSameRequest(const struct StagedAcquisitionRequest *a,
+	const struct StagedAcquisitionRequest *b)
+{
+	return WaveformGeometry_IsEqual(&a->geometry, &b->geometry) &&
+		a->channelCount == b->channelCount &&
+		strcmp(a->correctionDirectory, b->correctionDirectory) == 0;
+}
+
+
+void StagedAcquisition_Destroy(struct StagedAcquisition *staged)
+{
+	if (staged == NULL)
+		return;
+	PreparedWaveform_Destroy(staged->waveform);
+	FrameCorrection_Destroy(staged->correction);
+	free(staged);
+}
+
+
+static struct StagedAcquisition *Prepare(OScDev_Device *device,
+	const struct StagedAcquisitionRequest *request)
+{
+	struct StagedAcquisition *staged = calloc(1, sizeof(struct StagedAcquisition));
+	if (staged == NULL)
+		return NULL;
+	staged->request = *request;
+
+	// Whatever fails here is simply done again, and reported, at arm
+	OScDev_Error err;
+	if (OScDev_CHECK(err, PreparedWaveform_Create(&staged->waveform, &request->geometry)))
+		NIFPGA_LOG_DEBUG(device, "Cannot stage waveform (error %d)", (int)err);
+	if (request->correctionDirectory[0] != '\0')
+	{
+		if (OScDev_CHECK(err, FrameCorrection_Load(&staged->correction, device,
+			request->correctionDirectory, request->channelCount,
+			request->geometry.resolution)))
+			NIFPGA_LOG_DEBUG(device, "Cannot stage correction maps (error %d)", (int)err);
+	}
+	return staged;
+}
+
+
+static DWORD WINAPI StagerLoop(void *param)
+{
+	struct AcquisitionStager *stager = param;
+	uint64_t seen = 0;
+
+	EnterCriticalSection(&stager->mutex);
+	for (;;)
+	{
+		while (stager->generation == seen && !stager->stopRequested)
+			SleepConditionVariableCS(&stager->requested, &stager->mutex, INFINITE);
+		if (stager->stopRequested)
+			break;
+		seen = stager->generation;
+		struct StagedAcquisitionRequest request = stager->request;
+		LeaveCriticalSection(&stager->mutex);
+
+		struct StagedAcquisition *staged = Prepare(stager->device, &request);
+
+		EnterCriticalSection(&stager->mutex);
+		if (stager->generation == seen)
+		{
+			StagedAcquisition_Destroy(stager->ready);
+			stager->ready = staged;
+			stager->readyGeneration = seen;
+			WakeAllConditionVariable(&stager->prepared);
+		}
+		else
+		{
+			// Superseded while being prepared
+			StagedAcquisition_Destroy(staged);
+		}
+	}
+	LeaveCriticalSection(&stager->mutex);
+	return 0;
+}
+
+
+OScDev_Error AcquisitionStager_Start(struct AcquisitionStager **stager, OScDev_Device *device)
+{
+	*stager = NULL;
+	struct AcquisitionStager *s = calloc(1, sizeof(struct AcquisitionStager));
+	if (s == NULL)
+		return OScDev_Error_Out_Of_Memory;
+	s->device = device;
+	InitializeCriticalSection(&s->mutex);
+	InitializeConditionVariable(&s->requested);
+	InitializeConditionVariable(&s->prepared);
+
+	s->thread = CreateThread(NULL, 0, StagerLoop, s, 0, NULL);
+	if (s->thread == NULL)
+	{
+		DeleteCriticalSection(&s->mutex);
+		free(s);
+		return OScDev_Error_Unknown;
+	}
+
+	*stager = s;
+	return OScDev_OK;
+}
+
+
+void AcquisitionStager_Stop(struct AcquisitionStager *stager)
+{
+	if (stager == NULL)
+		return;
+
+	EnterCriticalSection(&stager->mutex);
+	stager->stopRequested = true;
+	LeaveCriticalSection(&stager->mutex);
+	WakeConditionVariable(&stager->requested);
+
+	WaitForSingleObject(stager->thread, INFINITE);
+	CloseHandle(stager->thread);
+
+	StagedAcquisition_Destroy(stager->ready);
+	DeleteCriticalSection(&stager->mutex);
+	free(stager);
+}
+
+
+void AcquisitionStager_Request(struct AcquisitionStager *stager,
+	const struct StagedAcquisitionRequest *request)
+{
+	EnterCriticalSection(&stager->mutex);
+	stager->request = *request;
+	stager->hasRequest = true;
+	++stager->generation;
+	LeaveCriticalSection(&stager->mutex);
+	WakeConditionVariable(&stager->requested);
+}
+
+
+struct StagedAcquisition *AcquisitionStager_Take(struct AcquisitionStager *stager,
+	const struct StagedAcquisitionRequest *request)
+{
+	struct StagedAcquisition *staged = NULL;
+	EnterCriticalSection(&stager->mutex);
+	if (stager->hasRequest && IsSameRequest(&stager->request, request))
+	{
+		// Preparing again here would take no less time than waiting
+		while (stager->readyGeneration != stager->generation)
+			SleepConditionVariableCS(&stager->prepared, &stager->mutex, INFINITE);
+		staged = stager->ready;
+		stager->ready = NULL;
+		stager->hasRequest = false;
+	}
+	LeaveCriticalSection(&stager->mutex);
+	return staged;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "WaveformUpdater.h"
+
+#include "OpenScanDeviceLib.h"
+
+#include <stdint.h>
+
+
+// Preparation of the next acquisition while the current one runs
+//
+// When the next geometry is known in advance, its waveform is computed and
+// its correction maps are loaded on a background thread, so that arming it
+// is left with only the FPGA reset, register writes and upload. A new
+// request replaces the previous one.
+
+struct StagedAcquisitionRequest
+{
+	struct WaveformGeometry geometry;
+	uint32_t channelCount;
+	// Empty for no correction maps
+	char correctionDirectory[OScDev_MAX_STR_LEN + 1];
+};
+
+struct StagedAcquisition
+{
+	struct StagedAcquisitionRequest request;
+	struct PreparedWaveform *waveform; // Null if it could not be prepared
+	struct FrameCorrection *correction; // Null if none or not loaded
+};
+
+void StagedAcquisition_Destroy(struct StagedAcquisition *staged);
+
+struct AcquisitionStager;
+
+OScDev_Error AcquisitionStager_Start(struct AcquisitionStager **stager, OScDev_Device *device);
+void AcquisitionStager_Stop(struct AcquisitionStager *stager);
+
+void AcquisitionStager_Request(struct AcquisitionStager *stager,
+	const struct StagedAcquisitionRequest *request);
+
+// The staged acquisition if it was requested exactly as request, waiting
+// for it if it is still being prepared; otherwise null. The caller owns the
+// result.
+struct StagedAcquisition *AcquisitionStager_Take(struct AcquisitionStager *stager,
+	const struct StagedAcquisitionRequest *request);
@@ -0,0 +1,237 @@
+#include "FifoReaders.h"
+#include "Log.h"
+
+#include <stdlib.h>
+
+#include <Windows.h>
+
+
+// Largest blocking read while waiting for data; bounds the latency of
+// noticing a timeout
+#define BLOCKING_CHUNK_WORDS 16384
+#define BLOCKING_SLICE_MS 50
+
+
+struct Reader
+{
+	struct FifoReaders *readers;
+	uint32_t fifo;
+	HANDLE thread;
+
+	// Results of the current frame
+	NiFpga_Status status;
+	bool timedOut;
+	bool cancelled;
+	size_t remaining;
+};
+
+struct FifoReaders
+{
+	OScDev_Device *device;
+	const struct FpgaBackend *backend;
+	NiFpga_Session session;
+	FifoReaders_CancelFunc isCancelled;
+	struct Reader readers[FIFO_READERS_MAX_FIFOS];
+	uint32_t fifoCount;
+
+	CRITICAL_SECTION mutex;
+	CONDITION_VARIABLE frameRequested;
+	CONDITION_VARIABLE frameDone;
+	uint64_t generation; // Incremented for each frame
+	uint32_t pending; // Readers yet to finish the current frame
+	bool stopRequested;
+
+	// Current frame
+	uint32_t *buffers[FIFO_READERS_MAX_FIFOS];
+	size_t wordCount;
+	uint32_t timeoutMs;
+};
+
+
+static void ReadFifo(struct FifoReaders *readers, struct Reader *reader,
+	uint32_t *buffer)
+{
+	const struct FpgaBackend *backend = readers->backend;
+	NiFpga_Session session = readers->session;
+	size_t wordCount = readers->wordCount;
+	ULONGLONG deadline = GetTickCount64() + readers->timeoutMs;
+
+	reader->status = NiFpga_Status_Success;
+	reader->timedOut = false;
+	reader->cancelled = false;
+	reader->remaining = 0;
+
+	size_t readSoFar = 0;
+	while (readSoFar < wordCount)
+	{
+		if (readers->isCancelled != NULL && readers->isCancelled(readers->device))
+		{
+			reader->cancelled = true;
+			return;
+		}
+
+		// Take whatever is already there; otherwise block in the driver
+		// for a modest chunk rather than polling
+		size_t available = 0;
+		NiFpga_Status stat = backend->ReadFifoU32(session, reader->fifo,
+			buffer + readSoFar, 0, 0, &available);
+		if (NiFpga_IsError(stat))
+		{
+			reader->status = stat;
+			return;
+		}
+
+		size_t toRead = wordCount - readSoFar;
+		uint32_t timeout = 0;
+		if (available > 0)
+		{
+			if (toRead > available)
+				toRead = available;
+		}
+		else
+		{
+			if (toRead > BLOCKING_CHUNK_WORDS)
+				toRead = BLOCKING_CHUNK_WORDS;
+			timeout = BLOCKING_SLICE_MS;
+		}
+
+		stat = backend->ReadFifoU32(session, reader->fifo,
+			buffer + readSoFar, toRead, timeout, &reader->remaining);
+		if (stat == NiFpga_Status_FifoTimeout)
+		{
+			if (GetTickCount64() >= deadline)
+			{
+				reader->timedOut = true;
+				return;
+			}
+			continue;
+		}
+		if (NiFpga_IsError(stat))
+		{
+			reader->status = stat;
+			return;
+		}
+		readSoFar += toRead;
+		NIFPGA_LOG_TRACE(readers->device, 250, "FIFO %u read %d %%",
+			reader->fifo, (int)(readSoFar * 100 / wordCount));
+	}
+}
+
+
+static DWORD WINAPI ReaderLoop(void *param)
+{
+	struct Reader *reader = param;
+	struct FifoReaders *readers = reader->readers;
+	uint32_t index = (uint32_t)(reader - readers->readers);
+	uint64_t seen = 0;
+
+	EnterCriticalSection(&readers->mutex);
+	for (;;)
+	{
+		while (readers->generation == seen && !readers->stopRequested)
+			SleepConditionVariableCS(&readers->frameRequested, &readers->mutex, INFINITE);
+		if (readers->stopRequested)
+			break;
+		seen = readers->generation;
+		uint32_t *buffer = readers->buffers[index];
+		LeaveCriticalSection(&readers->mutex);
+
+		ReadFifo(readers, reader, buffer);
+
+		EnterCriticalSection(&readers->mutex);
+		if (--readers->pending == 0)
+			WakeConditionVariable(&readers->frameDone);
+	}
+	LeaveCriticalSection(&readers->mutex);
+	return 0;
+}
+
+
+OScDev_Error FifoReaders_Start(struct FifoReaders **readers, OScDev_Device *device,
+	const struct FpgaBackend *backend, NiFpga_Session session,
+	const uint32_t *fifos, uint32_t fifoCount, FifoReaders_CancelFunc isCancelled)
+{
+	*readers = NULL;
+	if (fifoCount == 0 || fifoCount > FIFO_READERS_MAX_FIFOS)
+		return OScDev_Error_Illegal_Argument;
+
+	struct FifoReaders *r = calloc(1, sizeof(struct FifoReaders));
+	if (r == NULL)
+		return OScDev_Error_Out_Of_Memory;
+	r->device = device;
+	r->backend = backend;
+	r->session = session;
+	r->isCancelled = isCancelled;
+	InitializeCriticalSection(&r->mutex);
+	InitializeConditionVariable(&r->frameRequested);
+	InitializeConditionVariable(&r->frameDone);
+
+	for (uint32_t i = 0; i < fifoCount; ++i)
+	{
+		r->readers[i].readers = r;
+		r->readers[i].fifo = fifos[i];
+		r->readers[i].thread = CreateThread(NULL, 0, ReaderLoop, &r->readers[i], 0, NULL);
+		if (r->readers[i].thread == NULL)
+		{
+			FifoReaders_Stop(r);
+			return OScDev_Error_Unknown;
+		}
+		++r->fifoCount;
+	}
+
+	*readers = r;
+	return OScDev_OK;
+}
+
+
+void FifoReaders_Stop(struct FifoReaders *readers)
+{
+	if (readers == NULL)
+		return;
+
+	EnterCriticalSection(&readers->mutex);
+	readers->stopRequested = true;
+	LeaveCriticalSection(&readers->mutex);
+	WakeAllConditionVariable(&readers->frameRequested);
+
+	for (uint32_t i = 0; i < readers->fifoCount; ++i)
+	{
+		WaitForSingleObject(readers->readers[i].thread, INFINITE);
+		CloseHandle(readers->readers[i].thread);
+	}
+
+	DeleteCriticalSection(&readers->mutex);
+	free(readers);
+}
+
+
+NiFpga_Status FifoReaders_ReadFrame(struct FifoReaders *readers,
+	uint32_t *const *buffers, size_t wordCount, uint32_t timeoutMs,
+	bool *timedOut, bool *cancelled, size_t *remaining)
+{
+	EnterCriticalSection(&readers->mutex);
+	for (uint32_t i = 0; i < readers->fifoCount; ++i)
+		readers->buffers[i] = buffers[i];
+	readers->wordCount = wordCount;
+	readers->timeoutMs = timeoutMs;
+	readers->pending = readers->fifoCount;
+	++readers->generation;
+	WakeAllConditionVariable(&readers->frameRequested);
+
+	while (readers->pending > 0)
+		SleepConditionVariableCS(&readers->frameDone, &readers->mutex, INFINITE);
+	LeaveCriticalSection(&readers->mutex);
+
+	NiFpga_Status status = NiFpga_Status_Success;
+	*timedOut = false;
+	*cancelled = false;
+	for (uint32_t i = 0; i < readers->fifoCount; ++i)
+	{
+		if (!NiFpga_IsError(status))
+			status = readers->readers[i].status;
+		*timedOut = *timedOut || readers->readers[i].timedOut;
+		*cancelled = *cancelled || readers->readers[i].cancelled;
+		remaining[i] = readers->readers[i].remaining;
+	}
+	return status;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "FpgaBackend.h"
+
+#include "OpenScanDeviceLib.h"
+
+#include <NiFpga.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// One reader thread per target-to-host FIFO
+//
+// Each thread drains its own FIFO with blocking reads, so that a FIFO
+// filling up does not wait for the others to be serviced, and the frame
+// is complete when the slowest channel is. The threads persist for an
+// acquisition and are handed one frame at a time.
+
+#define FIFO_READERS_MAX_FIFOS 4
+
+struct FifoReaders;
+
+// Polled by the readers between reads; a true result abandons the frame
+typedef bool (*FifoReaders_CancelFunc)(OScDev_Device *device);
+
+// isCancelled may be null
+OScDev_Error FifoReaders_Start(struct FifoReaders **readers, OScDev_Device *device,
+	const struct FpgaBackend *backend, NiFpga_Session session,
+	const uint32_t *fifos, uint32_t fifoCount, FifoReaders_CancelFunc isCancelled);
+void FifoReaders_Stop(struct FifoReaders *readers);
+
+// Read wordCount words from each FIFO into the corresponding buffer, all
+// FIFOs in parallel, and wait for all of them. A FIFO that does not
+// deliver its words within timeoutMs is left short and timedOut is set;
+// if the frame is cancelled, all readers stop within about 50 ms and
+// cancelled is set. Returns the first error status of any reader.
+// remaining receives, per FIFO, the words still in the FIFO after its
+// last read.
+NiFpga_Status FifoReaders_ReadFrame(struct FifoReaders *readers,
+	uint32_t *const *buffers, size_t wordCount, uint32_t timeoutMs,
+	bool *timedOut, bool *cancelled, size_t *remaining);
@@ -0,0 +1,22 @@
+#include "FpgaBackend.h"
+
+
+const struct FpgaBackend NiFpgaBackend = {
+	.name = "NI FPGA",
+	.usesNiFpgaRuntime = true,
+	.Open = NiFpga_Open,
+	.Close = NiFpga_Close,
+	.Reset = NiFpga_Reset,
+	.Run = NiFpga_Run,
+	.ReadU16 = NiFpga_ReadU16,
+	.ReadI32 = NiFpga_ReadI32,
+	.ReadU32 = NiFpga_ReadU32,
+	.WriteU16 = NiFpga_WriteU16,
+	.WriteI32 = NiFpga_WriteI32,
+	.WriteU32 = NiFpga_WriteU32,
+	.WriteBool = NiFpga_WriteBool,
+	.StartFifo = NiFpga_StartFifo,
+	.StopFifo = NiFpga_StopFifo,
+	.ReadFifoU32 = NiFpga_ReadFifoU32,
+	.WriteFifoU32 = NiFpga_WriteFifoU32,
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <NiFpga.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Dispatch table for the subset of the NiFpga C API used by this module.
+//
+// Every FPGA access goes through the device's backend, so that the same
+// acquisition code can run against the hardware (NiFpgaBackend) or against
+// a stand-in (SimFpgaBackend, see SimFpga.h). The function signatures are
+// those of the corresponding NiFpga_* functions.
+struct FpgaBackend
+{
+	const char *name;
+
+	// True if sessions require NiFpga_Initialize()
+	bool usesNiFpgaRuntime;
+
+	NiFpga_Status (*Open)(const char *bitfile, const char *signature,
+		const char *resource, uint32_t attribute, NiFpga_Session *session);
+	NiFpga_Status (*Close)(NiFpga_Session session, uint32_t attribute);
+	NiFpga_Status (*Reset)(NiFpga_Session session);
+	NiFpga_Status (*Run)(NiFpga_Session session, uint32_t attribute);
+
+	NiFpga_Status (*ReadU16)(NiFpga_Session session, uint32_t indicator, uint16_t *value);
+	NiFpga_Status (*ReadI32)(NiFpga_Session session, uint32_t indicator, int32_t *value);
+	NiFpga_Status (*ReadU32)(NiFpga_Session session, uint32_t indicator, uint32_t *value);
+	NiFpga_Status (*WriteU16)(NiFpga_Session session, uint32_t control, uint16_t value);
+	NiFpga_Status (*WriteI32)(NiFpga_Session session, uint32_t control, int32_t value);
+	NiFpga_Status (*WriteU32)(NiFpga_Session session, uint32_t control, uint32_t value);
+	NiFpga_Status (*WriteBool)(NiFpga_Session session, uint32_t control, NiFpga_Bool value);
+
+	NiFpga_Status (*StartFifo)(NiFpga_Session session, uint32_t fifo);
+	NiFpga_Status (*StopFifo)(NiFpga_Session session, uint32_t fifo);
+	NiFpga_Status (*ReadFifoU32)(NiFpga_Session session, uint32_t fifo,
+		uint32_t *data, size_t numberOfElements, uint32_t timeout,
+		size_t *elementsRemaining);
+	NiFpga_Status (*WriteFifoU32)(NiFpga_Session session, uint32_t fifo,
+		const uint32_t *data, size_t numberOfElements, uint32_t timeout,
+		size_t *emptyElementsRemaining);
+};
+
+
+extern const struct FpgaBackend NiFpgaBackend;
@@ -0,0 +1,137 @@
+#include "FrameAverager.h"
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <emmintrin.h>
+
+
+struct FrameAverager
+{
+	uint32_t channelCount;
+	size_t pixelsPerFrame;
+	uint32_t *sums[4]; // 16-byte aligned
+	uint32_t counts[4];
+};
+
+
+OScDev_Error FrameAverager_Create(struct FrameAverager **averager,
+	uint32_t channelCount, size_t pixelsPerFrame)
+{
+	*averager = NULL;
+	if (channelCount == 0 || channelCount > 4)
+		return OScDev_Error_Illegal_Argument;
+
+	struct FrameAverager *a = calloc(1, sizeof(struct FrameAverager));
+	if (a == NULL)
+		return OScDev_Error_Out_Of_Memory;
+	a->channelCount = channelCount;
+	a->pixelsPerFrame = pixelsPerFrame;
+	for (uint32_t ch = 0; ch < channelCount; ++ch)
+	{
+		a->sums[ch] = _aligned_malloc(sizeof(uint32_t) * pixelsPerFrame, 16);
+		if (a->sums[ch] == NULL)
+		{
+			FrameAverager_Destroy(a);
+			return OScDev_Error_Out_Of_Memory;
+		}
+	}
+
+	*averager = a;
+	return OScDev_OK;
+}
+
+
+void FrameAverager_Destroy(struct FrameAverager *averager)
+{
+	if (averager == NULL)
+		return;
+	for (uint32_t ch = 0; ch < averager->channelCount; ++ch)
+		_aligned_free(averager->sums[ch]);
+	free(averager);
+}
+
+
+void FrameAverager_Reset(struct FrameAverager *averager)
+{
+	for (uint32_t ch = 0; ch < averager->channelCount; ++ch)
+		averager->counts[ch] = 0;
+}
+
+
+void FrameAverager_Add(struct FrameAverager *averager, uint32_t channel,
+	uint32_t *words)
+{
+	if (channel >= averager->channelCount)
+		return;
+
+	uint32_t *sums = averager->sums[channel];
+	size_t n = averager->pixelsPerFrame;
+	size_t i = 0;
+
+	// The first frame after a reset stores instead of adding, so the sums
+	// never need clearing; its mean is the frame itself
+	if (averager->counts[channel] == 0)
+	{
+		const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128i w = _mm_loadu_si128((const __m128i *)(words + i));
+			__m128i raw = _mm_and_si128(w, lowMask);
+			_mm_store_si128((__m128i *)(sums + i), raw);
+			_mm_storeu_si128((__m128i *)(words + i),
+				_mm_or_si128(_mm_slli_epi32(raw, 16), raw));
+		}
+		for (; i < n; ++i)
+		{
+			uint32_t raw = words[i] & 0xFFFF;
+			sums[i] = raw;
+			words[i] = (raw << 16) | raw;
+		}
+		averager->counts[channel] = 1;
+		return;
+	}
+
+	// Frames past FRAME_AVERAGER_MAX_FRAMES would overflow the sums; they
+	// are left out of them but still carry the mean of the frames so far
+	bool accumulate = averager->counts[channel] < FRAME_AVERAGER_MAX_FRAMES;
+	if (accumulate)
+		++averager->counts[channel];
+	uint32_t count = averager->counts[channel];
+	uint32_t addMask = accumulate ? 0xFFFF : 0;
+
+	// The mean is rounded as the integer (sum + count / 2) / count, with
+	// sum + count / 2 < 2^31. SSE2 has no integer division, so the
+	// quotient is taken in double precision, where the conversions are
+	// exact and the division is correctly rounded: an integer quotient
+	// comes out exactly, and any other lies at least 1 / count above the
+	// integer below it, so truncation matches the integer result.
+	const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+	const __m128i addMasks = _mm_set1_epi32((int)addMask);
+	const __m128i bias = _mm_set1_epi32((int)(count / 2));
+	const __m128d divisor = _mm_set1_pd((double)count);
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i w = _mm_loadu_si128((const __m128i *)(words + i));
+		__m128i raw = _mm_and_si128(w, lowMask);
+		__m128i sum = _mm_add_epi32(_mm_load_si128((const __m128i *)(sums + i)),
+			_mm_and_si128(raw, addMasks));
+		_mm_store_si128((__m128i *)(sums + i), sum);
+		__m128i biased = _mm_add_epi32(sum, bias);
+		__m128i meanLow = _mm_cvttpd_epi32(
+			_mm_div_pd(_mm_cvtepi32_pd(biased), divisor));
+		__m128i meanHigh = _mm_cvttpd_epi32(
+			_mm_div_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(biased, _MM_SHUFFLE(1, 0, 3, 2))), divisor));
+		__m128i mean = _mm_unpacklo_epi64(meanLow, meanHigh);
+		_mm_storeu_si128((__m128i *)(words + i),
+			_mm_or_si128(_mm_slli_epi32(mean, 16), raw));
+	}
+	for (; i < n; ++i)
+	{
+		uint32_t raw = words[i] & 0xFFFF;
+		sums[i] += raw & addMask;
+		uint32_t mean = (sums[i] + count / 2) / count;
+		words[i] = (mean << 16) | raw;
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "OpenScanDeviceLib.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Host-side frame averaging
+//
+// Sums the raw (low 16-bit) samples of successive frames in 32-bit
+// accumulators and writes the running mean back into the high 16 bits of
+// each FIFO word, where the firmware would otherwise have put its own
+// average. Unpacking therefore sees the same word layout whichever side
+// averages. Raw capture takes the words before they are rewritten.
+//
+// The accumulators hold at least FRAME_AVERAGER_MAX_FRAMES full-scale
+// samples without overflow.
+
+#define FRAME_AVERAGER_MAX_FRAMES 10000
+
+struct FrameAverager;
+
+OScDev_Error FrameAverager_Create(struct FrameAverager **averager,
+	uint32_t channelCount, size_t pixelsPerFrame);
+void FrameAverager_Destroy(struct FrameAverager *averager);
+
+// Start a new average; the next frame added replaces the accumulated sum
+void FrameAverager_Reset(struct FrameAverager *averager);
+
+// Add one channel of a frame and rewrite the high halves of words with the
+// mean of all frames added to that channel since the last reset. Only the
+// first FRAME_AVERAGER_MAX_FRAMES frames count toward the mean; later ones
+// are given the mean as it stands.
+void FrameAverager_Add(struct FrameAverager *averager, uint32_t channel,
+	uint32_t *words);
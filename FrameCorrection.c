@@ -0,0 +1,150 @@
+#include "FrameCorrection.h"
+#include "Log.h"
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Windows.h>
+
+
+#define MAX_CHANNELS 4
+
+
+struct FrameCorrection
+{
+	uint32_t channelCount;
+	struct FrameCorrectionMaps maps[MAX_CHANNELS];
+	bool hasMaps[MAX_CHANNELS];
+};
+
+
+// Returns NULL, without logging, if the file does not exist
+static void *ReadMapFile(OScDev_Device *device, const char *path,
+	size_t expectedBytes, OScDev_Error *err)
+{
+	*err = OScDev_OK;
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	void *data = NULL;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart != expectedBytes)
+	{
+		NIFPGA_LOG_ERROR(device, "Correction map %s is not %zu bytes", path, expectedBytes);
+		*err = OScDev_Error_Unknown;
+		goto done;
+	}
+
+	data = _aligned_malloc(expectedBytes, 16);
+	if (data == NULL)
+	{
+		*err = OScDev_Error_Out_Of_Memory;
+		goto done;
+	}
+	size_t offset = 0;
+	while (offset < expectedBytes)
+	{
+		size_t remaining = expectedBytes - offset;
+		DWORD chunk = remaining < (1 << 24) ? (DWORD)remaining : (1 << 24);
+		DWORD read;
+		if (!ReadFile(file, (char *)data + offset, chunk, &read, NULL) || read == 0)
+		{
+			NIFPGA_LOG_ERROR(device, "Cannot read correction map %s", path);
+			_aligned_free(data);
+			data = NULL;
+			*err = OScDev_Error_Unknown;
+			goto done;
+		}
+		offset += read;
+	}
+
+done:
+	CloseHandle(file);
+	return data;
+}
+
+
+OScDev_Error FrameCorrection_Load(struct FrameCorrection **correction,
+	OScDev_Device *device, const char *directory,
+	uint32_t channelCount, uint32_t resolution)
+{
+	*correction = NULL;
+	if (channelCount == 0 || channelCount > MAX_CHANNELS)
+		return OScDev_Error_Illegal_Argument;
+
+	struct FrameCorrection *c = calloc(1, sizeof(struct FrameCorrection));
+	if (c == NULL)
+		return OScDev_Error_Out_Of_Memory;
+	c->channelCount = channelCount;
+
+	size_t nPixels = (size_t)resolution * resolution;
+	OScDev_Error err;
+	for (uint32_t ch = 0; ch < channelCount; ++ch)
+	{
+		char path[MAX_PATH];
+		snprintf(path, sizeof(path), "%s\\dark%u.raw", directory, ch);
+		c->maps[ch].dark = ReadMapFile(device, path, nPixels * sizeof(uint16_t), &err);
+		if (err != OScDev_OK)
+			goto error;
+
+		snprintf(path, sizeof(path), "%s\\flat%u.raw", directory, ch);
+		float *flat = ReadMapFile(device, path, nPixels * sizeof(float), &err);
+		if (err != OScDev_OK)
+			goto error;
+		if (flat != NULL)
+		{
+			// Convert in place; each 16-bit gain lands on a float already read
+			const float maxGain = 65535.0f / (1 << FRAME_CORRECTION_GAIN_FRACTION_BITS);
+			uint16_t *gain = (uint16_t *)flat;
+			for (size_t i = 0; i < nPixels; ++i)
+			{
+				float g = flat[i];
+				if (!(g > 0.0f))
+					g = 0.0f;
+				else if (g > maxGain)
+					g = maxGain;
+				gain[i] = (uint16_t)(g * (1 << FRAME_CORRECTION_GAIN_FRACTION_BITS) + 0.5f);
+			}
+			c->maps[ch].gain = gain;
+		}
+
+		c->hasMaps[ch] = c->maps[ch].dark != NULL || c->maps[ch].gain != NULL;
+		NIFPGA_LOG_INFO(device, "Channel %u correction: dark %s, flat %s", ch,
+			c->maps[ch].dark != NULL ? "on" : "off",
+			c->maps[ch].gain != NULL ? "on" : "off");
+	}
+
+	*correction = c;
+	return OScDev_OK;
+
+error:
+	FrameCorrection_Destroy(c);
+	return err;
+}
+
+
+void FrameCorrection_Destroy(struct FrameCorrection *correction)
+{
+	if (correction == NULL)
+		return;
+	for (uint32_t ch = 0; ch < correction->channelCount; ++ch)
+	{
+		_aligned_free((void *)correction->maps[ch].dark);
+		_aligned_free((void *)correction->maps[ch].gain);
+	}
+	free(correction);
+}
+
+
+const struct FrameCorrectionMaps *FrameCorrection_GetMaps(
+	const struct FrameCorrection *correction, uint32_t channel)
+{
+	if (correction == NULL || channel >= correction->channelCount ||
+		!correction->hasMaps[channel])
+		return NULL;
+	return &correction->maps[channel];
+}
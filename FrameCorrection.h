@@ -0,0 +1,40 @@
+#pragma once
+
+#include "OpenScanDeviceLib.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Dark-offset and flat-field correction maps
+//
+// Loaded from a directory once per acquisition, for its resolution. For
+// each channel N (counted from 0), the directory may contain:
+//
+// - darkN.raw: resolution^2 little-endian uint16 dark offsets
+// - flatN.raw: resolution^2 little-endian float32 gains
+//
+// A missing file disables that correction for the channel. Gains are
+// stored as unsigned Q2.14 fixed point (0 to just under 4), so that the
+// unpack kernel applies them with 16-bit multiplies (see FrameUnpack.h):
+//
+//   corrected = min(65535, max(0, sample - dark) * gain)
+
+#define FRAME_CORRECTION_GAIN_FRACTION_BITS 14
+
+struct FrameCorrectionMaps
+{
+	const uint16_t *dark; // Null if not corrected
+	const uint16_t *gain; // Q2.14; null if not corrected
+};
+
+struct FrameCorrection;
+
+OScDev_Error FrameCorrection_Load(struct FrameCorrection **correction,
+	OScDev_Device *device, const char *directory,
+	uint32_t channelCount, uint32_t resolution);
+void FrameCorrection_Destroy(struct FrameCorrection *correction);
+
+// Null if the channel has neither map
+const struct FrameCorrectionMaps *FrameCorrection_GetMaps(
+	const struct FrameCorrection *correction, uint32_t channel);
@@ -0,0 +1,215 @@
+#include "FramePipeline.h"
+#include "FrameCorrection.h"
+#include "FrameStats.h"
+#include "FrameUnpack.h"
+#include "Preview.h"
+#include "TemporalFilter.h"
+#include "WorkPool.h"
+
+#include <stddef.h>
+
+
+// Rows per parallel task are a whole number of bands, sized so that the
+// FIFO words, output planes and filter state of all channels of a tile
+// stay within a typical 256 KiB L2 cache
+#define TILE_TARGET_BYTES (256 * 1024)
+#define TILE_BYTES_PER_SAMPLE 16
+// Enough tasks per worker for stealing to even out the load
+#define MIN_TILES_PER_WORKER 4
+// Smaller frames (in samples over all channels) are processed on the
+// calling thread, where they take less time than waking the workers
+#define PARALLEL_MIN_SAMPLES (256 * 1024)
+
+
+// The layout of the frame whose callbacks are in progress on this thread
+static __declspec(thread) const OScNIFPGA_FrameLayout *currentLayout;
+
+
+void FramePipeline_ProcessBand(struct FramePipelineFrame *frame, uint32_t channel,
+	uint32_t firstRow, uint32_t rowCount,
+	OScNIFPGA_FrameStats *averagedStats, OScNIFPGA_FrameStats *rawStats)
+{
+	size_t begin = (size_t)firstRow * frame->resolution;
+	size_t end = begin + (size_t)rowCount * frame->resolution;
+
+	// The filter, when active, writes the final averaged pixels
+	FrameUnpack_Split(frame->words[channel], begin, end,
+		frame->averaged[channel], frame->raw[channel],
+		FrameCorrection_GetMaps(frame->correction, channel),
+		frame->filter != NULL ? NULL : averagedStats, rawStats);
+
+	if (frame->filter != NULL)
+	{
+		TemporalFilter_Apply(frame->filter, channel, frame->averaged[channel],
+			begin, end, averagedStats);
+	}
+
+	if (frame->preview != NULL)
+	{
+		Preview_AddRows(frame->preview, channel, frame->averaged[channel],
+			firstRow, rowCount);
+	}
+}
+
+
+void FramePipeline_InterleaveBand(struct FramePipelineFrame *frame,
+	uint32_t firstRow, uint32_t rowCount)
+{
+	uint16_t *planes[8];
+	uint32_t planeCount = 0;
+	for (uint32_t ch = 0; ch < frame->channelCount; ++ch)
+		planes[planeCount++] = frame->averaged[ch];
+	for (uint32_t ch = 0; ch < frame->channelCount; ++ch)
+	{
+		if (frame->raw[ch] != NULL)
+			planes[planeCount++] = frame->raw[ch];
+	}
+
+	size_t begin = (size_t)firstRow * frame->resolution;
+	size_t end = begin + (size_t)rowCount * frame->resolution;
+	FrameUnpack_Interleave(planes, planeCount, begin, end, frame->interleaved);
+}
+
+
+// Point averagedStats and rawStats at slots of base, in the order of
+// frame->stats, and reset them
+static void BindStats(const struct FramePipelineFrame *frame, OScNIFPGA_FrameStats *base,
+	OScNIFPGA_FrameStats **averagedStats, OScNIFPGA_FrameStats **rawStats)
+{
+	for (uint32_t ch = 0; ch < frame->channelCount; ++ch)
+	{
+		averagedStats[ch] = NULL;
+		rawStats[ch] = NULL;
+		if (base == NULL)
+			continue;
+		averagedStats[ch] = &base[ch];
+		FrameStats_Reset(averagedStats[ch]);
+		if (frame->raw[ch] != NULL)
+		{
+			rawStats[ch] = &base[frame->channelCount + ch];
+			FrameStats_Reset(rawStats[ch]);
+		}
+	}
+}
+
+
+static void ProcessRows(struct FramePipelineFrame *frame, uint32_t firstRow, uint32_t endRow,
+	OScNIFPGA_FrameStats *const *averagedStats, OScNIFPGA_FrameStats *const *rawStats)
+{
+	for (uint32_t row = firstRow; row < endRow; row += FRAME_PIPELINE_BAND_ROWS)
+	{
+		uint32_t rows = endRow - row < FRAME_PIPELINE_BAND_ROWS ?
+			endRow - row : FRAME_PIPELINE_BAND_ROWS;
+		for (uint32_t ch = 0; ch < frame->channelCount; ++ch)
+			FramePipeline_ProcessBand(frame, ch, row, rows, averagedStats[ch], rawStats[ch]);
+		if (frame->interleaved != NULL)
+			FramePipeline_InterleaveBand(frame, row, rows);
+	}
+}
+
+
+struct TileRun
+{
+	struct FramePipelineFrame *frame;
+	uint32_t tileRows;
+	// Per worker, into separate statistics that are merged afterwards
+	OScNIFPGA_FrameStats *averagedStats[WORK_POOL_MAX_WORKERS][4];
+	OScNIFPGA_FrameStats *rawStats[WORK_POOL_MAX_WORKERS][4];
+};
+
+
+static void ProcessTile(void *context, uint32_t tile, uint32_t worker)
+{
+	struct TileRun *run = context;
+	uint32_t resolution = run->frame->resolution;
+	uint32_t firstRow = tile * run->tileRows;
+	uint32_t endRow = resolution - firstRow < run->tileRows ?
+		resolution : firstRow + run->tileRows;
+	ProcessRows(run->frame, firstRow, endRow,
+		run->averagedStats[worker], run->rawStats[worker]);
+}
+
+
+static uint32_t TileRows(const struct FramePipelineFrame *frame, uint32_t workerCount)
+{
+	size_t bytesPerRow = (size_t)frame->resolution * frame->channelCount *
+		TILE_BYTES_PER_SAMPLE;
+	uint32_t rows = (uint32_t)(TILE_TARGET_BYTES / bytesPerRow);
+	uint32_t maxRows = frame->resolution / (workerCount * MIN_TILES_PER_WORKER);
+	if (rows > maxRows)
+		rows = maxRows;
+	rows -= rows % FRAME_PIPELINE_BAND_ROWS;
+	return rows > 0 ? rows : FRAME_PIPELINE_BAND_ROWS;
+}
+
+
+static bool ProcessInParallel(struct FramePipelineFrame *frame, struct WorkPool *pool)
+{
+	uint32_t workerCount = WorkPool_GetWorkerCount(pool);
+	uint32_t statsPerWorker = 2 * frame->channelCount;
+	OScNIFPGA_FrameStats *workerStats = NULL;
+	if (frame->stats != NULL)
+	{
+		workerStats = frame->workerStats;
+		if (workerStats == NULL)
+			return false;
+	}
+
+	struct TileRun run;
+	run.frame = frame;
+	run.tileRows = TileRows(frame, workerCount);
+	for (uint32_t w = 0; w < workerCount; ++w)
+	{
+		BindStats(frame, workerStats != NULL ? workerStats + w * statsPerWorker : NULL,
+			run.averagedStats[w], run.rawStats[w]);
+	}
+
+	uint32_t tileCount = (frame->resolution + run.tileRows - 1) / run.tileRows;
+	WorkPool_Run(pool, tileCount, ProcessTile, &run);
+
+	if (workerStats != NULL)
+	{
+		OScNIFPGA_FrameStats *averagedStats[4];
+		OScNIFPGA_FrameStats *rawStats[4];
+		BindStats(frame, frame->stats, averagedStats, rawStats);
+		for (uint32_t w = 0; w < workerCount; ++w)
+		{
+			for (uint32_t ch = 0; ch < frame->channelCount; ++ch)
+			{
+				FrameStats_Merge(averagedStats[ch], run.averagedStats[w][ch]);
+				if (rawStats[ch] != NULL)
+					FrameStats_Merge(rawStats[ch], run.rawStats[w][ch]);
+			}
+		}
+	}
+	return true;
+}
+
+
+void FramePipeline_Process(struct FramePipelineFrame *frame, struct WorkPool *pool)
+{
+	size_t samples = (size_t)frame->resolution * frame->resolution * frame->channelCount;
+	if (pool != NULL && WorkPool_GetWorkerCount(pool) > 1 &&
+		samples >= PARALLEL_MIN_SAMPLES && ProcessInParallel(frame, pool))
+		return;
+
+	OScNIFPGA_FrameStats *averagedStats[4];
+	OScNIFPGA_FrameStats *rawStats[4];
+	BindStats(frame, frame->stats, averagedStats, rawStats);
+	ProcessRows(frame, 0, frame->resolution, averagedStats, rawStats);
+}
+
+
+void FramePipeline_SetCurrentLayout(const OScNIFPGA_FrameLayout *layout)
+{
+	currentLayout = layout;
+}
+
+
+bool OScNIFPGA_GetFrameLayout(OScNIFPGA_FrameLayout *layout)
+{
+	if (currentLayout == NULL)
+		return false;
+	*layout = *currentLayout;
+	return true;
+}
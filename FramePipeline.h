@@ -0,0 +1,71 @@
+#pragma once
+
+#include "OScNIFPGAFrameLayout.h"
+#include "OScNIFPGAFrameStats.h"
+
+#include <stdint.h>
+
+
+// Host-side processing of one frame, from FIFO words to delivered pixels
+//
+// Each channel is processed in bands of rows, and every stage runs on a
+// band before the next band is touched, so that the band stays in cache:
+// unpack with correction (FrameUnpack.h), temporal filter
+// (TemporalFilter.h), then preview downsampling (Preview.h). Statistics
+// are accumulated by whichever stage writes the final pixels. For
+// interleaved delivery, all channels of a band are processed before the
+// band is interleaved.
+//
+// Given a work pool (WorkPool.h), large frames are split into tiles of
+// whole bands, sized to stay in cache, and the tiles are processed in
+// parallel, each worker into its own statistics.
+
+#define FRAME_PIPELINE_BAND_ROWS 8
+
+struct FrameCorrection;
+struct Preview;
+struct TemporalFilter;
+struct WorkPool;
+
+struct FramePipelineFrame
+{
+	uint32_t resolution;
+	uint32_t channelCount;
+	uint32_t *words[4];
+	uint16_t *averaged[4];
+	uint16_t *raw[4]; // Null unless raw planes are delivered
+	// Averaged then raw samples of each pixel; null for planar delivery
+	uint16_t *interleaved;
+
+	// Optional stages; null when not in use
+	const struct FrameCorrection *correction;
+	struct TemporalFilter *filter;
+	struct Preview *preview;
+
+	// Null, or per delivered channel: averaged planes, then raw planes
+	OScNIFPGA_FrameStats *stats;
+	// With stats, room for 2 * channelCount statistics per worker of the
+	// pool, reused from frame to frame; frames with stats are processed on
+	// the calling thread without it
+	OScNIFPGA_FrameStats *workerStats;
+};
+
+// Process all channels of the frame, on the workers of pool unless it is
+// null. TemporalFilter_BeginFrame must already have been called.
+void FramePipeline_Process(struct FramePipelineFrame *frame, struct WorkPool *pool);
+
+// Interleave rows [firstRow, firstRow + rowCount) of all processed planes
+void FramePipeline_InterleaveBand(struct FramePipelineFrame *frame,
+	uint32_t firstRow, uint32_t rowCount);
+
+// Publish the layout of the frame whose callbacks are about to be called
+// on this thread (NULL to withdraw it)
+void FramePipeline_SetCurrentLayout(const OScNIFPGA_FrameLayout *layout);
+
+// Process rows [firstRow, firstRow + rowCount) of one channel, adding the
+// statistics to averagedStats and rawStats unless null. firstRow must be a
+// multiple of FRAME_PIPELINE_BAND_ROWS. Disjoint bands may be processed
+// concurrently, into separate statistics.
+void FramePipeline_ProcessBand(struct FramePipelineFrame *frame, uint32_t channel,
+	uint32_t firstRow, uint32_t rowCount,
+	OScNIFPGA_FrameStats *averagedStats, OScNIFPGA_FrameStats *rawStats);
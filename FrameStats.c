@@ -0,0 +1,47 @@
+#include "FrameStats.h"
+
+#include <string.h>
+
+
+// The frame whose callbacks are in progress on this thread
+static __declspec(thread) const OScNIFPGA_FrameStats *currentStats;
+static __declspec(thread) uint32_t currentChannelCount;
+
+
+void FrameStats_Reset(OScNIFPGA_FrameStats *stats)
+{
+	memset(stats, 0, sizeof(OScNIFPGA_FrameStats));
+	stats->min = UINT16_MAX;
+}
+
+
+void FrameStats_Merge(OScNIFPGA_FrameStats *dst, const OScNIFPGA_FrameStats *src)
+{
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->pixelCount += src->pixelCount;
+	dst->sum += src->sum;
+	dst->saturatedCount += src->saturatedCount;
+	for (int i = 0; i < OSCNIFPGA_HISTOGRAM_BINS; ++i)
+		dst->histogram[i] += src->histogram[i];
+	dst->mean = dst->pixelCount > 0 ?
+		(double)dst->sum / dst->pixelCount : 0.0;
+}
+
+
+void FrameStats_SetCurrent(const OScNIFPGA_FrameStats *stats, uint32_t channelCount)
+{
+	currentStats = stats;
+	currentChannelCount = stats != NULL ? channelCount : 0;
+}
+
+
+bool OScNIFPGA_GetFrameStats(uint32_t channel, OScNIFPGA_FrameStats *stats)
+{
+	if (currentStats == NULL || channel >= currentChannelCount)
+		return false;
+	*stats = currentStats[channel];
+	return true;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "OScNIFPGAFrameStats.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <emmintrin.h>
+
+
+// Fused per-frame statistics
+//
+// A pass that produces output pixels (unpacking, filtering) feeds each
+// vector of 8 pixels it stores to a FrameStatsAccumulator, which keeps the
+// running min, max, sum and saturation count in registers and the
+// histogram in the target OScNIFPGA_FrameStats.
+
+void FrameStats_Reset(OScNIFPGA_FrameStats *stats);
+
+// Combine statistics of disjoint parts of the same frame
+void FrameStats_Merge(OScNIFPGA_FrameStats *dst, const OScNIFPGA_FrameStats *src);
+
+// Publish the statistics of the frame whose callbacks are about to be
+// called on this thread (NULL to withdraw them)
+void FrameStats_SetCurrent(const OScNIFPGA_FrameStats *stats, uint32_t channelCount);
+
+
+// Lane counters are flushed to the 64-bit totals often enough that
+// neither the 32-bit sums nor the 16-bit saturation counts overflow
+#define FRAME_STATS_FLUSH_INTERVAL 4096
+
+struct FrameStatsAccumulator
+{
+	OScNIFPGA_FrameStats *stats;
+	__m128i min; // Biased by 0x8000 for signed comparison
+	__m128i max;
+	__m128i sum; // 4 x uint32
+	__m128i saturated; // 8 x uint16, counting down from 0
+	uint32_t pending;
+};
+
+
+static inline void FrameStatsAccumulator_Begin(struct FrameStatsAccumulator *acc,
+	OScNIFPGA_FrameStats *stats)
+{
+	acc->stats = stats;
+	acc->min = _mm_set1_epi16(0x7FFF);
+	acc->max = _mm_set1_epi16((short)0x8000);
+	acc->sum = _mm_setzero_si128();
+	acc->saturated = _mm_setzero_si128();
+	acc->pending = 0;
+}
+
+
+static inline void FrameStatsAccumulator_Flush(struct FrameStatsAccumulator *acc)
+{
+	uint32_t sums[4];
+	uint16_t saturated[8];
+	_mm_storeu_si128((__m128i *)sums, acc->sum);
+	_mm_storeu_si128((__m128i *)saturated, acc->saturated);
+	for (int k = 0; k < 4; ++k)
+		acc->stats->sum += sums[k];
+	for (int k = 0; k < 8; ++k)
+		acc->stats->saturatedCount += (uint16_t)(0 - saturated[k]);
+	acc->sum = _mm_setzero_si128();
+	acc->saturated = _mm_setzero_si128();
+	acc->pending = 0;
+}
+
+
+static inline void FrameStatsAccumulator_Add8(struct FrameStatsAccumulator *acc,
+	__m128i pixels)
+{
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i biased = _mm_xor_si128(pixels, bias);
+	acc->min = _mm_min_epi16(acc->min, biased);
+	acc->max = _mm_max_epi16(acc->max, biased);
+	acc->sum = _mm_add_epi32(acc->sum, _mm_add_epi32(
+		_mm_unpacklo_epi16(pixels, zero), _mm_unpackhi_epi16(pixels, zero)));
+	acc->saturated = _mm_add_epi16(acc->saturated,
+		_mm_cmpeq_epi16(pixels, _mm_set1_epi16((short)OSCNIFPGA_SATURATED_VALUE)));
+
+	uint16_t lanes[8];
+	_mm_storeu_si128((__m128i *)lanes, pixels);
+	uint32_t *histogram = acc->stats->histogram;
+	for (int k = 0; k < 8; ++k)
+		++histogram[lanes[k] >> 8];
+
+	acc->stats->pixelCount += 8;
+	if (++acc->pending == FRAME_STATS_FLUSH_INTERVAL)
+		FrameStatsAccumulator_Flush(acc);
+}
+
+
+static inline void FrameStatsAccumulator_Add1(struct FrameStatsAccumulator *acc,
+	uint16_t pixel)
+{
+	OScNIFPGA_FrameStats *stats = acc->stats;
+	if (pixel < stats->min)
+		stats->min = pixel;
+	if (pixel > stats->max)
+		stats->max = pixel;
+	stats->sum += pixel;
+	if (pixel == OSCNIFPGA_SATURATED_VALUE)
+		++stats->saturatedCount;
+	++stats->histogram[pixel >> 8];
+	++stats->pixelCount;
+}
+
+
+// For passes that leave a range of pixels unchanged
+static inline void FrameStatsAccumulator_AddRange(struct FrameStatsAccumulator *acc,
+	const uint16_t *pixels, size_t begin, size_t end)
+{
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+		FrameStatsAccumulator_Add8(acc, _mm_loadu_si128((const __m128i *)(pixels + i)));
+	for (; i < end; ++i)
+		FrameStatsAccumulator_Add1(acc, pixels[i]);
+}
+
+
+static inline void FrameStatsAccumulator_End(struct FrameStatsAccumulator *acc)
+{
+	FrameStatsAccumulator_Flush(acc);
+
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	uint16_t mins[8], maxs[8];
+	_mm_storeu_si128((__m128i *)mins, _mm_xor_si128(acc->min, bias));
+	_mm_storeu_si128((__m128i *)maxs, _mm_xor_si128(acc->max, bias));
+	OScNIFPGA_FrameStats *stats = acc->stats;
+	for (int k = 0; k < 8; ++k)
+	{
+		if (mins[k] < stats->min)
+			stats->min = mins[k];
+		if (maxs[k] > stats->max)
+			stats->max = maxs[k];
+	}
+	stats->mean = stats->pixelCount > 0 ?
+		(double)stats->sum / stats->pixelCount : 0.0;
+}
@@ -0,0 +1,190 @@
+#include "FrameUnpack.h"
+#include "FrameStats.h"
+
+#include <stdbool.h>
+
+#include <emmintrin.h>
+
+
+// Arithmetic shifts sign-extend each 16-bit half, so the signed saturating
+// pack reproduces its bits exactly
+static inline __m128i PackHigh(__m128i a, __m128i b)
+{
+	return _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+}
+
+
+static inline __m128i PackLow(__m128i a, __m128i b)
+{
+	return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+		_mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+}
+
+
+// Dark subtraction saturates at 0; the Q2.14 gain product is formed in 32
+// bits from the low and high halves of the 16-bit multiply, rounded, and
+// saturated at 65535 by the biased signed pack
+static inline __m128i Correct8(__m128i v, const struct FrameCorrectionMaps *correction, size_t i)
+{
+	if (correction->dark != NULL)
+		v = _mm_subs_epu16(v, _mm_loadu_si128((const __m128i *)(correction->dark + i)));
+	if (correction->gain != NULL)
+	{
+		const __m128i round = _mm_set1_epi32(1 << (FRAME_CORRECTION_GAIN_FRACTION_BITS - 1));
+		const __m128i bias32 = _mm_set1_epi32(0x8000);
+		const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+		__m128i g = _mm_loadu_si128((const __m128i *)(correction->gain + i));
+		__m128i lo = _mm_mullo_epi16(v, g);
+		__m128i hi = _mm_mulhi_epu16(v, g);
+		__m128i p0 = _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round),
+			FRAME_CORRECTION_GAIN_FRACTION_BITS);
+		__m128i p1 = _mm_srli_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round),
+			FRAME_CORRECTION_GAIN_FRACTION_BITS);
+		v = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(p0, bias32), _mm_sub_epi32(p1, bias32)),
+			bias16);
+	}
+	return v;
+}
+
+
+static inline uint16_t Correct1(uint16_t sample, const struct FrameCorrectionMaps *correction, size_t i)
+{
+	uint32_t v = sample;
+	if (correction->dark != NULL)
+		v = v > correction->dark[i] ? v - correction->dark[i] : 0;
+	if (correction->gain != NULL)
+	{
+		v = (v * correction->gain[i] + (1 << (FRAME_CORRECTION_GAIN_FRACTION_BITS - 1))) >>
+			FRAME_CORRECTION_GAIN_FRACTION_BITS;
+		if (v > UINT16_MAX)
+			v = UINT16_MAX;
+	}
+	return (uint16_t)v;
+}
+
+
+// Instantiated for each combination of outputs so that the inner loop
+// carries no per-pixel branches beyond the loop-invariant correction test
+static inline void Split(const uint32_t *words, size_t begin, size_t end,
+	uint16_t *averaged, uint16_t *raw,
+	const struct FrameCorrectionMaps *correction,
+	OScNIFPGA_FrameStats *averagedStats, OScNIFPGA_FrameStats *rawStats,
+	bool withRaw, bool withAveragedStats, bool withRawStats)
+{
+	struct FrameStatsAccumulator averagedAcc, rawAcc;
+	if (withAveragedStats)
+		FrameStatsAccumulator_Begin(&averagedAcc, averagedStats);
+	if (withRawStats)
+		FrameStatsAccumulator_Begin(&rawAcc, rawStats);
+
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(words + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(words + i + 4));
+		__m128i high = PackHigh(a, b);
+		if (correction != NULL)
+			high = Correct8(high, correction, i);
+		_mm_storeu_si128((__m128i *)(averaged + i), high);
+		if (withAveragedStats)
+			FrameStatsAccumulator_Add8(&averagedAcc, high);
+		if (withRaw)
+		{
+			__m128i low = PackLow(a, b);
+			if (correction != NULL)
+				low = Correct8(low, correction, i);
+			_mm_storeu_si128((__m128i *)(raw + i), low);
+			if (withRawStats)
+				FrameStatsAccumulator_Add8(&rawAcc, low);
+		}
+	}
+	for (; i < end; ++i)
+	{
+		averaged[i] = (uint16_t)(words[i] >> 16);
+		if (correction != NULL)
+			averaged[i] = Correct1(averaged[i], correction, i);
+		if (withAveragedStats)
+			FrameStatsAccumulator_Add1(&averagedAcc, averaged[i]);
+		if (withRaw)
+		{
+			raw[i] = (uint16_t)words[i];
+			if (correction != NULL)
+				raw[i] = Correct1(raw[i], correction, i);
+			if (withRawStats)
+				FrameStatsAccumulator_Add1(&rawAcc, raw[i]);
+		}
+	}
+
+	if (withAveragedStats)
+		FrameStatsAccumulator_End(&averagedAcc);
+	if (withRawStats)
+		FrameStatsAccumulator_End(&rawAcc);
+}
+
+
+void FrameUnpack_Split(const uint32_t *words, size_t begin, size_t end,
+	uint16_t *averaged, uint16_t *raw,
+	const struct FrameCorrectionMaps *correction,
+	OScNIFPGA_FrameStats *averagedStats, OScNIFPGA_FrameStats *rawStats)
+{
+	bool withRaw = raw != NULL;
+	bool withAveragedStats = averagedStats != NULL;
+	bool withRawStats = withRaw && rawStats != NULL;
+
+	if (withRaw && withAveragedStats && withRawStats)
+		Split(words, begin, end, averaged, raw, correction, averagedStats, rawStats, true, true, true);
+	else if (withRaw && withAveragedStats)
+		Split(words, begin, end, averaged, raw, correction, averagedStats, NULL, true, true, false);
+	else if (withRaw && withRawStats)
+		Split(words, begin, end, averaged, raw, correction, NULL, rawStats, true, false, true);
+	else if (withRaw)
+		Split(words, begin, end, averaged, raw, correction, NULL, NULL, true, false, false);
+	else if (withAveragedStats)
+		Split(words, begin, end, averaged, NULL, correction, averagedStats, NULL, false, true, false);
+	else
+		Split(words, begin, end, averaged, NULL, correction, NULL, NULL, false, false, false);
+}
+
+
+void FrameUnpack_Interleave(uint16_t *const *planes, uint32_t planeCount,
+	size_t begin, size_t end, uint16_t *interleaved)
+{
+	size_t i = begin;
+	if (planeCount == 2)
+	{
+		const uint16_t *a = planes[0], *b = planes[1];
+		for (; i + 8 <= end; i += 8)
+		{
+			__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+			__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+			_mm_storeu_si128((__m128i *)(interleaved + 2 * i), _mm_unpacklo_epi16(va, vb));
+			_mm_storeu_si128((__m128i *)(interleaved + 2 * i + 8), _mm_unpackhi_epi16(va, vb));
+		}
+	}
+	else if (planeCount == 4)
+	{
+		const uint16_t *a = planes[0], *b = planes[1], *c = planes[2], *d = planes[3];
+		for (; i + 8 <= end; i += 8)
+		{
+			__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+			__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+			__m128i vc = _mm_loadu_si128((const __m128i *)(c + i));
+			__m128i vd = _mm_loadu_si128((const __m128i *)(d + i));
+			__m128i abLo = _mm_unpacklo_epi16(va, vb);
+			__m128i abHi = _mm_unpackhi_epi16(va, vb);
+			__m128i cdLo = _mm_unpacklo_epi16(vc, vd);
+			__m128i cdHi = _mm_unpackhi_epi16(vc, vd);
+			uint16_t *out = interleaved + 4 * i;
+			_mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi32(abLo, cdLo));
+			_mm_storeu_si128((__m128i *)(out + 8), _mm_unpackhi_epi32(abLo, cdLo));
+			_mm_storeu_si128((__m128i *)(out + 16), _mm_unpacklo_epi32(abHi, cdHi));
+			_mm_storeu_si128((__m128i *)(out + 24), _mm_unpackhi_epi32(abHi, cdHi));
+		}
+	}
+	for (; i < end; ++i)
+	{
+		uint16_t *out = interleaved + (size_t)planeCount * i;
+		for (uint32_t p = 0; p < planeCount; ++p)
+			out[p] = planes[p][i];
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "FrameCorrection.h"
+#include "OScNIFPGAFrameStats.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Unpacking of FIFO words into 16-bit frames
+//
+// Each FIFO word holds the averaged sample in its high 16 bits and the raw
+// (instantaneous) sample in its low 16 bits. Both planes are split out in a
+// single pass over the words, which also applies the dark and flat-field
+// correction (see FrameCorrection.h) and accumulates the statistics of
+// each plane (see FrameStats.h).
+
+// Unpack words [begin, end) into averaged and, unless it is NULL, raw.
+// Both planes are corrected with the maps unless correction is NULL.
+// Statistics are added to averagedStats and rawStats unless NULL. Disjoint
+// ranges of the same frame may be unpacked concurrently, into separate
+// statistics.
+void FrameUnpack_Split(const uint32_t *words, size_t begin, size_t end,
+	uint16_t *averaged, uint16_t *raw,
+	const struct FrameCorrectionMaps *correction,
+	OScNIFPGA_FrameStats *averagedStats, OScNIFPGA_FrameStats *rawStats);
+
+// Interleave samples [begin, end) of planeCount planes into pixel-major
+// order, planeCount samples per pixel
+void FrameUnpack_Interleave(uint16_t *const *planes, uint32_t planeCount,
+	size_t begin, size_t end, uint16_t *interleaved);
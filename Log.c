@@ -0,0 +1,90 @@
+#include "Log.h"
+#include "OScNIFPGADevicePrivate.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+
+bool LogIsTraceEnabled(OScDev_Device *device)
+{
+	return device != NULL && GetData(device)->debugTracing;
+}
+
+
+struct LogRateLimit *LogRateLimitForDevice(struct LogRateLimitSite *site,
+	OScDev_Device *device)
+{
+	for (int i = 0; i < NIFPGA_LOG_RATE_LIMIT_DEVICES - 1; ++i)
+	{
+		// Claim the first free one, unless another thread claims it first
+		struct LogRateLimit *limit = &site->devices[i];
+		OScDev_Device *owner = limit->device;
+		if (owner == NULL)
+			owner = InterlockedCompareExchangePointer((PVOID volatile *)&limit->device, device, NULL);
+		if (owner == NULL || owner == device)
+			return limit;
+	}
+	return &site->devices[NIFPGA_LOG_RATE_LIMIT_DEVICES - 1];
+}
+
+
+bool LogRateLimitAllows(struct LogRateLimit *limit, uint32_t intervalMs)
+{
+	LONG now = (LONG)GetTickCount();
+	LONG last = limit->lastTickMs;
+
+	if (limit->primed && (uint32_t)(now - last) < intervalMs)
+	{
+		InterlockedIncrement(&limit->suppressed);
+		return false;
+	}
+
+	// Another thread may have emitted from the same site in the meantime
+	if (InterlockedCompareExchange(&limit->lastTickMs, now, last) != last)
+	{
+		InterlockedIncrement(&limit->suppressed);
+		return false;
+	}
+
+	InterlockedExchange(&limit->primed, 1);
+	return true;
+}
+
+
+void LogFormatted(OScDev_Device *device, int level,
+	struct LogRateLimit *limit, const char *format, ...)
+{
+	char msg[OScDev_MAX_STR_LEN + 1];
+
+	va_list args;
+	va_start(args, format);
+	int len = vsnprintf(msg, sizeof(msg), format, args);
+	va_end(args);
+	if (len < 0)
+		return;
+
+	LONG suppressed = limit ? InterlockedExchange(&limit->suppressed, 0) : 0;
+	if (suppressed > 0 && (size_t)len < sizeof(msg))
+	{
+		snprintf(msg + len, sizeof(msg) - len,
+			" (%ld similar messages suppressed)", (long)suppressed);
+	}
+
+	switch (level)
+	{
+	case NIFPGA_LOG_LEVEL_ERROR:
+		OScDev_Log_Error(device, msg);
+		break;
+	case NIFPGA_LOG_LEVEL_WARNING:
+		OScDev_Log_Warning(device, msg);
+		break;
+	case NIFPGA_LOG_LEVEL_INFO:
+		OScDev_Log_Info(device, msg);
+		break;
+	case NIFPGA_LOG_LEVEL_DEBUG:
+	case NIFPGA_LOG_LEVEL_TRACE:
+	default:
+		OScDev_Log_Debug(device, msg);
+		break;
+	}
+}
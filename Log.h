@@ -0,0 +1,95 @@
+#pragma once
+
+#include "OpenScanDeviceLib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <Windows.h>
+
+
+// Formatted logging for the acquisition path.
+//
+// Messages below NIFPGA_LOG_LEVEL are removed by the preprocessor, together
+// with the evaluation of their arguments. Trace messages are additionally
+// gated at run time by the device's "DebugTracing" setting and rate limited
+// per call site and device, so that loops running once per FIFO poll do not pay for
+// snprintf() unless tracing was explicitly requested. In all cases the
+// message is only formatted after it has been decided that it will be
+// emitted.
+
+#define NIFPGA_LOG_LEVEL_TRACE 0
+#define NIFPGA_LOG_LEVEL_DEBUG 1
+#define NIFPGA_LOG_LEVEL_INFO 2
+#define NIFPGA_LOG_LEVEL_WARNING 3
+#define NIFPGA_LOG_LEVEL_ERROR 4
+
+// Define in the project settings to strip lower levels from the build
+#ifndef NIFPGA_LOG_LEVEL
+#define NIFPGA_LOG_LEVEL NIFPGA_LOG_LEVEL_TRACE
+#endif
+
+
+// Devices with a rate limit of their own at each call site; any further
+// devices share the last one
+#define NIFPGA_LOG_RATE_LIMIT_DEVICES 8
+
+
+struct LogRateLimit
+{
+	OScDev_Device *volatile device; // Null while unclaimed
+	volatile LONG primed;
+	volatile LONG lastTickMs;
+	volatile LONG suppressed;
+};
+
+
+struct LogRateLimitSite
+{
+	struct LogRateLimit devices[NIFPGA_LOG_RATE_LIMIT_DEVICES];
+};
+
+
+bool LogIsTraceEnabled(OScDev_Device *device);
+struct LogRateLimit *LogRateLimitForDevice(struct LogRateLimitSite *site,
+	OScDev_Device *device);
+bool LogRateLimitAllows(struct LogRateLimit *limit, uint32_t intervalMs);
+void LogFormatted(OScDev_Device *device, int level,
+	struct LogRateLimit *limit, const char *format, ...);
+
+
+#if NIFPGA_LOG_LEVEL <= NIFPGA_LOG_LEVEL_TRACE
+// intervalMs is the minimum time between two messages from this call site
+// for the same device; messages arriving earlier are counted and reported
+// with the next one.
+#define NIFPGA_LOG_TRACE(device, intervalMs, ...) \
+	do { \
+		static struct LogRateLimitSite logSite_; \
+		if (LogIsTraceEnabled(device)) { \
+			struct LogRateLimit *logLimit_ = LogRateLimitForDevice(&logSite_, (device)); \
+			if (LogRateLimitAllows(logLimit_, (intervalMs))) \
+				LogFormatted((device), NIFPGA_LOG_LEVEL_TRACE, logLimit_, __VA_ARGS__); \
+		} \
+	} while (0)
+#else
+#define NIFPGA_LOG_TRACE(device, intervalMs, ...) do { } while (0)
+#endif
+
+#if NIFPGA_LOG_LEVEL <= NIFPGA_LOG_LEVEL_DEBUG
+#define NIFPGA_LOG_DEBUG(device, ...) \
+	LogFormatted((device), NIFPGA_LOG_LEVEL_DEBUG, NULL, __VA_ARGS__)
+#else
+#define NIFPGA_LOG_DEBUG(device, ...) do { } while (0)
+#endif
+
+#if NIFPGA_LOG_LEVEL <= NIFPGA_LOG_LEVEL_INFO
+#define NIFPGA_LOG_INFO(device, ...) \
+	LogFormatted((device), NIFPGA_LOG_LEVEL_INFO, NULL, __VA_ARGS__)
+#else
+#define NIFPGA_LOG_INFO(device, ...) do { } while (0)
+#endif
+
+#define NIFPGA_LOG_WARNING(device, ...) \
+	LogFormatted((device), NIFPGA_LOG_LEVEL_WARNING, NULL, __VA_ARGS__)
+#define NIFPGA_LOG_ERROR(device, ...) \
+	LogFormatted((device), NIFPGA_LOG_LEVEL_ERROR, NULL, __VA_ARGS__)
@@ -1,11 +1,30 @@
 #include "OScNIFPGA.h"
+#include "OScNIFPGAArm.h"
+#include "AcquisitionQueue.h"
+#include "AcquisitionStager.h"
+#include "FifoReaders.h"
+#include "FpgaBackend.h"
+#include "FrameAverager.h"
+#include "FrameCorrection.h"
+#include "FrameStats.h"
+#include "FramePipeline.h"
+#include "Preview.h"
+#include "TemporalFilter.h"
+#include "Log.h"
+#include "RawCapture.h"
+#include "Replay.h"
+#include "ResidentWaveform.h"
+#include "SimFpga.h"
 #include "Waveform.h"
+#include "WaveformUpdater.h"
+#include "WorkPool.h"
 
 #include "NiFpga_OpenScanFPGAHost.h"
 #include <NiFpga.h>
 
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <Windows.h>
@@ -13,8 +32,24 @@
 
 // TODO Instead of reference counting NiFpga initialization,
 // use the OScDev_ModuleImpl Open() and Close() functions.
-static bool g_NiFpga_initialized = false;
-static size_t g_openDeviceCount = 0;
+// Devices may be enumerated, opened and closed on different threads.
+static SRWLOCK g_deviceCountLock = SRWLOCK_INIT;
+static bool g_NiFpga_initialized = false; // Guarded by g_deviceCountLock
+static size_t g_openDeviceCount = 0; // Hardware; guarded by g_deviceCountLock
+// Of any backend; the default frame processing threads are shared among
+// them (see StartWorkPool()). Guarded by g_deviceCountLock.
+static size_t g_allOpenDeviceCount = 0;
+
+
+// All detector data FIFOs; the firmware streams all four whatever the
+// channel count
+#define NUM_TARGET_TO_HOST_FIFOS 4
+static const uint32_t TargetToHostFifos[NUM_TARGET_TO_HOST_FIFOS] = {
+	NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettohostFIFO1,
+	NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO2,
+	NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO3,
+	NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO4,
+};
 
 
 static inline uint16_t DoubleToFixed16(double d, int intBits)
@@ -24,6 +59,7 @@ static inline uint16_t DoubleToFixed16(double d, int intBits)
 }
 
 
+// Call with g_deviceCountLock held
 static OScDev_Error EnsureNiFpgaInitialized(void)
 {
 	if (g_NiFpga_initialized)
@@ -39,6 +75,7 @@ static OScDev_Error EnsureNiFpgaInitialized(void)
 }
 
 
+// Call with g_deviceCountLock held
 static OScDev_Error DeinitializeNiFpga(void)
 {
 	if (!g_NiFpga_initialized)
@@ -51,77 +88,279 @@ static OScDev_Error DeinitializeNiFpga(void)
 }
 
 
+static OScDev_Error CountOpenDevice(const struct FpgaBackend *backend)
+{
+	OScDev_Error err = OScDev_OK;
+	AcquireSRWLockExclusive(&g_deviceCountLock);
+	if (backend->usesNiFpgaRuntime)
+	{
+		err = EnsureNiFpgaInitialized();
+		if (err == OScDev_OK)
+			++g_openDeviceCount;
+	}
+	if (err == OScDev_OK)
+		++g_allOpenDeviceCount;
+	ReleaseSRWLockExclusive(&g_deviceCountLock);
+	return err;
+}
+
+
+static OScDev_Error UncountOpenDevice(const struct FpgaBackend *backend)
+{
+	OScDev_Error err = OScDev_OK;
+	AcquireSRWLockExclusive(&g_deviceCountLock);
+	--g_allOpenDeviceCount;
+	if (backend->usesNiFpgaRuntime)
+	{
+		--g_openDeviceCount;
+		if (g_openDeviceCount == 0)
+			err = DeinitializeNiFpga();
+	}
+	ReleaseSRWLockExclusive(&g_deviceCountLock);
+	return err;
+}
+
+
+static size_t GetAllOpenDeviceCount(void)
+{
+	AcquireSRWLockShared(&g_deviceCountLock);
+	size_t count = g_allOpenDeviceCount;
+	ReleaseSRWLockShared(&g_deviceCountLock);
+	return count;
+}
+
+
 static void PopulateDefaultParameters(struct OScNIFPGAPrivateData *data)
 {
 	strncpy(data->bitfile, NiFpga_OpenScanFPGAHost_Bitfile, OScDev_MAX_STR_LEN);
 
 	data->settingsChanged = true;
 	data->reloadWaveformRequired = true;
+	data->keepArmed = false;
+	data->asyncArm = false;
+	data->resetOnClose = true;
+	data->waveformStartX = 0;
+	data->waveformStartY = 0;
+	data->residentWaveform.valid = false;
 	data->lineDelay = 50;
 	data->offsetXY[0] = data->offsetXY[1] = 0.0;
+	data->liveZoomFactor = 0.0;
+	data->nextResolution = 0;
+	data->nextZoomFactor = 1.0;
+	data->queueText[0] = '\0';
+	data->queue.stepCount = 0;
 	data->channels = CHANNELS_1_;
 	data->useProgressiveAveraging = true;
 	data->detectorEnabled = true;
 	data->scannerEnabled = true;
-	data->filterGain = 0.99; // TODO This is probably wrong; see also SetScanParameters
+	data->filterGain = 0.8;
+	data->temporalFilter = TEMPORAL_FILTER_NONE;
 	data->framesToAverage = 1;
+	data->hostAveraging = true;
+	data->deliverRawPlanes = false;
+	data->interleavedFrames = false;
+	data->frameStatistics = true;
+	data->correctionDirectory[0] = '\0';
+	data->previewLevels = 0;
+	data->preview8Bit = false;
+	data->previewDisplayMin = 0;
+	data->previewDisplayMax = UINT16_MAX;
+	data->parallelFifoReaders = false;
+	data->processingThreads = 0;
+	data->acquisitionThreadPriority = ACQUISITION_PRIORITY_NORMAL;
+	data->acquisitionThreadAffinity = 0;
+	data->debugTracing = false;
+	data->rawCaptureEnabled = false;
+	GetTempPathA(sizeof(data->rawCaptureDirectory), data->rawCaptureDirectory);
 
 	InitializeCriticalSection(&(data->acquisition.mutex));
 	data->acquisition.thread = NULL;
+	InitializeConditionVariable(&(data->acquisition.startCondition));
+	data->acquisition.startRequested = false;
+	data->acquisition.armRequested = false;
+	data->acquisition.exitRequested = false;
+	data->acquisition.stager = NULL;
 	InitializeConditionVariable(&(data->acquisition.acquisitionFinishCondition));
 	data->acquisition.running = false;
 	data->acquisition.armed = false;
+	data->acquisition.armPending = false;
+	data->acquisition.armError = OScDev_OK;
 	data->acquisition.started = false;
 	data->acquisition.stopRequested = false;
 	data->acquisition.acquisition = NULL;
+	data->acquisition.stepCount = 0;
+	data->acquisition.step = 0;
+	data->acquisition.rawCapture = NULL;
+	memset(&(data->acquisition.frameBuffers), 0, sizeof(data->acquisition.frameBuffers));
+	data->acquisition.averager = NULL;
+	data->acquisition.temporalFilter = NULL;
+	data->acquisition.frameStats = NULL;
+	data->acquisition.correction = NULL;
+	data->acquisition.preview = NULL;
+	data->acquisition.fifoReaders = NULL;
+	data->acquisition.workPool = NULL;
+	data->acquisition.workerStats = NULL;
+	data->acquisition.staged = NULL;
+	data->acquisition.waveformUpdater = NULL;
+
+	data->backend = &NiFpgaBackend;
+	data->replay = NULL;
+	data->replayOriginalTiming = true;
 }
 
 
-OScDev_Error EnumerateInstances(OScDev_PtrArray **devices)
+static OScDev_Error CreateDevice(OScDev_PtrArray *devices, const char *name,
+	const struct FpgaBackend *backend)
 {
-	OScDev_Error err;
-	if (OScDev_CHECK(err, EnsureNiFpgaInitialized()))
-		return err;
-
-	// The first FPGA board on the system always has the RIO Resource Name
-	// "RIO0" (as far as I know). For now, only support this one.
-
 	struct OScNIFPGAPrivateData *data = calloc(1, sizeof(struct OScNIFPGAPrivateData));
-	strncpy(data->rioResourceName, "RIO0", OScDev_MAX_STR_LEN);
+	strncpy(data->rioResourceName, name, OScDev_MAX_STR_LEN);
 
 	OScDev_Device *device;
+	OScDev_Error err;
 	if (OScDev_CHECK(err, OScDev_Device_Create(&device, &OpenScan_NIFPGA_Device_Impl, data)))
 	{
 		char msg[OScDev_MAX_STR_LEN + 1] = "Failed to create device ";
 		strcat(msg, data->rioResourceName);
 		OScDev_Log_Error(NULL, msg);
+		free(data);
 		return err; // TODO
 	}
 
 	PopulateDefaultParameters(GetData(device));
+	GetData(device)->backend = backend;
+
+	OScDev_PtrArray_Append(devices, device);
+	return OScDev_OK;
+}
+
+
+// The NiFpga API cannot list RIO resources, so they are taken from the
+// environment; the first FPGA board on the system always has the RIO
+// Resource Name "RIO0" (as far as I know)
+static OScDev_Error CreateHardwareDevices(OScDev_PtrArray *devices)
+{
+	char resources[1024];
+	DWORD len = GetEnvironmentVariableA(RIO_RESOURCES_ENVIRONMENT_VARIABLE,
+		resources, sizeof(resources));
+	if (len == 0 || len >= sizeof(resources))
+		return CreateDevice(devices, "RIO0", &NiFpgaBackend);
+
+	const char *p = resources;
+	while (*p != '\0')
+	{
+		p += strspn(p, " \t;,");
+		size_t nameLen = strcspn(p, " \t;,");
+		if (nameLen == 0)
+			continue;
+		if (nameLen > OScDev_MAX_STR_LEN)
+		{
+			NIFPGA_LOG_WARNING(NULL, "Ignoring RIO resource name longer than %d characters",
+				OScDev_MAX_STR_LEN);
+			p += nameLen;
+			continue;
+		}
+
+		char name[OScDev_MAX_STR_LEN + 1];
+		memcpy(name, p, nameLen);
+		name[nameLen] = '\0';
+		p += nameLen;
+
+		OScDev_Error err;
+		if (OScDev_CHECK(err, CreateDevice(devices, name, &NiFpgaBackend)))
+			return err;
+	}
+	return OScDev_OK;
+}
 
+
+OScDev_Error EnumerateInstances(OScDev_PtrArray **devices)
+{
 	*devices = OScDev_PtrArray_Create();
-	OScDev_PtrArray_Append(*devices, device);
+
+	AcquireSRWLockExclusive(&g_deviceCountLock);
+	OScDev_Error hardwareErr = EnsureNiFpgaInitialized();
+	ReleaseSRWLockExclusive(&g_deviceCountLock);
+	if (hardwareErr == OScDev_OK)
+		hardwareErr = CreateHardwareDevices(*devices);
+
+	// A capture to replay through a simulated FPGA can be given in the
+	// environment; this works without NI-RIO installed
+	char replayPath[OScDev_MAX_STR_LEN + 1];
+	DWORD len = GetEnvironmentVariableA(REPLAY_ENVIRONMENT_VARIABLE,
+		replayPath, sizeof(replayPath));
+	if (len > 0 && len < sizeof(replayPath))
+	{
+		OScDev_Error err;
+		if (OScDev_CHECK(err, CreateDevice(*devices, "Replay", &SimFpgaBackend)))
+			return err;
+		size_t last = OScDev_PtrArray_Size(*devices) - 1;
+		OScDev_Device *device = OScDev_PtrArray_At(*devices, last);
+		strncpy(GetData(device)->replayPath, replayPath, OScDev_MAX_STR_LEN);
+	}
+
+	// Simulated boards, for benchmarking and testing without hardware
+	char simCount[16];
+	len = GetEnvironmentVariableA(SIMFPGA_ENVIRONMENT_VARIABLE,
+		simCount, sizeof(simCount));
+	if (len > 0 && len < sizeof(simCount))
+	{
+		int count = atoi(simCount);
+		if (count > SIMFPGA_MAX_SESSIONS)
+			count = SIMFPGA_MAX_SESSIONS;
+		for (int i = 0; i < count; ++i)
+		{
+			char name[16];
+			snprintf(name, sizeof(name), "Sim%d", i);
+			OScDev_Error err;
+			if (OScDev_CHECK(err, CreateDevice(*devices, name, &SimFpgaBackend)))
+				return err;
+		}
+	}
+
+	if (OScDev_PtrArray_IsEmpty(*devices))
+	{
+		OScDev_PtrArray_Destroy(*devices);
+		*devices = NULL;
+		return hardwareErr;
+	}
 	return OScDev_OK;
 }
 
 
 OScDev_Error OpenFPGA(OScDev_Device *device)
 {
+	const struct FpgaBackend *backend = GetData(device)->backend;
+
 	OScDev_Error err;
-	if (OScDev_CHECK(err, EnsureNiFpgaInitialized()))
+	if (OScDev_CHECK(err, CountOpenDevice(backend)))
 		return err;
 
-	NiFpga_Status stat = NiFpga_Open(
+	NiFpga_Status stat = backend->Open(
 		GetData(device)->bitfile,
 		NiFpga_OpenScanFPGAHost_Signature,
 		GetData(device)->rioResourceName,
 		NiFpga_OpenAttribute_NoRun,
 		&(GetData(device)->niFpgaSession));
 	if (NiFpga_IsError(stat))
+	{
+		UncountOpenDevice(backend);
 		return stat; // TODO
+	}
 
-	++g_openDeviceCount;
+	if (GetData(device)->replayPath[0] != '\0')
+	{
+		if (OScDev_CHECK(err, Replay_Open(&(GetData(device)->replay), device,
+			GetData(device)->replayPath)))
+		{
+			backend->Close(GetData(device)->niFpgaSession, 0);
+			GetData(device)->niFpgaSession = 0;
+			UncountOpenDevice(backend);
+			return err;
+		}
+		struct SimFpgaSource source;
+		Replay_GetSource(GetData(device)->replay, &source);
+		SimFpga_SetSource(GetData(device)->niFpgaSession, &source);
+	}
 
 	return OScDev_OK;
 }
@@ -130,50 +369,69 @@ OScDev_Error OpenFPGA(OScDev_Device *device)
 OScDev_Error CloseFPGA(OScDev_Device *device)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 
-	if (session)
+	// The session is closed and the device uncounted even after an error,
+	// which is then returned
+	NiFpga_Status stat = NiFpga_Status_Success;
+	if (session && GetData(device)->resetOnClose)
 	{
 		// Reset FPGA to close shutter (temporary workaround)
 		StartFPGA(device);
 
-		NiFpga_Status stat;
-		stat = NiFpga_WriteU16(session,
+		stat = backend->WriteU16(session,
 			NiFpga_OpenScanFPGAHost_ControlU16_Current,
 			FPGA_STATE_STOP);
-		if (NiFpga_IsError(stat))
-			return stat; // TODO Wrap
 
-		stat = NiFpga_Close(session, 0);
-		if (NiFpga_IsError(stat))
-			return stat; // TODO Wrap
+		NiFpga_Status closeStat = backend->Close(session, 0);
+		if (!NiFpga_IsError(stat))
+			stat = closeStat;
+		GetData(device)->niFpgaSession = 0;
 	}
-
-	--g_openDeviceCount;
-	if (g_openDeviceCount == 0) {
-		OScDev_Error err;
-		if (OScDev_CHECK(err, DeinitializeNiFpga()))
-			return err;
+	else if (session)
+	{
+		// Leave the FPGA running and idle, with the waveform in DRAM, for the
+		// next session to attach to (see AttachRunningFPGA())
+		stat = backend->Close(session,
+			NiFpga_CloseAttribute_NoResetIfLastSession);
+		GetData(device)->niFpgaSession = 0;
 	}
 
-	return OScDev_OK;
+	Replay_Close(GetData(device)->replay);
+	GetData(device)->replay = NULL;
+
+	OScDev_Error err = UncountOpenDevice(backend);
+	if (NiFpga_IsError(stat))
+		return stat; // TODO Wrap
+	return err;
+}
+
+
+// On reset, and after an error that leaves the FPGA state unknown
+static void ForgetResidentWaveform(OScDev_Device *device)
+{
+	GetData(device)->residentWaveform.valid = false;
+	ResidentWaveform_Discard(GetData(device)->rioResourceName);
 }
 
 
 OScDev_Error StartFPGA(OScDev_Device *device)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 	NiFpga_Status stat;
 	OScDev_Log_Debug(device, "Resetting FPGA...");
-	stat = NiFpga_Reset(session);
+	ForgetResidentWaveform(device);
+	stat = backend->Reset(session);
 	if (NiFpga_IsError(stat))
 		return stat;
 	OScDev_Log_Debug(device, "Starting FPGA...");
-	stat = NiFpga_Run(session, 0);
+	stat = backend->Run(session, 0);
 	if (NiFpga_IsError(stat))
 		return stat;
 
 	uint16_t currentState;
-	stat = NiFpga_ReadU16(session, NiFpga_OpenScanFPGAHost_ControlU16_Current,
+	stat = backend->ReadU16(session, NiFpga_OpenScanFPGAHost_ControlU16_Current,
 		&currentState);
 	if (NiFpga_IsError(stat))
 		return stat;
@@ -187,6 +445,82 @@ OScDev_Error StartFPGA(OScDev_Device *device)
 }
 
 
+// Use the FPGA as an earlier session left it, if that session closed
+// without a reset (see resetOnClose) and the FPGA is idle. Returns false if
+// the FPGA needs a reset.
+bool AttachRunningFPGA(OScDev_Device *device)
+{
+	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
+
+	// Opening has downloaded the bitfile unless ours (by signature) was
+	// already on the FPGA, and only then can it be running
+	NiFpga_Status stat = backend->Run(session, 0);
+	if (stat != NiFpga_Status_FpgaAlreadyRunning)
+		return false;
+
+	uint16_t currentState;
+	stat = backend->ReadU16(session, NiFpga_OpenScanFPGAHost_ControlU16_Current,
+		&currentState);
+	if (NiFpga_IsError(stat) || currentState != FPGA_STATE_IDLE)
+	{
+		OScDev_Log_Debug(device, "Running FPGA is not idle");
+		return false;
+	}
+
+	OScDev_Log_Debug(device, "Attached to running FPGA without reset");
+	return true;
+}
+
+
+// Take over the waveform recorded as resident (see ResidentWaveform.h) if
+// the FPGA still has the scan geometry that went with it. Call only on an
+// FPGA attached to without a reset.
+void RestoreResidentWaveform(OScDev_Device *device)
+{
+	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
+
+	struct ResidentWaveformRecord record;
+	if (!ResidentWaveform_Load(GetData(device)->rioResourceName, &record))
+		return;
+
+	// These are all written with the waveform, and are zero after a reset
+	uint32_t resolution = record.geometry.resolution;
+	uint32_t lineDelay = record.geometry.lineDelay;
+	int32_t elementsPerLine = lineDelay + resolution + X_RETRACE_LEN;
+	uint32_t totalElements = elementsPerLine * (resolution + Y_RETRACE_LEN);
+
+	int32_t fpgaResolution, fpgaElementsPerLine, fpgaLineDelay;
+	uint32_t fpgaTotalElements;
+	if (NiFpga_IsError(backend->ReadI32(session,
+			NiFpga_OpenScanFPGAHost_ControlI32_Resolution, &fpgaResolution)) ||
+		NiFpga_IsError(backend->ReadI32(session,
+			NiFpga_OpenScanFPGAHost_ControlI32_Elementsperline, &fpgaElementsPerLine)) ||
+		NiFpga_IsError(backend->ReadI32(session,
+			NiFpga_OpenScanFPGAHost_ControlI32_Numofundershoot, &fpgaLineDelay)) ||
+		NiFpga_IsError(backend->ReadU32(session,
+			NiFpga_OpenScanFPGAHost_ControlU32_Totalelements, &fpgaTotalElements)))
+		return;
+	if (fpgaResolution != (int32_t)resolution ||
+		fpgaElementsPerLine != elementsPerLine ||
+		fpgaLineDelay != (int32_t)lineDelay ||
+		fpgaTotalElements != totalElements)
+	{
+		OScDev_Log_Debug(device, "Recorded waveform is not on the FPGA");
+		return;
+	}
+
+	GetData(device)->residentWaveform.geometry = record.geometry;
+	GetData(device)->residentWaveform.tag = record.tag;
+	GetData(device)->residentWaveform.valid = true;
+	GetData(device)->waveformStartX = record.startX;
+	GetData(device)->waveformStartY = record.startY;
+	NIFPGA_LOG_INFO(device, "Using waveform %016llx left on the FPGA",
+		(unsigned long long)record.tag);
+}
+
+
 static OScDev_Error SendParameters(OScDev_Device *device)
 {
 	OScDev_Error err;
@@ -194,17 +528,18 @@ static OScDev_Error SendParameters(OScDev_Device *device)
 		return err;
 
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 
 	NiFpga_Status stat;
-	stat = NiFpga_WriteI32(session,
+	stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Numofundershoot, GetData(device)->lineDelay);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteI32(session,
+	stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Pixelpulse_initialdelay, 1);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_Frameretracetime, 100);
 	if (NiFpga_IsError(stat))
 		return stat;
@@ -217,15 +552,16 @@ static OScDev_Error SendParameters(OScDev_Device *device)
 static OScDev_Error SetScanRate(OScDev_Device *device, double scanRate)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 
 	double pixelTime = 40.0 * 1000.0 / scanRate;
 	int32_t pixelTimeTicks = (int32_t)round(pixelTime);
-	NiFpga_Status stat = NiFpga_WriteI32(session,
+	NiFpga_Status stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Pixeltimetick, pixelTimeTicks);
 	if (NiFpga_IsError(stat))
 		return stat;
 	int32_t pulseWidthTicks = pixelTimeTicks - 4;
-	stat = NiFpga_WriteI32(session,
+	stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Pixelclock_pulsewidthtick, pulseWidthTicks);
 	if (NiFpga_IsError(stat))
 		return stat;
@@ -237,38 +573,39 @@ static OScDev_Error SetScanRate(OScDev_Device *device, double scanRate)
 static OScDev_Error SetResolution(OScDev_Device *device, uint32_t resolution)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 
 	int32_t elementsPerLine = GetData(device)->lineDelay + resolution + X_RETRACE_LEN;
 
-	NiFpga_Status stat = NiFpga_WriteI32(session,
+	NiFpga_Status stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Resolution, resolution);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteI32(session,
+	stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Elementsperline, elementsPerLine);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_maxaddr, (uint32_t)elementsPerLine);
 	if (NiFpga_IsError(stat))
 		return stat;
 
 	uint32_t totalElements = elementsPerLine * resolution;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_Totalelements, totalElements);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_Numofelements, totalElements);
 	if (NiFpga_IsError(stat))
 		return stat;
 
 	uint32_t totalPixels = resolution * resolution;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_Samplesperframecontrol, totalPixels);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_MaxDRAMaddress, totalPixels / 16);
 	if (NiFpga_IsError(stat))
 		return stat;
@@ -280,10 +617,11 @@ static OScDev_Error SetResolution(OScDev_Device *device, uint32_t resolution)
 OScDev_Error InitScan(OScDev_Device *device)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 
 	NiFpga_Status stat;
 
-	stat = NiFpga_WriteU16(session, NiFpga_OpenScanFPGAHost_ControlU16_Current, FPGA_STATE_INIT);
+	stat = backend->WriteU16(session, NiFpga_OpenScanFPGAHost_ControlU16_Current, FPGA_STATE_INIT);
 	if (NiFpga_IsError(stat))
 		return stat;
 
@@ -291,93 +629,87 @@ OScDev_Error InitScan(OScDev_Device *device)
 }
 
 
-static OScDev_Error SetAveragingFilterGain(OScDev_Device *device, double kg)
+// Polled by waits that a stop request should interrupt
+static bool IsStopRequested(OScDev_Device *device)
 {
-	NiFpga_Session session = GetData(device)->niFpgaSession;
-	return OScDev_OK;
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	bool stopRequested = GetData(device)->acquisition.running &&
+		GetData(device)->acquisition.stopRequested;
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+	return stopRequested;
 }
 
 
-static OScDev_Error WriteWaveforms(OScDev_Device *device, OScDev_Acquisition *acq, uint16_t *firstX, uint16_t *firstY)
+// Write the waveform to the FPGA DRAM; the FPGA returns to idle once it
+// has taken all of it
+static OScDev_Error UploadWaveform(OScDev_Device *device, const struct PreparedWaveform *waveform)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 
-	uint32_t resolution = OScDev_Acquisition_GetResolution(acq);
-	double zoom = OScDev_Acquisition_GetZoomFactor(acq);
-	double offsetX = GetData(device)->offsetXY[0];
-	double offsetY = GetData(device)->offsetXY[1];
-
-	uint32_t elementsPerLine =
-		GetData(device)->lineDelay + resolution + X_RETRACE_LEN;
-	uint32_t elementsPerRow = resolution + Y_RETRACE_LEN;
-	uint16_t *xScaled = (uint16_t *)malloc(sizeof(uint16_t) * elementsPerLine);
-	uint16_t *yScaled = (uint16_t *)malloc(sizeof(uint16_t) * elementsPerRow);
-
-	OScDev_Error err;
-	if (OScDev_CHECK(err, GenerateScaledWaveforms(resolution, 0.25 * zoom, 
-		GetData(device)->lineDelay, xScaled, yScaled, offsetX, offsetY)))
-		return OScDev_Error_Waveform_Out_Of_Range;
+	uint32_t elementsPerLine = waveform->elementsPerLine;
+	uint32_t elementsPerRow = waveform->elementsPerRow;
 
 	NiFpga_Status stat;
 
-	stat = NiFpga_WriteBool(session,
+	stat = backend->WriteBool(session,
 		NiFpga_OpenScanFPGAHost_ControlBool_WriteDRAMenable, true);
 	if (NiFpga_IsError(stat))
-		goto error;
-	stat = NiFpga_WriteBool(session,
+		return stat;
+	stat = backend->WriteBool(session,
 		NiFpga_OpenScanFPGAHost_ControlBool_WriteFrameGalvosignal, true);
 	if (NiFpga_IsError(stat))
-		goto error;
+		return stat;
 
-	stat = NiFpga_WriteU16(session,
+	stat = backend->WriteU16(session,
 		NiFpga_OpenScanFPGAHost_ControlU16_Current, FPGA_STATE_WRITE);
 	if (NiFpga_IsError(stat))
-		goto error;
+		return stat;
 
 	size_t fifoSize = 0;
-	stat = NiFpga_WriteFifoU32(session,
+	stat = backend->WriteFifoU32(session,
 		NiFpga_OpenScanFPGAHost_HostToTargetFifoU32_HosttotargetFIFO,
 		0, 0, 10000, &fifoSize);
 
 	uint32_t *xy = (uint32_t *)malloc(sizeof(uint32_t) * elementsPerLine);
+	if (xy == NULL)
+		return OScDev_Error_Out_Of_Memory;
 	for (unsigned j = 0; j < elementsPerRow; ++j)
 	{
-		for (unsigned i = 0; i < elementsPerLine; ++i)
+		// The FPGA is left expecting the rest of the waveform, so the next
+		// arm resets it and uploads again (reloadWaveformRequired stays set)
+		if (IsStopRequested(device))
 		{
-			xy[i] = ((uint32_t)xScaled[i] << 16) | yScaled[j];
+			OScDev_Log_Debug(device, "Waveform upload interrupted");
+			free(xy);
+			return NIFPGA_ERROR_CANCELLED;
 		}
 
+		InterleaveXYRow(waveform->xScaled, waveform->yScaled[j], elementsPerLine, xy);
+
 		size_t remaining;
-		stat = NiFpga_WriteFifoU32(session,
+		stat = backend->WriteFifoU32(session,
 			NiFpga_OpenScanFPGAHost_HostToTargetFifoU32_HosttotargetFIFO,
 			xy, elementsPerLine, 10000, &remaining);
 		if (NiFpga_IsError(stat))
-			goto error;
-
-		Sleep(1);
+		{
+			free(xy);
+			return stat;
+		}
 	}
 
-	*firstX = xScaled[0];
-	*firstY = yScaled[0];
-
-	free(xScaled);
-	free(yScaled);
-
+	free(xy);
 	return OScDev_OK;
-
-error:
-	free(xScaled);
-	free(yScaled);
-	return stat;
 }
 
 
 static OScDev_Error MoveGalvosTo(OScDev_Device *device, uint16_t x, uint16_t y)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 
 	uint32_t xy = (uint32_t)x << 16 | y;
-	NiFpga_Status stat = NiFpga_WriteU32(session,
+	NiFpga_Status stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_Galvosignal, xy);
 	if (NiFpga_IsError(stat))
 		return stat;
@@ -385,30 +717,172 @@ static OScDev_Error MoveGalvosTo(OScDev_Device *device, uint16_t x, uint16_t y)
 }
 
 
-OScDev_Error ReloadWaveform(OScDev_Device *device, OScDev_Acquisition *acq)
+static bool IsWaveformResident(OScDev_Device *device, const struct WaveformGeometry *geometry)
+{
+	return GetData(device)->residentWaveform.valid &&
+		WaveformGeometry_IsEqual(&(GetData(device)->residentWaveform.geometry), geometry);
+}
+
+
+static void GetWaveformGeometry(OScDev_Device *device, struct WaveformGeometry *geometry)
+{
+	// Settings may be changing the geometry from other threads
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	geometry->resolution = GetScanStep(device)->resolution;
+	geometry->zoomFactor = GetScanZoomFactor(device);
+	geometry->lineDelay = GetData(device)->lineDelay;
+	geometry->offsetX = GetData(device)->offsetXY[0];
+	geometry->offsetY = GetData(device)->offsetXY[1];
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+}
+
+
+// Upload a waveform, unless it is resident, and park the galvos at its start
+static OScDev_Error LoadWaveform(OScDev_Device *device, const struct PreparedWaveform *waveform)
 {
 	OScDev_Error err;
 
-	uint16_t firstX, firstY;
-	OScDev_Log_Debug(device, "Writing waveform...");
-	if (OScDev_CHECK(err, WriteWaveforms(device, acq, &firstX, &firstY)))
-		return err;
+	if (IsWaveformResident(device, &waveform->geometry))
+	{
+		NIFPGA_LOG_DEBUG(device, "Waveform %016llx is resident; not uploading",
+			(unsigned long long)GetData(device)->residentWaveform.tag);
+	}
+	else
+	{
+		OScDev_Log_Debug(device, "Writing waveform...");
+		ForgetResidentWaveform(device);
+		if (OScDev_CHECK(err, UploadWaveform(device, waveform)))
+			return err;
+		GetData(device)->residentWaveform.geometry = waveform->geometry;
+		GetData(device)->residentWaveform.tag = WaveformGeometry_Hash(&waveform->geometry);
+		GetData(device)->residentWaveform.valid = true;
+
+		struct ResidentWaveformRecord record;
+		record.tag = GetData(device)->residentWaveform.tag;
+		record.geometry = waveform->geometry;
+		record.startX = waveform->xScaled[0];
+		record.startY = waveform->yScaled[0];
+		ResidentWaveform_Save(GetData(device)->rioResourceName, &record);
+	}
 
 	OScDev_Log_Debug(device, "Moving galvos to start position...");
+	uint16_t firstX = waveform->xScaled[0];
+	uint16_t firstY = waveform->yScaled[0];
 	if (OScDev_CHECK(err, MoveGalvosTo(device, firstX, firstY)))
 		return err;
+	GetData(device)->waveformStartX = firstX;
+	GetData(device)->waveformStartY = firstY;
 
 	return OScDev_OK;
 }
 
-OScDev_Error WaitTillIdle(OScDev_Device *device)
+
+OScDev_Error ReloadWaveform(OScDev_Device *device)
+{
+	struct WaveformGeometry geometry;
+	GetWaveformGeometry(device, &geometry);
+
+	if (IsWaveformResident(device, &geometry))
+	{
+		NIFPGA_LOG_DEBUG(device, "Waveform %016llx is resident; not uploading",
+			(unsigned long long)GetData(device)->residentWaveform.tag);
+		return MoveGalvosTo(device,
+			GetData(device)->waveformStartX, GetData(device)->waveformStartY);
+	}
+
+	struct StagedAcquisition *staged = GetData(device)->acquisition.staged;
+	if (staged != NULL && staged->waveform != NULL &&
+		WaveformGeometry_IsEqual(&staged->waveform->geometry, &geometry))
+	{
+		OScDev_Log_Debug(device, "Using staged waveform");
+		return LoadWaveform(device, staged->waveform);
+	}
+
+	OScDev_Error err;
+	struct PreparedWaveform *waveform;
+	if (OScDev_CHECK(err, PreparedWaveform_Create(&waveform, &geometry)))
+		return err;
+	err = LoadWaveform(device, waveform);
+	PreparedWaveform_Destroy(waveform);
+	return err;
+}
+
+
+// Whether the waveform for the current settings is in FPGA DRAM
+bool IsCurrentWaveformResident(OScDev_Device *device)
+{
+	struct WaveformGeometry geometry;
+	GetWaveformGeometry(device, &geometry);
+	return IsWaveformResident(device, &geometry);
+}
+
+
+static void GetStagingRequest(OScDev_Device *device, uint32_t resolution,
+	double zoomFactor, uint32_t channelCount, struct StagedAcquisitionRequest *request)
+{
+	memset(request, 0, sizeof(struct StagedAcquisitionRequest));
+	request->geometry.resolution = resolution;
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	request->geometry.zoomFactor = GetData(device)->liveZoomFactor > 0.0 ?
+		GetData(device)->liveZoomFactor : zoomFactor;
+	request->geometry.lineDelay = GetData(device)->lineDelay;
+	request->geometry.offsetX = GetData(device)->offsetXY[0];
+	request->geometry.offsetY = GetData(device)->offsetXY[1];
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+	request->channelCount = channelCount;
+	if (GetData(device)->detectorEnabled)
+	{
+		strncpy(request->correctionDirectory, GetData(device)->correctionDirectory,
+			OScDev_MAX_STR_LEN);
+	}
+}
+
+
+// Start preparing the acquisition given by the NextResolution and
+// NextZoomFactor settings with the current settings
+void StageNextAcquisition(OScDev_Device *device)
+{
+	struct AcquisitionStager *stager = GetData(device)->acquisition.stager;
+	if (stager == NULL || GetData(device)->nextResolution == 0)
+		return;
+
+	struct StagedAcquisitionRequest request;
+	GetStagingRequest(device, GetData(device)->nextResolution,
+		GetData(device)->nextZoomFactor, GetData(device)->channels + 1, &request);
+	AcquisitionStager_Request(stager, &request);
+}
+
+
+// Claim what was staged for the current step, if it was staged with the
+// same settings
+void TakeStagedAcquisition(OScDev_Device *device)
+{
+	StagedAcquisition_Destroy(GetData(device)->acquisition.staged);
+	GetData(device)->acquisition.staged = NULL;
+
+	struct AcquisitionStager *stager = GetData(device)->acquisition.stager;
+	if (stager == NULL)
+		return;
+
+	struct StagedAcquisitionRequest request;
+	GetStagingRequest(device, GetScanStep(device)->resolution,
+		GetScanStep(device)->zoomFactor, GetData(device)->acquisition.channelCount, &request);
+	GetData(device)->acquisition.staged = AcquisitionStager_Take(stager, &request);
+	if (GetData(device)->acquisition.staged != NULL)
+		OScDev_Log_Debug(device, "Arming staged acquisition");
+}
+
+static OScDev_Error WaitForIdle(OScDev_Device *device, bool cancellable)
 {
 	OScDev_Log_Debug(device, "Please wait...");
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 	NiFpga_Status stat;
 	uint16_t currentState;
 	do {
-		stat = NiFpga_ReadU16(session, NiFpga_OpenScanFPGAHost_ControlU16_Current,
+		if (cancellable && IsStopRequested(device))
+			return NIFPGA_ERROR_CANCELLED;
+		stat = backend->ReadU16(session, NiFpga_OpenScanFPGAHost_ControlU16_Current,
 			&currentState);
 		if (NiFpga_IsError(stat))
 			return stat;
@@ -418,11 +892,19 @@ OScDev_Error WaitTillIdle(OScDev_Device *device)
 
 }
 
+
+// Gives up with NIFPGA_ERROR_CANCELLED if a stop is requested
+OScDev_Error WaitTillIdle(OScDev_Device *device)
+{
+	return WaitForIdle(device, true);
+}
+
 OScDev_Error SetBuildInParameters(OScDev_Device *device)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 	NiFpga_Status stat;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_Frameretracetime, 50);
 	if (NiFpga_IsError(stat))
 		return stat;
@@ -433,18 +915,19 @@ OScDev_Error SetBuildInParameters(OScDev_Device *device)
 OScDev_Error SetPixelParameters(OScDev_Device *device, double pixelRateHz)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 	double pixelTime = 40e6 / pixelRateHz;
 	int32_t pixelTimeTicks = (int32_t)round(pixelTime);
-	NiFpga_Status stat = NiFpga_WriteI32(session,
+	NiFpga_Status stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Pixeltimetick, pixelTimeTicks);
 	if (NiFpga_IsError(stat))
 		return stat;
 	int32_t pulseWidthTicks = pixelTimeTicks - 4;
-	stat = NiFpga_WriteI32(session,
+	stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Pixelclock_pulsewidthtick, pulseWidthTicks);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteI32(session,
+	stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Pixelpulse_initialdelay, 1);
 	if (NiFpga_IsError(stat))
 		return stat;
@@ -452,80 +935,93 @@ OScDev_Error SetPixelParameters(OScDev_Device *device, double pixelRateHz)
 	return OScDev_OK;
 }
 
-OScDev_Error SetResolutionParameters(OScDev_Device *device, uint32_t resolution) 
+static OScDev_Error WriteScanGeometry(OScDev_Device *device, uint32_t resolution,
+	uint32_t lineDelay)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
-	int32_t elementsPerLine = GetData(device)->lineDelay + resolution + X_RETRACE_LEN;
+	const struct FpgaBackend *backend = GetData(device)->backend;
+	int32_t elementsPerLine = lineDelay + resolution + X_RETRACE_LEN;
 	uint32_t elementsPerRow = resolution + Y_RETRACE_LEN;
 
-	NiFpga_Status stat = NiFpga_WriteI32(session,
+	NiFpga_Status stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Resolution, resolution);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteI32(session,
+	stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Elementsperline, elementsPerLine);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_maxaddr, (uint32_t)elementsPerLine);
 	if (NiFpga_IsError(stat))
 		return stat;
 
 	uint32_t totalElements = elementsPerLine * elementsPerRow;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_Totalelements, totalElements);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_Numofelements, totalElements);
 	if (NiFpga_IsError(stat))
 		return stat;
 
 	uint32_t totalPixels = resolution * resolution;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_Samplesperframecontrol, totalPixels);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteU32(session,
+	stat = backend->WriteU32(session,
 		NiFpga_OpenScanFPGAHost_ControlU32_MaxDRAMaddress, totalPixels / 16);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteI32(session,
-		NiFpga_OpenScanFPGAHost_ControlI32_Numofundershoot, GetData(device)->lineDelay);
+	stat = backend->WriteI32(session,
+		NiFpga_OpenScanFPGAHost_ControlI32_Numofundershoot, lineDelay);
 	if (NiFpga_IsError(stat))
 		return stat;
 
 	return OScDev_OK;
 }
 
+OScDev_Error SetResolutionParameters(OScDev_Device *device, uint32_t resolution)
+{
+	return WriteScanGeometry(device, resolution, GetData(device)->lineDelay);
+}
+
 OScDev_Error SetTaskParameters(OScDev_Device *device, uint32_t nf)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 	uint16_t filtergain_ = 65534;
 
-	NiFpga_Status stat = NiFpga_WriteI32(session,
+	NiFpga_Status stat = backend->WriteI32(session,
 		NiFpga_OpenScanFPGAHost_ControlI32_Numberofframes, nf);
 	if (NiFpga_IsError(stat))
 		return stat;
 
 	// The FPGA firmware register is called "Kalmanfacotr", but its
-	// functionality is regular averaging.
-	stat = NiFpga_WriteU16(session,
-		NiFpga_OpenScanFPGAHost_ControlU16_Kalmanfactor, GetData(device)->framesToAverage);
+	// functionality is regular averaging. With host averaging the firmware
+	// passes every frame through unaveraged.
+	uint16_t firmwareFramesToAverage = GetData(device)->hostAveraging ?
+		1 : (uint16_t)GetScanStep(device)->framesToAverage;
+	stat = backend->WriteU16(session,
+		NiFpga_OpenScanFPGAHost_ControlU16_Kalmanfactor, firmwareFramesToAverage);
 	if (NiFpga_IsError(stat))
 		return stat;
 
-	stat = NiFpga_WriteU16(session,
+	// Unused by the firmware while CustomizedKalmangain is false; the
+	// AveragingFilterGain setting drives the host temporal filter instead
+	stat = backend->WriteU16(session,
 		NiFpga_OpenScanFPGAHost_ControlU16_Filtergain, filtergain_);
 	if (NiFpga_IsError(stat))
 		return stat;
 
-	stat = NiFpga_WriteU16(session,
+	stat = backend->WriteU16(session,
 		NiFpga_OpenScanFPGAHost_ControlBool_Enablescanner, GetData(device)->scannerEnabled);
 	if (NiFpga_IsError(stat))
 		return stat;
 
-	stat = NiFpga_WriteU16(session,
+	stat = backend->WriteU16(session,
 		NiFpga_OpenScanFPGAHost_ControlBool_Enabledetector, GetData(device)->detectorEnabled);
 	if (NiFpga_IsError(stat))
 		return stat;
@@ -536,36 +1032,37 @@ OScDev_Error SetTaskParameters(OScDev_Device *device, uint32_t nf)
 OScDev_Error Cleanflags(OScDev_Device *device)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 
 	NiFpga_Status stat;
-	stat = NiFpga_WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_Imageaveragingdone, false);
+	stat = backend->WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_Imageaveragingdone, false);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_Averagedimagedisplayed, false);
+	stat = backend->WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_Averagedimagedisplayed, false);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteBool(session, NiFpga_OpenScanFPGAHost_ControlBool_WriteFrameGalvosignal, false);
+	stat = backend->WriteBool(session, NiFpga_OpenScanFPGAHost_ControlBool_WriteFrameGalvosignal, false);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteBool(session, NiFpga_OpenScanFPGAHost_ControlBool_WriteDRAMenable, false);
+	stat = backend->WriteBool(session, NiFpga_OpenScanFPGAHost_ControlBool_WriteDRAMenable, false);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_FrameGalvosignalwritedone, false);
+	stat = backend->WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_FrameGalvosignalwritedone, false);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_Framewaveformoutputfinish, false);
+	stat = backend->WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_Framewaveformoutputfinish, false);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_Frameacquisitionfinish, false);
+	stat = backend->WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_Frameacquisitionfinish, false);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteBool(session, NiFpga_OpenScanFPGAHost_ControlBool_Done, false);
+	stat = backend->WriteBool(session, NiFpga_OpenScanFPGAHost_ControlBool_Done, false);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_WriteDRAMdone, false);
+	stat = backend->WriteBool(session, NiFpga_OpenScanFPGAHost_IndicatorBool_WriteDRAMdone, false);
 	if (NiFpga_IsError(stat))
 		return stat;
-	stat = NiFpga_WriteBool(session, NiFpga_OpenScanFPGAHost_ControlBool_CustomizedKalmangain, false);
+	stat = backend->WriteBool(session, NiFpga_OpenScanFPGAHost_ControlBool_CustomizedKalmangain, false);
 	if (NiFpga_IsError(stat))
 		return stat;
 
@@ -577,14 +1074,15 @@ static OScDev_Error StartScan(OScDev_Device *device)
 {
 	OScDev_Log_Debug(device, "Starting scanning...");
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 
 	// Workaround: Set ReadytoScan to false to acquire only one image
-	NiFpga_Status stat = NiFpga_WriteBool(session,
+	NiFpga_Status stat = backend->WriteBool(session,
 		NiFpga_OpenScanFPGAHost_ControlBool_ReadytoScan, true); // bug fixed
 	if (NiFpga_IsError(stat))
 		return stat;
 
-	stat = NiFpga_WriteU16(session,
+	stat = backend->WriteU16(session,
 		NiFpga_OpenScanFPGAHost_ControlU16_Current, FPGA_STATE_SCAN);
 	if (NiFpga_IsError(stat))
 		return stat;
@@ -596,370 +1094,764 @@ static OScDev_Error StartScan(OScDev_Device *device)
 static OScDev_Error StopScan(OScDev_Device *device)
 {
 	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
 	
 	OScDev_Log_Debug(device, "Stopping Scanning...");
-	NiFpga_Status stat = NiFpga_WriteBool(session,
+	NiFpga_Status stat = backend->WriteBool(session,
 		NiFpga_OpenScanFPGAHost_ControlBool_ReadytoScan, false);
 	if (NiFpga_IsError(stat))
 		return stat;
 	OScDev_Error err;
-	if (OScDev_CHECK(err, WaitTillIdle(device)))
+	if (OScDev_CHECK(err, WaitForIdle(device, false)))
 		return err;
 
 	return OScDev_OK;
 }
 
 
-static OScDev_Error ReadImage(OScDev_Device *device, OScDev_Acquisition *acq, bool discard)
+// Poll all four FIFOs in turn from the calling thread
+static OScDev_Error ReadFifosRoundRobin(OScDev_Device *device,
+	uint32_t *const *rawPlanes, size_t *remainingInFifo1)
 {
-	uint32_t resolution = OScDev_Acquisition_GetResolution(acq);
+	uint32_t resolution = GetScanStep(device)->resolution;
 	size_t nPixels = resolution * resolution;
-	uint32_t* rawAndAveraged = malloc(sizeof(uint32_t) * nPixels);
-	uint32_t* rawAndAveraged2 = malloc(sizeof(uint32_t) * nPixels);
-	uint32_t* rawAndAveraged3 = malloc(sizeof(uint32_t) * nPixels);
-	uint32_t* rawAndAveraged4 = malloc(sizeof(uint32_t) * nPixels);
+	uint32_t *rawAndAveraged = rawPlanes[0];
+	uint32_t *rawAndAveraged2 = rawPlanes[1];
+	uint32_t *rawAndAveraged3 = rawPlanes[2];
+	uint32_t *rawAndAveraged4 = rawPlanes[3];
+	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
+	NiFpga_Status stat;
 
-	if (GetData(device)->detectorEnabled == true)
+	size_t readSoFar = 0;
+	size_t available = 0;
+	size_t remaining = 0;
+
+	size_t readSoFar2 = 0;
+	size_t available2 = 0;
+	size_t remaining2 = 0;
+
+	size_t readSoFar3 = 0;
+	size_t available3 = 0;
+	size_t remaining3 = 0;
+
+	size_t readSoFar4 = 0;
+	size_t available4 = 0;
+	size_t remaining4 = 0;
+
+	uint32_t elementsPerLine = GetData(device)->lineDelay + resolution + X_RETRACE_LEN;
+	uint32_t scanLines = resolution;
+	uint32_t yLen = resolution + Y_RETRACE_LEN;
+	double pixelRatekHz = 1e-3 * GetScanStep(device)->pixelRateHz;
+	uint32_t estFrameTimeMs = (uint32_t)(elementsPerLine * yLen / pixelRatekHz);
+	NIFPGA_LOG_TRACE(device, 1000, "Estimated time per frame: %u (msec)", estFrameTimeMs);
+	uint32_t totalWaitTimeMs = 0;
+
+	//Begin reading only when there is data input into FIFO
+	while (!(available && available2 && available3 && available4))
 	{
-		OScDev_Log_Debug(device, "Reading image...");
-		NiFpga_Session session = GetData(device)->niFpgaSession;
+		if (IsStopRequested(device))
+			return NIFPGA_ERROR_CANCELLED;
+		totalWaitTimeMs += 5;
+		if (totalWaitTimeMs > 2 * estFrameTimeMs)
+		{
+			OScDev_Log_Debug(device, "Scan timeout");
+			break;
+		}
 
-		NiFpga_Status stat = NiFpga_StartFifo(session,
-			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettohostFIFO1);
+		stat = backend->ReadFifoU32(session,
+			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettohostFIFO1,
+			rawAndAveraged + readSoFar, 0, -1, &available);
 		if (NiFpga_IsError(stat))
 			return stat;
 
-		stat = NiFpga_StartFifo(session,
-			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO2);
+		stat = backend->ReadFifoU32(session,
+			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO2,
+			rawAndAveraged2 + readSoFar2, 0, -1, &available2);
 		if (NiFpga_IsError(stat))
 			return stat;
 
-		stat = NiFpga_StartFifo(session,
-			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO3);
+		stat = backend->ReadFifoU32(session,
+			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO3,
+			rawAndAveraged3 + readSoFar3, 0, -1, &available3);
 		if (NiFpga_IsError(stat))
 			return stat;
 
-		stat = NiFpga_StartFifo(session,
-			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO4);
+		stat = backend->ReadFifoU32(session,
+			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO4,
+			rawAndAveraged4 + readSoFar4, 0, -1, &available4);
 		if (NiFpga_IsError(stat))
 			return stat;
 
+		Sleep(5);
+	}
 
-		size_t readSoFar = 0;
-		int32_t prevPercentRead = -1;
-		size_t available = 0;
-		size_t remaining = 0;
+	totalWaitTimeMs = 0;
 
-		size_t readSoFar2 = 0;
-		int32_t prevPercentRead2 = -1;
-		size_t available2 = 0;
-		size_t remaining2 = 0;
-
-		size_t readSoFar3 = 0;
-		int32_t prevPercentRead3 = -1;
-		size_t available3 = 0;
-		size_t remaining3 = 0;
-
-		size_t readSoFar4 = 0;
-		int32_t prevPercentRead4 = -1;
-		size_t available4 = 0;
-		size_t remaining4 = 0;
-
-		uint32_t elementsPerLine = GetData(device)->lineDelay + resolution + X_RETRACE_LEN;
-		uint32_t scanLines = resolution;
-		uint32_t yLen = resolution + Y_RETRACE_LEN;
-		double pixelRatekHz = 1e-3 * OScDev_Acquisition_GetPixelRate(acq);
-		uint32_t estFrameTimeMs = (uint32_t)(elementsPerLine * yLen / pixelRatekHz);
-		char msg[OScDev_MAX_STR_LEN + 1];
-		snprintf(msg, OScDev_MAX_STR_LEN, "Estimated time per frame: %d (msec)", estFrameTimeMs);
-		OScDev_Log_Debug(device, msg);
-		uint32_t totalWaitTimeMs = 0;
-
-		//Begin reading only when there is data input into FIFO
-		while (!(available && available2 && available3 && available4))
+	while ((readSoFar < nPixels) || (readSoFar2 < nPixels) || (readSoFar3 < nPixels) || (readSoFar4 < nPixels))
+	{
+		if (IsStopRequested(device))
+			return NIFPGA_ERROR_CANCELLED;
+		totalWaitTimeMs += 5;
+		if (totalWaitTimeMs > 2 * estFrameTimeMs)
 		{
-			totalWaitTimeMs += 5;
-			if (totalWaitTimeMs > 2 * estFrameTimeMs)
-			{
-				char msg[OScDev_MAX_STR_LEN + 1];
-				snprintf(msg, OScDev_MAX_STR_LEN, "Scan timeout");
-				OScDev_Log_Debug(device, msg);
-				break;
-			}
+			OScDev_Log_Debug(device, "Read image timeout");
+			break;
+		}
+		// The percentages are only computed if the message is emitted
+		NIFPGA_LOG_TRACE(device, 250, "Read channel 1 %d %%",
+			(int)(readSoFar * 100 / nPixels));
+		NIFPGA_LOG_TRACE(device, 250, "Read channel 2 %d %%",
+			(int)(readSoFar2 * 100 / nPixels));
+		NIFPGA_LOG_TRACE(device, 250, "Read channel 3 %d %%",
+			(int)(readSoFar3 * 100 / nPixels));
+		NIFPGA_LOG_TRACE(device, 250, "Read channel 4 %d %%",
+			(int)(readSoFar4 * 100 / nPixels));
+
+		if (readSoFar < nPixels)
+		{
+			stat = backend->ReadFifoU32(session,
+				NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettohostFIFO1,
+				rawAndAveraged + readSoFar, 0, 3000, &available);
+			if (NiFpga_IsError(stat))
+				return stat;
 
-			stat = NiFpga_ReadFifoU32(session,
+			stat = backend->ReadFifoU32(session,
 				NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettohostFIFO1,
-				rawAndAveraged + readSoFar, 0, -1, &available);
+				rawAndAveraged + readSoFar, available, 3000, &remaining);
+			if (NiFpga_IsError(stat))
+				return stat;
+
+			readSoFar += available;
+		}
+
+		if (readSoFar2 < nPixels)
+		{
+			stat = backend->ReadFifoU32(session,
+				NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO2,
+				rawAndAveraged2 + readSoFar2, 0, 3000, &available2);
 			if (NiFpga_IsError(stat))
 				return stat;
 
-			stat = NiFpga_ReadFifoU32(session,
+			stat = backend->ReadFifoU32(session,
 				NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO2,
-				rawAndAveraged2 + readSoFar2, 0, -1, &available2);
+				rawAndAveraged2 + readSoFar2, available2, 3000, &remaining2);
 			if (NiFpga_IsError(stat))
 				return stat;
 
-			stat = NiFpga_ReadFifoU32(session,
+			readSoFar2 += available2;
+		}
+
+		if (readSoFar3 < nPixels)
+		{
+			stat = backend->ReadFifoU32(session,
 				NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO3,
-				rawAndAveraged3 + readSoFar3, 0, -1, &available3);
+				rawAndAveraged3 + readSoFar3, 0, 3000, &available3);
 			if (NiFpga_IsError(stat))
 				return stat;
 
-			stat = NiFpga_ReadFifoU32(session,
-				NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO4,
-				rawAndAveraged4 + readSoFar4, 0, -1, &available4);
+			stat = backend->ReadFifoU32(session,
+				NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO3,
+				rawAndAveraged3 + readSoFar3, available3, 3000, &remaining3);
 			if (NiFpga_IsError(stat))
 				return stat;
 
-			Sleep(5);
+			readSoFar3 += available3;
 		}
 
-		totalWaitTimeMs = 0;
-
-		while ((readSoFar < nPixels) || (readSoFar2 < nPixels) || (readSoFar3 < nPixels) || (readSoFar4 < nPixels))
+		if (readSoFar4 < nPixels)
 		{
-			totalWaitTimeMs += 5;
-			if (totalWaitTimeMs > 2 * estFrameTimeMs)
-			{
-				char msg[OScDev_MAX_STR_LEN + 1];
-				snprintf(msg, OScDev_MAX_STR_LEN, "Read image timeout");
-				OScDev_Log_Debug(device, msg);
-				break;
-			}
-			int32_t percentRead = (int32_t)(readSoFar * 100 / nPixels);
-			int32_t percentRead2 = (int32_t)(readSoFar2 * 100 / nPixels);
-			int32_t percentRead3 = (int32_t)(readSoFar3 * 100 / nPixels);
-			int32_t percentRead4 = (int32_t)(readSoFar4 * 100 / nPixels);
+			stat = backend->ReadFifoU32(session,
+				NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO4,
+				rawAndAveraged4 + readSoFar4, 0, 3000, &available4);
+			if (NiFpga_IsError(stat))
+				return stat;
 
-			if (percentRead > prevPercentRead)
-			{
-				if (percentRead % 1 == 0)
-				{
-					char msg[OScDev_MAX_STR_LEN + 1];
-					snprintf(msg, OScDev_MAX_STR_LEN, "Read channel 1 %d %%", percentRead);
-					OScDev_Log_Debug(device, msg);
-				}
-				prevPercentRead = percentRead;
-			}
+			stat = backend->ReadFifoU32(session,
+				NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO4,
+				rawAndAveraged4 + readSoFar4, available4, 3000, &remaining4);
+			if (NiFpga_IsError(stat))
+				return stat;
 
-			if (percentRead2 > prevPercentRead2)
-			{
-				if (percentRead2 % 1 == 0)
-				{
-					char msg[OScDev_MAX_STR_LEN + 1];
-					snprintf(msg, OScDev_MAX_STR_LEN, "Read channel 2 %d %%", percentRead2);
-					OScDev_Log_Debug(device, msg);
-				}
-				prevPercentRead2 = percentRead2;
-			}
+			readSoFar4 += available4;
+		}
 
-			if (percentRead3 > prevPercentRead3)
-			{
-				if (percentRead3 % 1 == 0)
-				{
-					char msg[OScDev_MAX_STR_LEN + 1];
-					snprintf(msg, OScDev_MAX_STR_LEN, "Read channel 3 %d %%", percentRead3);
-					OScDev_Log_Debug(device, msg);
-				}
-				prevPercentRead3 = percentRead3;
-			}
 
-			if (percentRead4 > prevPercentRead4)
-			{
-				if (percentRead4 % 1 == 0)
-				{
-					char msg[OScDev_MAX_STR_LEN + 1];
-					snprintf(msg, OScDev_MAX_STR_LEN, "Read channel 4 %d %%", percentRead4);
-					OScDev_Log_Debug(device, msg);
-				}
-				prevPercentRead4 = percentRead4;
-			}
+		Sleep(5);
+	}
 
-			if (readSoFar < nPixels)
-			{
-				stat = NiFpga_ReadFifoU32(session,
-					NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettohostFIFO1,
-					rawAndAveraged + readSoFar, 0, 3000, &available);
-				if (NiFpga_IsError(stat))
-					return stat;
+	Sleep(10);
+	*remainingInFifo1 = remaining;
+	return OScDev_OK;
+}
 
-				stat = NiFpga_ReadFifoU32(session,
-					NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettohostFIFO1,
-					rawAndAveraged + readSoFar, available, 3000, &remaining);
-				if (NiFpga_IsError(stat))
-					return stat;
 
-				readSoFar += available;
-			}
+// Hand the frame to the per-FIFO reader threads and wait for all of them
+static OScDev_Error ReadFifosInParallel(OScDev_Device *device,
+	uint32_t *const *rawPlanes, size_t *remainingInFifo1)
+{
+	uint32_t resolution = GetScanStep(device)->resolution;
+	size_t nPixels = resolution * resolution;
+	uint32_t elementsPerLine = GetData(device)->lineDelay + resolution + X_RETRACE_LEN;
+	uint32_t yLen = resolution + Y_RETRACE_LEN;
+	double pixelRatekHz = 1e-3 * GetScanStep(device)->pixelRateHz;
+	uint32_t estFrameTimeMs = (uint32_t)(elementsPerLine * yLen / pixelRatekHz);
+
+	// As long as the round-robin reader allows for the first data and
+	// then for the rest of the frame
+	uint32_t timeoutMs = 4 * estFrameTimeMs + 100;
+
+	bool timedOut, cancelled;
+	size_t remaining[FIFO_READERS_MAX_FIFOS];
+	NiFpga_Status stat = FifoReaders_ReadFrame(GetData(device)->acquisition.fifoReaders,
+		rawPlanes, nPixels, timeoutMs, &timedOut, &cancelled, remaining);
+	if (NiFpga_IsError(stat))
+		return stat;
+	if (cancelled)
+		return NIFPGA_ERROR_CANCELLED;
+	if (timedOut)
+		OScDev_Log_Debug(device, "Read image timeout");
 
-			if (readSoFar2 < nPixels)
-			{
-				stat = NiFpga_ReadFifoU32(session,
-					NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO2,
-					rawAndAveraged2 + readSoFar2, 0, 3000, &available2);
-				if (NiFpga_IsError(stat))
-					return stat;
+	*remainingInFifo1 = remaining[0];
+	return OScDev_OK;
+}
 
-				stat = NiFpga_ReadFifoU32(session,
-					NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO2,
-					rawAndAveraged2 + readSoFar2, available2, 3000, &remaining2);
-				if (NiFpga_IsError(stat))
-					return stat;
 
-				readSoFar2 += available2;
-			}
+// Allocate the frame buffers for the delivery shape fixed at arm; they are
+// kept until FinishStep()
+static OScDev_Error StartFrameBuffers(OScDev_Device *device)
+{
+	uint32_t resolution = GetScanStep(device)->resolution;
+	size_t nPixels = (size_t)resolution * resolution;
+	uint32_t channelCount = GetData(device)->acquisition.channelCount;
+	bool deliverRawPlanes = GetData(device)->acquisition.deliverRawPlanes;
+	uint32_t deliveredChannelCount = deliverRawPlanes ? 2 * channelCount : channelCount;
+
+	uint32_t **words = GetData(device)->acquisition.frameBuffers.words;
+	uint16_t **averaged = GetData(device)->acquisition.frameBuffers.averaged;
+	uint16_t **raw = GetData(device)->acquisition.frameBuffers.raw;
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		words[i] = malloc(sizeof(uint32_t) * nPixels);
+		if (words[i] == NULL)
+			goto error;
+	}
+	for (uint32_t ch = 0; ch < channelCount; ++ch)
+	{
+		averaged[ch] = malloc(sizeof(uint16_t) * nPixels);
+		if (averaged[ch] == NULL)
+			goto error;
+		if (deliverRawPlanes)
+		{
+			raw[ch] = malloc(sizeof(uint16_t) * nPixels);
+			if (raw[ch] == NULL)
+				goto error;
+		}
+	}
+	if (GetData(device)->acquisition.interleavedFrames)
+	{
+		GetData(device)->acquisition.frameBuffers.interleaved =
+			malloc(sizeof(uint16_t) * deliveredChannelCount * nPixels);
+		if (GetData(device)->acquisition.frameBuffers.interleaved == NULL)
+			goto error;
+	}
+	return OScDev_OK;
 
-			if (readSoFar3 < nPixels)
-			{
-				stat = NiFpga_ReadFifoU32(session,
-					NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO3,
-					rawAndAveraged3 + readSoFar3, 0, 3000, &available3);
-				if (NiFpga_IsError(stat))
-					return stat;
+error:
+	OScDev_Log_Error(device, "Failed to allocate frame buffers");
+	return OScDev_Error_Out_Of_Memory;
+}
 
-				stat = NiFpga_ReadFifoU32(session,
-					NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO3,
-					rawAndAveraged3 + readSoFar3, available3, 3000, &remaining3);
-				if (NiFpga_IsError(stat))
-					return stat;
 
-				readSoFar3 += available3;
-			}
+static void FinishFrameBuffers(OScDev_Device *device)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		free(GetData(device)->acquisition.frameBuffers.words[i]);
+		GetData(device)->acquisition.frameBuffers.words[i] = NULL;
+		free(GetData(device)->acquisition.frameBuffers.averaged[i]);
+		GetData(device)->acquisition.frameBuffers.averaged[i] = NULL;
+		free(GetData(device)->acquisition.frameBuffers.raw[i]);
+		GetData(device)->acquisition.frameBuffers.raw[i] = NULL;
+	}
+	free(GetData(device)->acquisition.frameBuffers.interleaved);
+	GetData(device)->acquisition.frameBuffers.interleaved = NULL;
+}
 
-			if (readSoFar4 < nPixels)
-			{
-				stat = NiFpga_ReadFifoU32(session,
-					NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO4,
-					rawAndAveraged4 + readSoFar4, 0, 3000, &available4);
-				if (NiFpga_IsError(stat))
-					return stat;
 
-				stat = NiFpga_ReadFifoU32(session,
-					NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO4,
-					rawAndAveraged4 + readSoFar4, available4, 3000, &remaining4);
-				if (NiFpga_IsError(stat))
-					return stat;
+static OScDev_Error ReadImage(OScDev_Device *device, OScDev_Acquisition *acq, bool discard)
+{
+	uint32_t resolution = GetScanStep(device)->resolution;
+	uint32_t channelCount = GetData(device)->acquisition.channelCount;
+	OScDev_Error err;
+	uint32_t *const *rawPlanes = GetData(device)->acquisition.frameBuffers.words;
 
-				readSoFar4 += available4;
-			}
+	if (GetData(device)->detectorEnabled == true)
+	{
+		NIFPGA_LOG_TRACE(device, 1000, "Reading image...");
+		NiFpga_Session session = GetData(device)->niFpgaSession;
+		const struct FpgaBackend *backend = GetData(device)->backend;
+
+		NiFpga_Status stat = backend->StartFifo(session,
+			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettohostFIFO1);
+		if (NiFpga_IsError(stat))
+			return stat;
 
+		stat = backend->StartFifo(session,
+			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO2);
+		if (NiFpga_IsError(stat))
+			return stat;
 
-			Sleep(5);
-		}
+		stat = backend->StartFifo(session,
+			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO3);
+		if (NiFpga_IsError(stat))
+			return stat;
+
+		stat = backend->StartFifo(session,
+			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO4);
+		if (NiFpga_IsError(stat))
+			return stat;
+
+
+		size_t remaining = 0;
+		if (GetData(device)->acquisition.fifoReaders != NULL)
+			err = ReadFifosInParallel(device, rawPlanes, &remaining);
+		else
+			err = ReadFifosRoundRobin(device, rawPlanes, &remaining);
+		if (err != OScDev_OK)
+			return err;
 
-		Sleep(10);
 		if (remaining > 0)
 		{
 			return OScDev_Error_Data_Left_In_Fifo_After_Reading_Image;
 		}
 
-		stat = NiFpga_StopFifo(session,
+		stat = backend->StopFifo(session,
 			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettohostFIFO1);
 		if (NiFpga_IsError(stat))
 			return stat;
 
-		stat = NiFpga_StopFifo(session,
+		stat = backend->StopFifo(session,
 			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO2);
 		if (NiFpga_IsError(stat))
 			return stat;
 
-		stat = NiFpga_StopFifo(session,
+		stat = backend->StopFifo(session,
 			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO3);
 		if (NiFpga_IsError(stat))
 			return stat;
 
-		stat = NiFpga_StopFifo(session,
+		stat = backend->StopFifo(session,
 			NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO4);
 		if (NiFpga_IsError(stat))
 			return stat;
+
+		// Capture the words as read, before host averaging rewrites them;
+		// the capture writes its copy out on its own thread
+		struct RawCapture *capture = GetData(device)->acquisition.rawCapture;
+		if (capture != NULL)
+		{
+			if (!RawCapture_Submit(capture, rawPlanes))
+				NIFPGA_LOG_TRACE(device, 1000, "Raw capture cannot keep up; frame dropped");
+		}
+
+		// Fold this frame into the host average; the averaged high halves
+		// are then unpacked below exactly as if the firmware had averaged
+		struct FrameAverager *averager = GetData(device)->acquisition.averager;
+		if (averager != NULL)
+		{
+			for (uint32_t ch = 0; ch < channelCount; ++ch)
+				FrameAverager_Add(averager, ch, rawPlanes[ch]);
+		}
 	}
 
 	if (!discard)
 	{
-		uint16_t *averagedBuffer = malloc(sizeof(uint16_t) * nPixels);
-		uint16_t *averagedBuffer2 = malloc(sizeof(uint16_t) * nPixels);
-		uint16_t *averagedBuffer3 = malloc(sizeof(uint16_t) * nPixels);
-		uint16_t *averagedBuffer4 = malloc(sizeof(uint16_t) * nPixels);
-
-		for (size_t i = 0; i < nPixels; ++i) {
-			averagedBuffer[i] = (uint16_t)(rawAndAveraged[i] >> 16);
-			averagedBuffer2[i] = (uint16_t)(rawAndAveraged2[i] >> 16);
-			averagedBuffer3[i] = (uint16_t)(rawAndAveraged3[i] >> 16);
-			averagedBuffer4[i] = (uint16_t)(rawAndAveraged4[i] >> 16);
+		bool deliverRawPlanes = GetData(device)->acquisition.deliverRawPlanes;
+		uint16_t *const *averagedBuffers = GetData(device)->acquisition.frameBuffers.averaged;
+		uint16_t *const *rawBuffers = GetData(device)->acquisition.frameBuffers.raw;
+
+		// Only the averaged planes are filtered and previewed; the raw
+		// planes are the instantaneous frame
+		struct FramePipelineFrame frame = {
+			.resolution = resolution,
+			.channelCount = channelCount,
+			.correction = GetData(device)->acquisition.correction,
+			.filter = GetData(device)->acquisition.temporalFilter,
+			.preview = GetData(device)->acquisition.preview,
+			.stats = GetData(device)->acquisition.frameStats,
+			.workerStats = GetData(device)->acquisition.workerStats,
+			.interleaved = GetData(device)->acquisition.interleavedFrames ?
+				GetData(device)->acquisition.frameBuffers.interleaved : NULL,
+		};
+		for (uint32_t ch = 0; ch < channelCount; ++ch)
+		{
+			frame.words[ch] = rawPlanes[ch];
+			frame.averaged[ch] = averagedBuffers[ch];
+			frame.raw[ch] = deliverRawPlanes ? rawBuffers[ch] : NULL;
 		}
-
-		bool shouldContinue;
-		char msg[OScDev_MAX_STR_LEN + 1];
-		snprintf(msg, sizeof(msg), "Sending %d channels", GetData(device)->channels + 1);
-		OScDev_Log_Debug(device, msg);
-		switch (GetData(device)->channels)
+		if (frame.filter != NULL)
+			TemporalFilter_BeginFrame(frame.filter);
+		FramePipeline_Process(&frame, GetData(device)->acquisition.workPool);
+
+		// Averaged planes are channels 0 to N-1 and, when delivered, the
+		// raw planes follow as channels N to 2N-1; interleaved frames carry
+		// the same samples in that order in a single callback
+		uint32_t deliveredChannelCount = deliverRawPlanes ? 2 * channelCount : channelCount;
+		OScNIFPGA_FrameLayout layout = {
+			.interleaved = frame.interleaved != NULL,
+			.width = resolution,
+			.height = resolution,
+			.samplesPerPixel = frame.interleaved != NULL ? deliveredChannelCount : 1,
+			.averagedChannelCount = channelCount,
+			.rawChannels = deliverRawPlanes,
+		};
+		bool shouldContinue = true;
+		NIFPGA_LOG_TRACE(device, 1000, "Sending %u channels", deliveredChannelCount);
+		FrameStats_SetCurrent(frame.stats, deliveredChannelCount);
+		Preview_SetCurrent(frame.preview);
+		FramePipeline_SetCurrentLayout(&layout);
+		AcquisitionQueue_SetCurrentStep(&(GetData(device)->acquisition.step));
+		if (frame.interleaved != NULL)
 		{
-		case CHANNELS_1_:
-			shouldContinue = OScDev_Acquisition_CallFrameCallback(acq, 0, averagedBuffer);
-			break;
-
-		case CHANNELS_2_:
-			shouldContinue = OScDev_Acquisition_CallFrameCallback(acq, 0, averagedBuffer) &&
-				OScDev_Acquisition_CallFrameCallback(acq, 1, averagedBuffer2);
-			break;
-
-		case CHANNELS_3_:
-			shouldContinue = OScDev_Acquisition_CallFrameCallback(acq, 0, averagedBuffer) &&
-				OScDev_Acquisition_CallFrameCallback(acq, 1, averagedBuffer2) &&
-				OScDev_Acquisition_CallFrameCallback(acq, 2, averagedBuffer3);
-			break;
-
-		case CHANNELS_4_:
-		default: // TODO Why is default 4?
-			shouldContinue = OScDev_Acquisition_CallFrameCallback(acq, 0, averagedBuffer) &&
-				OScDev_Acquisition_CallFrameCallback(acq, 1, averagedBuffer2) &&
-				OScDev_Acquisition_CallFrameCallback(acq, 2, averagedBuffer3) &&
-				OScDev_Acquisition_CallFrameCallback(acq, 3, averagedBuffer4);
-			break;
+			shouldContinue = OScDev_Acquisition_CallFrameCallback(acq, 0, frame.interleaved);
 		}
-
-		free(averagedBuffer);
-		free(averagedBuffer2);
-		free(averagedBuffer3);
-		free(averagedBuffer4);
+		else
+		{
+			for (uint32_t ch = 0; ch < channelCount && shouldContinue; ++ch)
+				shouldContinue = OScDev_Acquisition_CallFrameCallback(acq, ch, averagedBuffers[ch]);
+			for (uint32_t ch = 0; ch < channelCount && shouldContinue && deliverRawPlanes; ++ch)
+				shouldContinue = OScDev_Acquisition_CallFrameCallback(acq, channelCount + ch, rawBuffers[ch]);
+		}
+		FrameStats_SetCurrent(NULL, 0);
+		Preview_SetCurrent(NULL);
+		FramePipeline_SetCurrentLayout(NULL);
+		AcquisitionQueue_SetCurrentStep(NULL);
 
 		if (!shouldContinue) {
 			// TODO We should use the return value of the frame callback to halt acquisition
 		}
 	}
 
-	free(rawAndAveraged);
-	free(rawAndAveraged2);
-	free(rawAndAveraged3);
-	free(rawAndAveraged4);
-
 	return OScDev_OK;
 }
 
 
 static OScDev_Error AcquireFrame(OScDev_Device *device, OScDev_Acquisition *acq, unsigned averagingCounter)
 {
+	if (GetData(device)->acquisition.averager != NULL)
+	{
+		// Every scanned frame contributes to the host average; the running
+		// mean is delivered after each one with progressive averaging, and
+		// only the full average otherwise
+		FrameAverager_Reset(GetData(device)->acquisition.averager);
+		uint32_t framesToAverage = GetScanStep(device)->framesToAverage;
+		for (uint32_t i = 0; i < framesToAverage; ++i)
+		{
+			NIFPGA_LOG_TRACE(device, 1000, "Image %u", i + 1);
+
+			bool shouldKeepImage = GetData(device)->useProgressiveAveraging ||
+				i + 1 == framesToAverage;
+			OScDev_Error err;
+			if (OScDev_CHECK(err, ReadImage(device, acq, !shouldKeepImage)))
+				return err;
+		}
+		return OScDev_OK;
+	}
+
 	bool shouldKeepImage = GetData(device)->useProgressiveAveraging ||
-		averagingCounter + 1 == GetData(device)->framesToAverage;
+		averagingCounter + 1 == GetScanStep(device)->framesToAverage;
 
-	for (unsigned i = 0; i < GetData(device)->framesToAverage; ++i)
+	for (unsigned i = 0; i < GetScanStep(device)->framesToAverage; ++i)
 	{
-		char msg[OScDev_MAX_STR_LEN + 1];
-		snprintf(msg, OScDev_MAX_STR_LEN, "Image %d", i + 1);
-		OScDev_Log_Debug(device, msg);
+		NIFPGA_LOG_TRACE(device, 1000, "Image %u", i + 1);
 
 		OScDev_Error err;
 		if (OScDev_CHECK(err, ReadImage(device, acq, !shouldKeepImage)))
 			return err;
-		OScDev_Log_Debug(device, "Finished reading image");
+		NIFPGA_LOG_TRACE(device, 1000, "Finished reading image");
 	}
 
 	return OScDev_OK;
 }
 
 
+static void StartRawCapture(OScDev_Device *device)
+{
+	if (!GetData(device)->rawCaptureEnabled || !GetData(device)->detectorEnabled)
+		return;
+
+	struct RawCaptureGeometry geometry;
+	geometry.resolution = GetScanStep(device)->resolution;
+	geometry.lineDelay = GetData(device)->lineDelay;
+	geometry.pixelRateHz = GetScanStep(device)->pixelRateHz;
+	geometry.channelCount = GetData(device)->acquisition.channelCount;
+
+	// Each queue step is captured to its own files
+	char nameSuffix[16] = "";
+	if (GetData(device)->acquisition.stepCount > 1)
+		snprintf(nameSuffix, sizeof(nameSuffix), "-step%02u", GetData(device)->acquisition.step);
+
+	OScDev_Error err;
+	if (OScDev_CHECK(err, RawCapture_Start(&(GetData(device)->acquisition.rawCapture),
+		device, GetData(device)->rawCaptureDirectory, nameSuffix, &geometry)))
+	{
+		OScDev_Log_Error(device, "Failed to start raw capture; continuing without");
+	}
+}
+
+
+static OScDev_Error StartHostAveraging(OScDev_Device *device)
+{
+	if (!GetData(device)->hostAveraging || !GetData(device)->detectorEnabled ||
+		GetScanStep(device)->framesToAverage <= 1)
+		return OScDev_OK;
+
+	uint32_t resolution = GetScanStep(device)->resolution;
+	OScDev_Error err;
+	if (OScDev_CHECK(err, FrameAverager_Create(&(GetData(device)->acquisition.averager),
+		GetData(device)->acquisition.channelCount, (size_t)resolution * resolution)))
+	{
+		OScDev_Log_Error(device, "Failed to allocate host averaging buffers");
+		return err;
+	}
+	return OScDev_OK;
+}
+
+
+static OScDev_Error StartTemporalFilter(OScDev_Device *device)
+{
+	if (GetData(device)->temporalFilter == TEMPORAL_FILTER_NONE ||
+		!GetData(device)->detectorEnabled)
+		return OScDev_OK;
+
+	uint32_t resolution = GetScanStep(device)->resolution;
+	OScDev_Error err;
+	if (OScDev_CHECK(err, TemporalFilter_Create(&(GetData(device)->acquisition.temporalFilter),
+		GetData(device)->temporalFilter, GetData(device)->filterGain,
+		GetData(device)->acquisition.channelCount, (size_t)resolution * resolution)))
+	{
+		OScDev_Log_Error(device, "Failed to allocate temporal filter buffers");
+		return err;
+	}
+	return OScDev_OK;
+}
+
+
+static OScDev_Error StartFrameCorrection(OScDev_Device *device)
+{
+	if (GetData(device)->correctionDirectory[0] == '\0' || !GetData(device)->detectorEnabled)
+		return OScDev_OK;
+
+	// Maps staged for this step were loaded with the same settings
+	struct StagedAcquisition *staged = GetData(device)->acquisition.staged;
+	if (staged != NULL && staged->correction != NULL)
+	{
+		GetData(device)->acquisition.correction = staged->correction;
+		staged->correction = NULL;
+		return OScDev_OK;
+	}
+
+	OScDev_Error err;
+	if (OScDev_CHECK(err, FrameCorrection_Load(&(GetData(device)->acquisition.correction),
+		device, GetData(device)->correctionDirectory,
+		GetData(device)->acquisition.channelCount, GetScanStep(device)->resolution)))
+	{
+		OScDev_Log_Error(device, "Failed to load correction maps");
+		return err;
+	}
+	return OScDev_OK;
+}
+
+
+static OScDev_Error StartPreview(OScDev_Device *device)
+{
+	if (GetData(device)->previewLevels == 0 || !GetData(device)->detectorEnabled)
+		return OScDev_OK;
+
+	OScDev_Error err;
+	if (OScDev_CHECK(err, Preview_Create(&(GetData(device)->acquisition.preview),
+		GetData(device)->acquisition.channelCount, GetScanStep(device)->resolution,
+		GetData(device)->previewLevels, GetData(device)->preview8Bit,
+		(uint16_t)GetData(device)->previewDisplayMin,
+		(uint16_t)GetData(device)->previewDisplayMax)))
+	{
+		OScDev_Log_Error(device, "Failed to allocate preview buffers");
+		return err;
+	}
+	return OScDev_OK;
+}
+
+
+static OScDev_Error StartFifoReaders(OScDev_Device *device)
+{
+	if (!GetData(device)->parallelFifoReaders || !GetData(device)->detectorEnabled)
+		return OScDev_OK;
+
+	// Every FIFO needs a reader to keep it from filling up
+	OScDev_Error err;
+	if (OScDev_CHECK(err, FifoReaders_Start(&(GetData(device)->acquisition.fifoReaders),
+		device, GetData(device)->backend, GetData(device)->niFpgaSession,
+		TargetToHostFifos, NUM_TARGET_TO_HOST_FIFOS, IsStopRequested)))
+	{
+		OScDev_Log_Error(device, "Failed to start FIFO reader threads");
+		return err;
+	}
+	return OScDev_OK;
+}
+
+
+static OScDev_Error StartWorkPool(OScDev_Device *device)
+{
+	if (!GetData(device)->detectorEnabled)
+		return OScDev_OK;
+
+	// By default, boards streaming at the same time share the processors
+	uint32_t workerCount = GetData(device)->processingThreads;
+	if (workerCount == 0)
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		size_t deviceCount = GetAllOpenDeviceCount();
+		workerCount = info.dwNumberOfProcessors / (uint32_t)(deviceCount > 0 ? deviceCount : 1);
+	}
+	if (workerCount > WORK_POOL_MAX_WORKERS)
+		workerCount = WORK_POOL_MAX_WORKERS;
+	if (workerCount <= 1)
+		return OScDev_OK;
+
+	OScDev_Error err;
+	if (OScDev_CHECK(err, WorkPool_Create(&(GetData(device)->acquisition.workPool),
+		workerCount)))
+	{
+		OScDev_Log_Error(device, "Failed to start frame processing threads");
+		return err;
+	}
+	if (GetData(device)->acquisition.frameStats != NULL)
+	{
+		// The averaged and raw planes of every channel, for each worker
+		GetData(device)->acquisition.workerStats = malloc(sizeof(OScNIFPGA_FrameStats) *
+			workerCount * 2 * GetData(device)->acquisition.channelCount);
+		if (GetData(device)->acquisition.workerStats == NULL)
+		{
+			OScDev_Log_Error(device, "Failed to allocate frame statistics");
+			return OScDev_Error_Out_Of_Memory;
+		}
+	}
+	NIFPGA_LOG_DEBUG(device, "Processing frames on %u threads", workerCount);
+	return OScDev_OK;
+}
+
+
+static OScDev_Error StartWaveformUpdater(OScDev_Device *device)
+{
+	if (!GetData(device)->scannerEnabled)
+		return OScDev_OK;
+
+	struct WaveformUpdater *updater;
+	OScDev_Error err;
+	if (OScDev_CHECK(err, WaveformUpdater_Start(&updater, device)))
+	{
+		OScDev_Log_Error(device, "Failed to start waveform updater");
+		return err;
+	}
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	GetData(device)->acquisition.waveformUpdater = updater;
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+	return OScDev_OK;
+}
+
+
+static OScDev_Error StartFrameStatistics(OScDev_Device *device)
+{
+	if (!GetData(device)->frameStatistics || !GetData(device)->detectorEnabled)
+		return OScDev_OK;
+
+	// Room for the averaged and raw planes of every channel
+	GetData(device)->acquisition.frameStats = malloc(sizeof(OScNIFPGA_FrameStats) * 8);
+	if (GetData(device)->acquisition.frameStats == NULL)
+	{
+		OScDev_Log_Error(device, "Failed to allocate frame statistics");
+		return OScDev_Error_Out_Of_Memory;
+	}
+	return OScDev_OK;
+}
+
+
+static void ReportThroughput(OScDev_Device *device)
+{
+	uint32_t frames = GetData(device)->acquisition.framesAcquired;
+	if (frames == 0)
+		return;
+
+	LARGE_INTEGER now, freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	double seconds = (double)(now.QuadPart -
+		GetData(device)->acquisition.scanStartTime.QuadPart) / freq.QuadPart;
+	double fps = seconds > 0.0 ? frames / seconds : 0.0;
+	GetData(device)->lastAcquisitionFramesPerSecond = fps;
+	NIFPGA_LOG_INFO(device, "Acquired %u frames in %.3f s (%.2f frames/s)",
+		frames, seconds, fps);
+}
+
+
+static void ReportStartLatency(OScDev_Device *device)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	double ms = (double)(GetData(device)->acquisition.scanStartTime.QuadPart -
+		GetData(device)->acquisition.armTime.QuadPart) * 1000.0 / freq.QuadPart;
+	GetData(device)->lastStartLatencyMs = ms;
+	NIFPGA_LOG_INFO(device, "Scan started %.2f ms after arm (%s)", ms,
+		GetData(device)->acquisition.reconfigured ? "reconfigured" : "configuration reused");
+}
+
+
+// Release what depends on the geometry or averaging of the step
+static void FinishStep(OScDev_Device *device)
+{
+	RawCapture_Finish(GetData(device)->acquisition.rawCapture);
+	GetData(device)->acquisition.rawCapture = NULL;
+	FrameAverager_Destroy(GetData(device)->acquisition.averager);
+	GetData(device)->acquisition.averager = NULL;
+	TemporalFilter_Destroy(GetData(device)->acquisition.temporalFilter);
+	GetData(device)->acquisition.temporalFilter = NULL;
+	FrameCorrection_Destroy(GetData(device)->acquisition.correction);
+	GetData(device)->acquisition.correction = NULL;
+	Preview_Destroy(GetData(device)->acquisition.preview);
+	GetData(device)->acquisition.preview = NULL;
+	FinishFrameBuffers(device);
+}
+
+
 static void FinishAcquisition(OScDev_Device *device)
 {
+	ReportThroughput(device);
+
+	FinishStep(device);
+	free(GetData(device)->acquisition.frameStats);
+	GetData(device)->acquisition.frameStats = NULL;
+	FifoReaders_Stop(GetData(device)->acquisition.fifoReaders);
+	GetData(device)->acquisition.fifoReaders = NULL;
+	free(GetData(device)->acquisition.workerStats);
+	GetData(device)->acquisition.workerStats = NULL;
+	WorkPool_Destroy(GetData(device)->acquisition.workPool);
+	GetData(device)->acquisition.workPool = NULL;
+	StagedAcquisition_Destroy(GetData(device)->acquisition.staged);
+	GetData(device)->acquisition.staged = NULL;
+
+	// Settings may be requesting updates from other threads
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	struct WaveformUpdater *updater = GetData(device)->acquisition.waveformUpdater;
+	GetData(device)->acquisition.waveformUpdater = NULL;
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+	WaveformUpdater_Stop(updater);
+
+	// A queue has used the stager for its own steps
+	if (GetData(device)->acquisition.stepCount > 1)
+		StageNextAcquisition(device);
+
 	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
 	GetData(device)->acquisition.running = false;
 	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
@@ -968,91 +1860,623 @@ static void FinishAcquisition(OScDev_Device *device)
 }
 
 
-static DWORD WINAPI AcquisitionLoop(void *param)
+// Empty the detector FIFOs once the scan has stopped, so that the next
+// acquisition does not read data left from this one
+static OScDev_Error DrainFifos(OScDev_Device *device)
 {
-	OScDev_Device *device = (OScDev_Device *)param;
-	OScDev_Acquisition *acq = GetData(device)->acquisition.acquisition;
+	NiFpga_Session session = GetData(device)->niFpgaSession;
+	const struct FpgaBackend *backend = GetData(device)->backend;
+	uint32_t discarded[4096];
 
-	uint32_t acqNumFrames = OScDev_Acquisition_GetNumberOfFrames(acq);
+	for (int i = 0; i < NUM_TARGET_TO_HOST_FIFOS; ++i)
+	{
+		NiFpga_Status stat = backend->StartFifo(session, TargetToHostFifos[i]);
+		if (NiFpga_IsError(stat))
+			return stat;
+
+		size_t available;
+		do {
+			stat = backend->ReadFifoU32(session, TargetToHostFifos[i],
+				discarded, 0, 0, &available);
+			if (NiFpga_IsError(stat))
+				return stat;
+			size_t toRead = available < 4096 ? available : 4096;
+			if (toRead > 0)
+			{
+				stat = backend->ReadFifoU32(session, TargetToHostFifos[i],
+					discarded, toRead, 0, &available);
+				if (NiFpga_IsError(stat))
+					return stat;
+			}
+		} while (available > 0);
+
+		stat = backend->StopFifo(session, TargetToHostFifos[i]);
+		if (NiFpga_IsError(stat))
+			return stat;
+	}
+	return OScDev_OK;
+}
+
+
+// Stop scanning in response to a stop request, possibly in the middle of
+// a frame. The FPGA is left idle with empty FIFOs and the galvos at the
+// start of the waveform, which stays loaded for the next acquisition.
+static OScDev_Error InterruptScan(OScDev_Device *device)
+{
+	OScDev_Log_Debug(device, "User interruption...");
+
+	// Unless kept armed, parameters are sent again at the next arm. A
+	// firmware average cut short leaves partial sums in DRAM, which only
+	// the full setup clears.
+	bool firmwareAveraging = GetScanStep(device)->framesToAverage > 1 &&
+		!GetData(device)->hostAveraging;
+	if (!GetData(device)->keepArmed || firmwareAveraging)
+		GetData(device)->settingsChanged = true;
+
+	OScDev_Error err;
+	if (OScDev_CHECK(err, StopScan(device)) ||
+		OScDev_CHECK(err, DrainFifos(device)) ||
+		OScDev_CHECK(err, MoveGalvosTo(device,
+			GetData(device)->waveformStartX, GetData(device)->waveformStartY)))
+	{
+		// State unknown; reset and reload at the next arm
+		GetData(device)->reloadWaveformRequired = true;
+		ForgetResidentWaveform(device);
+		return err;
+	}
+	return OScDev_OK;
+}
+
+
+// At a frame boundary, swap in the waveform of a live update if one is
+// ready. The frame the FPGA has already begun is discarded and scanning
+// resumes, for scanFrames frames, with the new waveform. On error
+// (including NIFPGA_ERROR_CANCELLED) the FPGA is left to be reset at the
+// next arm.
+//
+// The bitfile has a single waveform slot in DRAM, so the scan is stopped
+// for the whole upload; the pause is not bounded by a frame but by the
+// transfer of elementsPerLine * elementsPerRow words over the host-to-target
+// FIFO (4.6 M words, 18 MB, at 2048 x 2048 with a line delay of 60), which
+// can take seconds on hardware at that resolution. Only the host side of
+// this (a few ms at 2048 x 2048) is seen with the simulated FPGA.
+static OScDev_Error ApplyWaveformUpdate(OScDev_Device *device, uint32_t scanFrames)
+{
+	struct WaveformUpdater *updater = GetData(device)->acquisition.waveformUpdater;
+	if (updater == NULL)
+		return OScDev_OK;
+	struct PreparedWaveform *waveform = WaveformUpdater_TakeReady(updater);
+	if (waveform == NULL)
+		return OScDev_OK;
+
+	// Requested during an earlier queue step; the current step was loaded
+	// with the settings of the time
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	bool stale = waveform->geometry.resolution != GetScanStep(device)->resolution ||
+		waveform->geometry.zoomFactor != GetScanZoomFactor(device);
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+	if (stale)
+	{
+		PreparedWaveform_Destroy(waveform);
+		return OScDev_OK;
+	}
+
+	LARGE_INTEGER begin, end, freq;
+	QueryPerformanceCounter(&begin);
+
+	// As in InterruptScan, a partial firmware average must be cleared
+	bool firmwareAveraging = GetScanStep(device)->framesToAverage > 1 &&
+		!GetData(device)->hostAveraging;
+
+	OScDev_Error err;
+	if (OScDev_CHECK(err, StopScan(device)) ||
+		OScDev_CHECK(err, DrainFifos(device)) ||
+		OScDev_CHECK(err, WriteScanGeometry(device,
+			waveform->geometry.resolution, waveform->geometry.lineDelay)))
+		goto error;
+	if (firmwareAveraging)
+	{
+		if (OScDev_CHECK(err, InitScan(device)) ||
+			OScDev_CHECK(err, WaitTillIdle(device)))
+			goto error;
+	}
+	if (OScDev_CHECK(err, LoadWaveform(device, waveform)) ||
+		OScDev_CHECK(err, WaitTillIdle(device)) ||
+		OScDev_CHECK(err, SetTaskParameters(device, scanFrames)) ||
+		OScDev_CHECK(err, StartScan(device)))
+		goto error;
+
+	// The next arm need not upload again, unless the settings have moved on
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	struct WaveformGeometry current;
+	GetWaveformGeometry(device, &current);
+	if (WaveformGeometry_IsEqual(&current, &waveform->geometry))
+	{
+		GetData(device)->reloadWaveformRequired = false;
+		GetData(device)->lastAcquisitionZoomFactor = current.zoomFactor;
+	}
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&freq);
+	NIFPGA_LOG_INFO(device, "Waveform updated in %.2f ms",
+		(double)(end.QuadPart - begin.QuadPart) * 1000.0 / freq.QuadPart);
+	PreparedWaveform_Destroy(waveform);
+	return OScDev_OK;
+
+error:
+	GetData(device)->settingsChanged = true;
+	GetData(device)->reloadWaveformRequired = true;
+	ForgetResidentWaveform(device);
+	PreparedWaveform_Destroy(waveform);
+	return err;
+}
+
+
+// Have the stager prepare the waveform and correction maps of a queue step
+// while the one before it runs
+static void StageQueueStep(OScDev_Device *device, uint32_t step)
+{
+	struct AcquisitionStager *stager = GetData(device)->acquisition.stager;
+	if (stager == NULL)
+		return;
+
+	const struct AcquisitionStep *next = &(GetData(device)->acquisition.steps[step]);
+	struct StagedAcquisitionRequest request;
+	GetStagingRequest(device, next->resolution, next->zoomFactor,
+		GetData(device)->acquisition.channelCount, &request);
+	AcquisitionStager_Request(stager, &request);
+}
+
+
+// Move the FPGA from the finished queue step to the next, rewriting only
+// what differs between them. On error (including NIFPGA_ERROR_CANCELLED)
+// the FPGA is left to be set up in full at the next arm.
+static OScDev_Error BeginQueueStep(OScDev_Device *device, uint32_t step)
+{
+	const struct AcquisitionStep *from = &(GetData(device)->acquisition.steps[step - 1]);
+	const struct AcquisitionStep *to = &(GetData(device)->acquisition.steps[step]);
+
+	// The FPGA returns to idle by itself after the last frame of a step
+	OScDev_Error err;
+	if (OScDev_CHECK(err, WaitTillIdle(device)))
+		goto error;
+
+	// Settings may be requesting waveform updates from other threads
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	double fromZoomFactor = GetScanZoomFactor(device);
+	GetData(device)->acquisition.step = step;
+	double toZoomFactor = GetScanZoomFactor(device);
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+
+	TakeStagedAcquisition(device);
+
+	bool resolutionChanged = to->resolution != from->resolution;
+	bool waveformChanged = resolutionChanged || toZoomFactor != fromZoomFactor;
+	bool firmwareAveraging = to->framesToAverage > 1 && !GetData(device)->hostAveraging;
+
+	if (to->pixelRateHz != from->pixelRateHz)
+	{
+		if (OScDev_CHECK(err, SetPixelParameters(device, to->pixelRateHz)))
+			goto error;
+	}
+	if (waveformChanged)
+	{
+		if (OScDev_CHECK(err, WriteScanGeometry(device, to->resolution,
+			GetData(device)->lineDelay)))
+			goto error;
+	}
+	// The DRAM holding firmware averages is sized by the resolution
+	if (resolutionChanged ||
+		(firmwareAveraging && to->framesToAverage != from->framesToAverage))
+	{
+		if (OScDev_CHECK(err, InitScan(device)) ||
+			OScDev_CHECK(err, WaitTillIdle(device)))
+			goto error;
+	}
+	if (waveformChanged)
+	{
+		if (OScDev_CHECK(err, ReloadWaveform(device)) ||
+			OScDev_CHECK(err, WaitTillIdle(device)))
+			goto error;
+	}
+
+	GetData(device)->lastAcquisitionPixelRateHz = to->pixelRateHz;
+	GetData(device)->lastAcquisitionResolution = to->resolution;
+	GetData(device)->lastAcquisitionZoomFactor = toZoomFactor;
+	GetData(device)->lastAcquisitionFramesToAverage = to->framesToAverage;
+	return OScDev_OK;
+
+error:
+	GetData(device)->settingsChanged = true;
+	GetData(device)->reloadWaveformRequired = true;
+	ForgetResidentWaveform(device);
+	return err;
+}
+
+
+static void ReportStep(OScDev_Device *device, LARGE_INTEGER setupBegin,
+	LARGE_INTEGER scanStart, uint32_t framesAcquired)
+{
+	LARGE_INTEGER now, freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+
+	uint32_t step = GetData(device)->acquisition.step;
+	double setupMs = (double)(scanStart.QuadPart - setupBegin.QuadPart) * 1000.0 / freq.QuadPart;
+	double seconds = (double)(now.QuadPart - scanStart.QuadPart) / freq.QuadPart;
+	GetData(device)->lastStepTimings[step].setupMs = setupMs;
+	GetData(device)->lastStepTimings[step].seconds = seconds;
+	GetData(device)->lastStepTimings[step].framesAcquired = framesAcquired;
+	GetData(device)->lastStepCount = step + 1;
+
+	if (GetData(device)->acquisition.stepCount > 1)
+	{
+		const struct AcquisitionStep *scan = GetScanStep(device);
+		NIFPGA_LOG_INFO(device,
+			"Step %u of %u (%u x %u, zoom %g, %g Hz, average %u): set up in %.2f ms, "
+			"%u frames in %.3f s (%.2f frames/s)",
+			step + 1, GetData(device)->acquisition.stepCount,
+			scan->resolution, scan->resolution, GetScanZoomFactor(device),
+			scan->pixelRateHz, scan->framesToAverage, setupMs,
+			framesAcquired, seconds, seconds > 0.0 ? framesAcquired / seconds : 0.0);
+	}
+}
+
+
+// Scan and deliver the frames of the current step. *stopped is set if a
+// stop request ended the acquisition.
+static OScDev_Error ScanStep(OScDev_Device *device, OScDev_Acquisition *acq,
+	LARGE_INTEGER setupBegin, bool *stopped)
+{
+	*stopped = false;
+	const struct AcquisitionStep *scan = GetScanStep(device);
+	uint32_t step = GetData(device)->acquisition.step;
+	uint32_t acqNumFrames = scan->numberOfFrames;
 
 	int totalFrames;
 	int thisFrame;
 	if (acqNumFrames == INT32_MAX)
 		totalFrames = INT32_MAX;
 	else
-		totalFrames = acqNumFrames * GetData(device)->framesToAverage;
+		totalFrames = acqNumFrames * scan->framesToAverage;
 
+	// Until the scan starts, a stop request (or error) just ends the
+	// acquisition
 	OScDev_Error err;
-	if (OScDev_CHECK(err, SetTaskParameters(device, totalFrames)))
-		return err;
-	if (OScDev_CHECK(err, WaitTillIdle(device)))
-		return err;
+	if (OScDev_CHECK(err, SetTaskParameters(device, totalFrames)) ||
+		OScDev_CHECK(err, WaitTillIdle(device)))
+	{
+		*stopped = err == NIFPGA_ERROR_CANCELLED;
+		return *stopped ? OScDev_OK : err;
+	}
 
-	char msg[OScDev_MAX_STR_LEN + 1];
-	snprintf(msg, OScDev_MAX_STR_LEN, "%d frames averaged", GetData(device)->framesToAverage);
-	OScDev_Log_Debug(device, msg);
+	NIFPGA_LOG_DEBUG(device, "%u frames averaged", scan->framesToAverage);
+	NIFPGA_LOG_DEBUG(device, "%u number of frames", acqNumFrames);
+	NIFPGA_LOG_DEBUG(device, "%d total images", totalFrames);
 
-	snprintf(msg, OScDev_MAX_STR_LEN, "%d number of frames", acqNumFrames);
-	OScDev_Log_Debug(device, msg);
+	if (OScDev_CHECK(err, StartHostAveraging(device)) ||
+		OScDev_CHECK(err, StartTemporalFilter(device)) ||
+		OScDev_CHECK(err, StartFrameCorrection(device)) ||
+		OScDev_CHECK(err, StartPreview(device)) ||
+		OScDev_CHECK(err, StartFrameBuffers(device)))
+		return err;
+	StartRawCapture(device);
+
+	if (step + 1 < GetData(device)->acquisition.stepCount)
+		StageQueueStep(device, step + 1);
 
-	snprintf(msg, OScDev_MAX_STR_LEN, "%d total images", totalFrames);
-	OScDev_Log_Debug(device, msg);
-	
 	OScDev_Log_Debug(device, "Starting acquisition loop...");
 	if (OScDev_CHECK(err, StartScan(device)))
 		return err;
+	LARGE_INTEGER scanStart;
+	QueryPerformanceCounter(&scanStart);
+	if (step == 0)
+	{
+		GetData(device)->acquisition.scanStartTime = scanStart;
+		ReportStartLatency(device);
+	}
 
 	thisFrame = 1;
+	uint32_t framesAcquired = 0;
 
 	for (uint32_t frame = 0; frame < acqNumFrames; ++frame)
 	{
-		char msg[OScDev_MAX_STR_LEN + 1];
-		snprintf(msg, OScDev_MAX_STR_LEN, "Start frame %d", thisFrame);
-		OScDev_Log_Debug(device, msg);
+		NIFPGA_LOG_TRACE(device, 1000, "Start frame %d", thisFrame);
 		thisFrame++;
 
-		bool stopRequested;
-		EnterCriticalSection(&(GetData(device)->acquisition.mutex));
-		stopRequested = GetData(device)->acquisition.stopRequested;
-		LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
-		if (stopRequested)
+		// A stop request is also noticed within a frame, by the FIFO waits,
+		// which then abandon the frame
+		err = NIFPGA_ERROR_CANCELLED;
+		if (!IsStopRequested(device))
 		{
-			OScDev_Log_Debug(device, "User interruption...");
-			if (OScDev_CHECK(err, StopScan(device)))
-				return err;
-			GetData(device)->settingsChanged = true;
-			GetData(device)->reloadWaveformRequired = true;
+			uint32_t scanFramesLeft = totalFrames == INT32_MAX ? INT32_MAX :
+				(acqNumFrames - frame) * scan->framesToAverage;
+			if (OScDev_CHECK(err, ApplyWaveformUpdate(device, scanFramesLeft)))
+			{
+				if (err != NIFPGA_ERROR_CANCELLED)
+					NIFPGA_LOG_ERROR(device, "Error updating waveform: %d", (int)err);
+				*stopped = true;
+				break;
+			}
+			err = AcquireFrame(device, acq, frame % scan->framesToAverage);
+		}
+		if (err == NIFPGA_ERROR_CANCELLED)
+		{
+			if (OScDev_CHECK(err, InterruptScan(device)))
+				NIFPGA_LOG_ERROR(device, "Error stopping scan: %d", (int)err);
+			*stopped = true;
 			break;
 		}
+		if (err != OScDev_OK)
+		{
+			NIFPGA_LOG_ERROR(device, "Error during sequence acquisition: %d", (int)err);
+			return err;
+		}
+		++framesAcquired;
+		++GetData(device)->acquisition.framesAcquired;
+	}
+
+	ReportStep(device, setupBegin, scanStart, framesAcquired);
+	FinishStep(device);
+	return OScDev_OK;
+}
 
 
-		OScDev_Error err;
-		if (OScDev_CHECK(err,
-			AcquireFrame(device, acq, frame % GetData(device)->framesToAverage)))
+static OScDev_Error AcquisitionLoop(OScDev_Device *device)
+{
+	OScDev_Acquisition *acq = GetData(device)->acquisition.acquisition;
+	GetData(device)->acquisition.framesAcquired = 0;
+	GetData(device)->lastStepCount = 0;
+
+	OScDev_Error err;
+	if (OScDev_CHECK(err, StartFrameStatistics(device)) ||
+		OScDev_CHECK(err, StartFifoReaders(device)) ||
+		OScDev_CHECK(err, StartWorkPool(device)) ||
+		OScDev_CHECK(err, StartWaveformUpdater(device)))
+	{
+		FinishAcquisition(device);
+		return 0;
+	}
+
+	// Steps after the first are set up here, with no round trip through
+	// the application (see OScNIFPGAQueue.h)
+	LARGE_INTEGER setupBegin = GetData(device)->acquisition.armTime;
+	for (uint32_t step = 0; step < GetData(device)->acquisition.stepCount; ++step)
+	{
+		if (step > 0)
 		{
-			char msg[OScDev_MAX_STR_LEN + 1];
-			snprintf(msg, OScDev_MAX_STR_LEN,
-				"Error during sequence acquisition: %d", (int)err);
-			OScDev_Log_Error(device, msg);
-			FinishAcquisition(device);
-			return 0;
+			QueryPerformanceCounter(&setupBegin);
+			if (OScDev_CHECK(err, BeginQueueStep(device, step)))
+			{
+				if (err != NIFPGA_ERROR_CANCELLED)
+					NIFPGA_LOG_ERROR(device, "Error setting up queue step %u: %d",
+						step + 1, (int)err);
+				break;
+			}
 		}
+
+		bool stopped;
+		if (OScDev_CHECK(err, ScanStep(device, acq, setupBegin, &stopped)) || stopped)
+			break;
 	}
 
 	FinishAcquisition(device);
+	return err;
+}
+
+
+static void ApplyWorkerScheduling(OScDev_Device *device)
+{
+	static const int priorities[ACQUISITION_PRIORITY_NUM_VALUES] = {
+		THREAD_PRIORITY_NORMAL,
+		THREAD_PRIORITY_ABOVE_NORMAL,
+		THREAD_PRIORITY_HIGHEST,
+		THREAD_PRIORITY_TIME_CRITICAL,
+	};
+	HANDLE thread = GetCurrentThread();
+	if (!SetThreadPriority(thread, priorities[GetData(device)->acquisitionThreadPriority]))
+		OScDev_Log_Warning(device, "Failed to set acquisition thread priority");
+
+	DWORD_PTR mask = (DWORD_PTR)(uint32_t)GetData(device)->acquisitionThreadAffinity;
+	if (mask == 0)
+	{
+		DWORD_PTR systemMask;
+		if (!GetProcessAffinityMask(GetCurrentProcess(), &mask, &systemMask))
+			return;
+	}
+	if (SetThreadAffinityMask(thread, mask) == 0)
+		OScDev_Log_Warning(device, "Failed to set acquisition thread affinity");
+}
+
+
+static SRWLOCK g_armCallbackLock = SRWLOCK_INIT;
+static OScNIFPGA_ArmCallback g_armCallback; // Guarded by g_armCallbackLock
+static void *g_armCallbackContext;
+
+
+void OScNIFPGA_SetArmCallback(OScNIFPGA_ArmCallback callback, void *context)
+{
+	AcquireSRWLockExclusive(&g_armCallbackLock);
+	g_armCallback = callback;
+	g_armCallbackContext = context;
+	ReleaseSRWLockExclusive(&g_armCallbackLock);
+}
+
+
+static void NotifyArmFinished(OScDev_Device *device, bool armed)
+{
+	// Call without the lock, so that the callback may replace itself
+	AcquireSRWLockShared(&g_armCallbackLock);
+	OScNIFPGA_ArmCallback callback = g_armCallback;
+	void *context = g_armCallbackContext;
+	ReleaseSRWLockShared(&g_armCallbackLock);
+
+	if (callback != NULL)
+		callback(GetData(device)->rioResourceName, armed, context);
+}
+
+
+static DWORD WINAPI AcquisitionWorker(void *param)
+{
+	OScDev_Device *device = (OScDev_Device *)param;
+
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	for (;;)
+	{
+		while (!GetData(device)->acquisition.startRequested &&
+			!GetData(device)->acquisition.armRequested &&
+			!GetData(device)->acquisition.exitRequested)
+		{
+			SleepConditionVariableCS(&(GetData(device)->acquisition.startCondition),
+				&(GetData(device)->acquisition.mutex), INFINITE);
+		}
+		if (GetData(device)->acquisition.exitRequested)
+			break;
+
+		// Start waits for the arm, so the two are never requested together
+		if (GetData(device)->acquisition.armRequested)
+		{
+			GetData(device)->acquisition.armRequested = false;
+			LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+
+			OScDev_Error err = PrepareArm(device);
+			if (err != OScDev_OK && err != NIFPGA_ERROR_CANCELLED)
+				NIFPGA_LOG_ERROR(device, "Error setting up asynchronous arm: %d", (int)err);
+			NotifyArmFinished(device, err == OScDev_OK);
+
+			EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+			continue;
+		}
+		GetData(device)->acquisition.startRequested = false;
+		LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+
+		ApplyWorkerScheduling(device);
+		AcquisitionLoop(device);
+
+		EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	}
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
 	return 0;
 }
 
 
-OScDev_Error RunAcquisitionLoop(OScDev_Device *device)
+OScDev_Error StartAcquisitionWorker(OScDev_Device *device)
 {
-	DWORD id;
+	GetData(device)->acquisition.startRequested = false;
+	GetData(device)->acquisition.armRequested = false;
+	GetData(device)->acquisition.exitRequested = false;
 	GetData(device)->acquisition.thread =
-		CreateThread(NULL, 0, AcquisitionLoop, device, 0, &id);
+		CreateThread(NULL, 0, AcquisitionWorker, device, 0, NULL);
+	if (GetData(device)->acquisition.thread == NULL)
+	{
+		OScDev_Log_Error(device, "Failed to create acquisition thread");
+		return OScDev_Error_Unknown;
+	}
+
+	OScDev_Error err;
+	if (OScDev_CHECK(err, AcquisitionStager_Start(&(GetData(device)->acquisition.stager), device)))
+	{
+		OScDev_Log_Error(device, "Failed to create staging thread");
+		StopAcquisitionWorker(device);
+		return err;
+	}
+	StageNextAcquisition(device);
+	return OScDev_OK;
+}
+
+
+// Any acquisition must have finished
+void StopAcquisitionWorker(OScDev_Device *device)
+{
+	if (GetData(device)->acquisition.thread == NULL)
+		return;
+
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	GetData(device)->acquisition.exitRequested = true;
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+	WakeConditionVariable(&(GetData(device)->acquisition.startCondition));
+
+	WaitForSingleObject(GetData(device)->acquisition.thread, INFINITE);
+	CloseHandle(GetData(device)->acquisition.thread);
+	GetData(device)->acquisition.thread = NULL;
+
+	AcquisitionStager_Stop(GetData(device)->acquisition.stager);
+	GetData(device)->acquisition.stager = NULL;
+	StagedAcquisition_Destroy(GetData(device)->acquisition.staged);
+	GetData(device)->acquisition.staged = NULL;
+}
+
+
+OScDev_Error RunAcquisitionLoop(OScDev_Device *device)
+{
+	if (GetData(device)->acquisition.thread == NULL)
+		return OScDev_Error_Unknown;
+
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	GetData(device)->acquisition.startRequested = true;
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+	WakeConditionVariable(&(GetData(device)->acquisition.startCondition));
+	return OScDev_OK;
+}
+
+
+// Have the acquisition thread set up the FPGA for the armed acquisition
+OScDev_Error RequestAsyncArm(OScDev_Device *device)
+{
+	if (GetData(device)->acquisition.thread == NULL)
+		return PrepareArm(device);
+
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	GetData(device)->acquisition.armRequested = true;
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+	WakeConditionVariable(&(GetData(device)->acquisition.startCondition));
 	return OScDev_OK;
 }
 
 
+// A setting that the setup depends on has changed, so an asynchronous arm
+// still setting up would arm with stale values; cancel it, leaving the
+// device unarmed (see OScNIFPGAArm.h)
+void CancelPendingArm(OScDev_Device *device)
+{
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	if (GetData(device)->acquisition.running &&
+		GetData(device)->acquisition.armPending)
+	{
+		OScDev_Log_Debug(device, "Settings changed; cancelling asynchronous arm");
+		GetData(device)->acquisition.stopRequested = true;
+	}
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+}
+
+
+// Change the offset, line delay or zoom between these two calls, which
+// hold the acquisition mutex so that the scan never sees a change without
+// its update. A running scan switches to the new waveform at its next
+// frame boundary; otherwise the change takes effect at the next arm.
+void BeginWaveformChange(OScDev_Device *device)
+{
+	CancelPendingArm(device);
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+}
+
+
+void EndWaveformChange(OScDev_Device *device)
+{
+	GetData(device)->settingsChanged = true;
+	GetData(device)->reloadWaveformRequired = true;
+	struct WaveformUpdater *updater = GetData(device)->acquisition.waveformUpdater;
+	if (updater != NULL)
+	{
+		struct WaveformGeometry geometry;
+		GetWaveformGeometry(device, &geometry);
+		WaveformUpdater_Request(updater, &geometry);
+	}
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+}
+
+
 OScDev_Error StopAcquisitionAndWait(OScDev_Device *device)
 {
 	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
@@ -1064,6 +2488,16 @@ OScDev_Error StopAcquisitionAndWait(OScDev_Device *device)
 		}
 
 		GetData(device)->acquisition.stopRequested = true;
+
+		// An acquisition armed but never started has no loop to end it
+		if (GetData(device)->acquisition.armed &&
+			!GetData(device)->acquisition.started)
+		{
+			GetData(device)->acquisition.running = false;
+			LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+			WakeAllConditionVariable(&(GetData(device)->acquisition.acquisitionFinishCondition));
+			return OScDev_OK;
+		}
 	}
 	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
 	return WaitForAcquisitionToFinish(device);
@@ -2,11 +2,20 @@
 
 #include "OScNIFPGADevicePrivate.h"
 
+// RIO resource names of the FPGA boards to enumerate, separated by ';' (for
+// example "RIO0;RIO1;rio://192.168.10.2/RIO0"); RIO0 alone when not set
+#define RIO_RESOURCES_ENVIRONMENT_VARIABLE "OSC_NIFPGA_RESOURCES"
+
 OScDev_Error EnumerateInstances(OScDev_PtrArray **devices);
 OScDev_Error OpenFPGA(OScDev_Device *device);
 OScDev_Error CloseFPGA(OScDev_Device *device);
 OScDev_Error StartFPGA(OScDev_Device *device);
-OScDev_Error ReloadWaveform(OScDev_Device *device, OScDev_Acquisition *acq);
+bool AttachRunningFPGA(OScDev_Device *device);
+void RestoreResidentWaveform(OScDev_Device *device);
+OScDev_Error ReloadWaveform(OScDev_Device *device);
+bool IsCurrentWaveformResident(OScDev_Device *device);
+void StageNextAcquisition(OScDev_Device *device);
+void TakeStagedAcquisition(OScDev_Device *device);
 OScDev_Error WaitTillIdle(OScDev_Device *device);
 OScDev_Error SetBuildInParameters(OScDev_Device *device);
 OScDev_Error SetPixelParameters(OScDev_Device *device, double pixelRateHz);
@@ -14,7 +23,13 @@ OScDev_Error SetResolutionParameters(OScDev_Device *device, uint32_t resolution)
 OScDev_Error SetTaskParameters(OScDev_Device *device, uint32_t nf);
 OScDev_Error Cleanflags(OScDev_Device *device);
 OScDev_Error InitScan(OScDev_Device *device);
+OScDev_Error StartAcquisitionWorker(OScDev_Device *device);
+void StopAcquisitionWorker(OScDev_Device *device);
 OScDev_Error RunAcquisitionLoop(OScDev_Device *device);
+OScDev_Error RequestAsyncArm(OScDev_Device *device);
+void CancelPendingArm(OScDev_Device *device);
+void BeginWaveformChange(OScDev_Device *device);
+void EndWaveformChange(OScDev_Device *device);
 OScDev_Error StopAcquisitionAndWait(OScDev_Device *device);
 OScDev_Error IsAcquisitionRunning(OScDev_Device *device, bool *isRunning);
 OScDev_Error WaitForAcquisitionToFinish(OScDev_Device *device);
@@ -0,0 +1,9 @@
+#pragma once
+
+// Export macro for the public interface of the NI FPGA device module
+
+#ifdef OPENSCANNIFPGA_EXPORTS
+#define OSCNIFPGA_API __declspec(dllexport)
+#else
+#define OSCNIFPGA_API __declspec(dllimport)
+#endif
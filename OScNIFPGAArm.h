@@ -0,0 +1,43 @@
+#pragma once
+
+// Public interface for applications using the NI FPGA device module
+
+#include "OScNIFPGAApi.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Asynchronous arm
+//
+// Arming sets up the FPGA: reset, parameters, DRAM initialization and, at
+// high resolution, a waveform upload that can take seconds. When the
+// AsyncArm setting is on, arming only checks the acquisition and returns;
+// the setup runs on the device's acquisition thread. Start waits for it if
+// it is still in progress, and fails if it failed.
+//
+// A stop, or a change to a setting that the setup depends on (line delay,
+// offset, zoom, averaging, scanner or detector enabled), cancels a setup in
+// progress and leaves the device unarmed; arm again with the new settings.
+
+
+// Called on the acquisition thread of the device named deviceName when the
+// setup of an asynchronous arm has finished; armed is false if it failed
+// or was cancelled
+typedef void (*OScNIFPGA_ArmCallback)(const char *deviceName, bool armed,
+	void *context);
+
+// Set the function called when any device finishes an asynchronous arm;
+// null for none. The function must not call back into the device, but may
+// call this. A setup finishing while this is called may still report to
+// the previous function.
+OSCNIFPGA_API void OScNIFPGA_SetArmCallback(OScNIFPGA_ArmCallback callback,
+	void *context);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,5 +1,7 @@
 #include "OScNIFPGADevicePrivate.h"
 #include "OScNIFPGA.h"
+#include "Log.h"
+#include "Replay.h"
 
 #include <math.h>
 
@@ -30,16 +32,35 @@ static OScDev_Error NIFPGAOpen(OScDev_Device *device)
 	OScDev_Error err;
 	if (OScDev_CHECK(err, OpenFPGA(device)))
 		return err;
-	if (OScDev_CHECK(err, StartFPGA(device)))
-		return err;
+	// Parameters from before a close are not relied on; only the waveform
+	// left in DRAM by an earlier session is, when the FPGA was not reset
+	GetData(device)->settingsChanged = true;
+	GetData(device)->reloadWaveformRequired = true;
+	if (AttachRunningFPGA(device))
+	{
+		RestoreResidentWaveform(device);
+	}
+	else
+	{
+		if (OScDev_CHECK(err, StartFPGA(device)))
+			goto error;
+	}
+	if (OScDev_CHECK(err, StartAcquisitionWorker(device)))
+		goto error;
 
 	return OScDev_OK;
+
+error:
+	// Leave the device closed, as if OpenFPGA() had failed
+	CloseFPGA(device);
+	return err;
 }
 
 
 static OScDev_Error NIFPGAClose(OScDev_Device *device)
 {
 	StopAcquisitionAndWait(device);
+	StopAcquisitionWorker(device);
 	OScDev_Error err = CloseFPGA(device);
 	return err;
 }
@@ -137,6 +158,11 @@ static OScDev_Error NIFPGAGetNumberOfChannels(OScDev_Device *device, uint32_t *n
 		*nChannels = 4;
 		break;
 	}
+	if (GetData(device)->deliverRawPlanes)
+		*nChannels *= 2;
+	// All samples of a pixel travel together as one wide sample
+	if (GetData(device)->interleavedFrames)
+		*nChannels = 1;
 	return OScDev_OK;
 }
 
@@ -144,70 +170,78 @@ static OScDev_Error NIFPGAGetNumberOfChannels(OScDev_Device *device, uint32_t *n
 static OScDev_Error NIFPGAGetBytesPerSample(OScDev_Device *device, uint32_t *bytesPerSample)
 {
 	*bytesPerSample = 2;
+	if (GetData(device)->interleavedFrames)
+	{
+		*bytesPerSample *= GetData(device)->channels + 1;
+		if (GetData(device)->deliverRawPlanes)
+			*bytesPerSample *= 2;
+	}
 	return OScDev_OK;
 }
 
 
-static OScDev_Error NIFPGAArm(OScDev_Device *device, OScDev_Acquisition *acq)
+// The acquisition as steps: the queue, if one is set, with what it leaves
+// out taken from acq; otherwise acq alone
+static OScDev_Error GetAcquisitionSteps(OScDev_Device *device, OScDev_Acquisition *acq,
+	struct AcquisitionStep *steps, uint32_t *stepCount)
 {
-	bool useClock, useScanner, useDetector;
-	OScDev_Acquisition_IsClockRequested(acq, &useClock);
-	OScDev_Acquisition_IsScannerRequested(acq, &useScanner);
-	OScDev_Acquisition_IsDetectorRequested(acq, &useDetector);
-
-	// assume scanner is always enabled
-	if (!useClock || !useScanner)
-		return OScDev_Error_Unsupported_Operation;
-
-	OScDev_TriggerSource clockStartTriggerSource;
-	OScDev_Acquisition_GetClockStartTriggerSource(acq, &clockStartTriggerSource);
-	if (clockStartTriggerSource != OScDev_TriggerSource_Software)
-		return OScDev_Error_Unsupported_Operation;
+	struct AcquisitionStep defaults = {
+		.resolution = OScDev_Acquisition_GetResolution(acq),
+		.zoomFactor = OScDev_Acquisition_GetZoomFactor(acq),
+		.pixelRateHz = OScDev_Acquisition_GetPixelRate(acq),
+		.numberOfFrames = OScDev_Acquisition_GetNumberOfFrames(acq),
+		.framesToAverage = GetData(device)->framesToAverage,
+	};
 
-	OScDev_ClockSource clockSource;
-	OScDev_Acquisition_GetClockSource(acq, &clockSource);
-	if (clockSource != OScDev_ClockSource_Internal)
-		return OScDev_Error_Unsupported_Operation;
-	// what if we use external line clock to trigger acquisition?
+	const struct AcquisitionQueue *queue = &(GetData(device)->queue);
+	if (queue->stepCount == 0)
+	{
+		steps[0] = defaults;
+		*stepCount = 1;
+		return OScDev_OK;
+	}
 
-	GetData(device)->detectorEnabled = useDetector;
-	GetData(device)->scannerEnabled = useScanner;
-	
-	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	for (uint32_t i = 0; i < queue->stepCount; ++i)
 	{
-		if (GetData(device)->acquisition.running &&
-			GetData(device)->acquisition.armed)
+		steps[i] = queue->steps[i];
+		AcquisitionStep_Resolve(&steps[i], &defaults);
+		if (!GetData(device)->hostAveraging &&
+			steps[i].framesToAverage > FIRMWARE_MAX_FRAMES_TO_AVERAGE)
 		{
-			LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
-			if (GetData(device)->acquisition.started)
-				return OScDev_Error_Acquisition_Running;
-			else
-				return OScDev_OK;
+			NIFPGA_LOG_ERROR(device, "Queue step %u averages more frames than the firmware can",
+				i + 1);
+			return OScDev_Error_Illegal_Argument;
 		}
-
-		GetData(device)->acquisition.acquisition = acq;
-
-		GetData(device)->acquisition.stopRequested = false;
-		GetData(device)->acquisition.running = true;
-		GetData(device)->acquisition.armed = false;
-		GetData(device)->acquisition.started = false;
 	}
-	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+	*stepCount = queue->stepCount;
+	return OScDev_OK;
+}
 
-	double pixelRateHz = OScDev_Acquisition_GetPixelRate(acq);
-	uint32_t resolution = OScDev_Acquisition_GetResolution(acq);
-	double zoomFactor = OScDev_Acquisition_GetZoomFactor(acq);
+
+// Bring the FPGA up to date with the parameters of the first step
+static OScDev_Error SetUpScan(OScDev_Device *device)
+{
+	const struct AcquisitionStep *scan = GetScanStep(device);
+	double pixelRateHz = scan->pixelRateHz;
+	uint32_t resolution = scan->resolution;
+	double zoomFactor = GetScanZoomFactor(device);
 	if (pixelRateHz != GetData(device)->lastAcquisitionPixelRateHz ||
 		resolution != GetData(device)->lastAcquisitionResolution ||
-		zoomFactor != GetData(device)->lastAcquisitionZoomFactor) {
+		zoomFactor != GetData(device)->lastAcquisitionZoomFactor ||
+		scan->framesToAverage != GetData(device)->lastAcquisitionFramesToAverage) {
 		GetData(device)->settingsChanged = true;
 	}
 	if (resolution != GetData(device)->lastAcquisitionResolution ||
 		zoomFactor != GetData(device)->lastAcquisitionZoomFactor) {
 		GetData(device)->reloadWaveformRequired = true;
 	}
+	// Neither the reset nor the upload is needed while the waveform is
+	// still in DRAM, as when a setting is changed and changed back
+	if (GetData(device)->reloadWaveformRequired && IsCurrentWaveformResident(device))
+		GetData(device)->reloadWaveformRequired = false;
+	GetData(device)->acquisition.reconfigured = GetData(device)->settingsChanged;
 
-	uint32_t nFrames = OScDev_Acquisition_GetNumberOfFrames(acq);
+	uint32_t nFrames = scan->numberOfFrames;
 
 	if (GetData(device)->settingsChanged)
 	{
@@ -243,7 +277,7 @@ static OScDev_Error NIFPGAArm(OScDev_Device *device, OScDev_Acquisition *acq)
 
 		if (GetData(device)->reloadWaveformRequired)
 		{
-			if (OScDev_CHECK(err, ReloadWaveform(device, acq)))
+			if (OScDev_CHECK(err, ReloadWaveform(device)))
 				return err;
 			if (OScDev_CHECK(err, WaitTillIdle(device)))
 				return err;
@@ -251,16 +285,136 @@ static OScDev_Error NIFPGAArm(OScDev_Device *device, OScDev_Acquisition *acq)
 
 		GetData(device)->settingsChanged = false;
 		GetData(device)->reloadWaveformRequired = false;
+		GetData(device)->lastAcquisitionPixelRateHz = pixelRateHz;
+		GetData(device)->lastAcquisitionResolution = resolution;
+		GetData(device)->lastAcquisitionZoomFactor = zoomFactor;
+		GetData(device)->lastAcquisitionFramesToAverage = scan->framesToAverage;
+	}
+
+	return OScDev_OK;
+}
+
+
+static OScDev_Error NIFPGAArm(OScDev_Device *device, OScDev_Acquisition *acq)
+{
+	bool useClock, useScanner, useDetector;
+	OScDev_Acquisition_IsClockRequested(acq, &useClock);
+	OScDev_Acquisition_IsScannerRequested(acq, &useScanner);
+	OScDev_Acquisition_IsDetectorRequested(acq, &useDetector);
+
+	// assume scanner is always enabled
+	if (!useClock || !useScanner)
+		return OScDev_Error_Unsupported_Operation;
+
+	OScDev_TriggerSource clockStartTriggerSource;
+	OScDev_Acquisition_GetClockStartTriggerSource(acq, &clockStartTriggerSource);
+	if (clockStartTriggerSource != OScDev_TriggerSource_Software)
+		return OScDev_Error_Unsupported_Operation;
+
+	OScDev_ClockSource clockSource;
+	OScDev_Acquisition_GetClockSource(acq, &clockSource);
+	if (clockSource != OScDev_ClockSource_Internal)
+		return OScDev_Error_Unsupported_Operation;
+	// what if we use external line clock to trigger acquisition?
+
+	struct AcquisitionStep steps[ACQUISITION_QUEUE_MAX_STEPS];
+	uint32_t stepCount;
+	OScDev_Error err;
+	if (OScDev_CHECK(err, GetAcquisitionSteps(device, acq, steps, &stepCount)))
+		return err;
+
+	if (GetData(device)->replay != NULL)
+	{
+		const struct RawCaptureGeometry *recorded = Replay_GetGeometry(GetData(device)->replay);
+		for (uint32_t i = 0; i < stepCount; ++i)
+		{
+			if (steps[i].resolution != recorded->resolution)
+			{
+				NIFPGA_LOG_ERROR(device, "Replay requires resolution %u", recorded->resolution);
+				return OScDev_Error_Unsupported_Operation;
+			}
+		}
+		Replay_SetOriginalTiming(GetData(device)->replay, GetData(device)->replayOriginalTiming);
 	}
 
+	GetData(device)->detectorEnabled = useDetector;
+	GetData(device)->scannerEnabled = useScanner;
+	
+	bool async = GetData(device)->asyncArm;
 	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
 	{
-		GetData(device)->acquisition.armed = true;
+		// A cancelled asynchronous setup must end before arming again
+		while (GetData(device)->acquisition.running &&
+			GetData(device)->acquisition.armPending &&
+			GetData(device)->acquisition.stopRequested)
+		{
+			SleepConditionVariableCS(&(GetData(device)->acquisition.acquisitionFinishCondition),
+				&(GetData(device)->acquisition.mutex), INFINITE);
+		}
+
+		if (GetData(device)->acquisition.running &&
+			(GetData(device)->acquisition.armed || GetData(device)->acquisition.armPending))
+		{
+			LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+			if (GetData(device)->acquisition.started)
+				return OScDev_Error_Acquisition_Running;
+			else
+				return OScDev_OK;
+		}
+
+		GetData(device)->acquisition.acquisition = acq;
+		memcpy(GetData(device)->acquisition.steps, steps,
+			sizeof(struct AcquisitionStep) * stepCount);
+		GetData(device)->acquisition.stepCount = stepCount;
+		GetData(device)->acquisition.step = 0;
+		GetData(device)->acquisition.channelCount = GetData(device)->channels + 1;
+		GetData(device)->acquisition.deliverRawPlanes = GetData(device)->deliverRawPlanes;
+		GetData(device)->acquisition.interleavedFrames = GetData(device)->interleavedFrames;
+		QueryPerformanceCounter(&(GetData(device)->acquisition.armTime));
+
+		GetData(device)->acquisition.stopRequested = false;
+		GetData(device)->acquisition.running = true;
+		GetData(device)->acquisition.armed = false;
+		GetData(device)->acquisition.armPending = async;
+		GetData(device)->acquisition.armError = OScDev_OK;
+		GetData(device)->acquisition.started = false;
 	}
 	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
 
-	return OScDev_OK;
+	err = async ? RequestAsyncArm(device) : PrepareArm(device);
+	return err == NIFPGA_ERROR_CANCELLED ? OScDev_OK : err;
+}
+
+
+OScDev_Error PrepareArm(OScDev_Device *device)
+{
+	TakeStagedAcquisition(device);
+
+	OScDev_Error err = SetUpScan(device);
+
+	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
+	{
+		// A stop or settings change after the last point where the setup
+		// checks for one still cancels it
+		if (err == OScDev_OK && GetData(device)->acquisition.stopRequested)
+		{
+			err = NIFPGA_ERROR_CANCELLED;
+			GetData(device)->settingsChanged = true;
+			GetData(device)->reloadWaveformRequired = true;
+		}
+		GetData(device)->acquisition.armPending = false;
+		GetData(device)->acquisition.armError = err;
+		if (err == OScDev_OK)
+			GetData(device)->acquisition.armed = true;
+		else
+			GetData(device)->acquisition.running = false;
+	}
+	LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
 
+	// Let a Start, Stop or Wait in progress return; a stop request that
+	// interrupted the setup leaves the device unarmed
+	WakeAllConditionVariable(&(GetData(device)->acquisition.acquisitionFinishCondition));
+	return err;
 }
 
 
@@ -269,10 +423,20 @@ static OScDev_Error NIFPGAStart(OScDev_Device *device)
 	// start scanner
 	EnterCriticalSection(&(GetData(device)->acquisition.mutex));
 	{
+		while (GetData(device)->acquisition.running &&
+			GetData(device)->acquisition.armPending)
+		{
+			SleepConditionVariableCS(&(GetData(device)->acquisition.acquisitionFinishCondition),
+				&(GetData(device)->acquisition.mutex), INFINITE);
+		}
+
 		if (!GetData(device)->acquisition.running ||
 			!GetData(device)->acquisition.armed)
 		{
+			OScDev_Error armError = GetData(device)->acquisition.armError;
 			LeaveCriticalSection(&(GetData(device)->acquisition.mutex));
+			if (armError != OScDev_OK && armError != NIFPGA_ERROR_CANCELLED)
+				return armError;
 			return OScDev_Error_Not_Armed;
 		}
 		if (GetData(device)->acquisition.started)
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "AcquisitionQueue.h"
 #include "OScNIFPGADevice.h"
+#include "OScNIFPGAFrameStats.h"
+#include "WaveformUpdater.h"
 
 #include "OpenScanDeviceLib.h"
 
@@ -23,18 +26,67 @@ enum
 #define OSc_DEFAULT_RESOLUTION 512
 #define OSc_DEFAULT_ZOOM 1.0
 
+// Upper limit of framesToAverage when the firmware averages
+#define FIRMWARE_MAX_FRAMES_TO_AVERAGE 100
+
+// Returned within the module by waits that a stop request interrupted
+#define NIFPGA_ERROR_CANCELLED (OScDev_Error_Unknown + 1000)
+
+struct AcquisitionStager;
+struct FifoReaders;
+struct FpgaBackend;
+struct FrameCorrection;
+struct Preview;
+struct FrameAverager;
+struct RawCapture;
+struct TemporalFilter;
+struct Replay;
+struct StagedAcquisition;
+struct WorkPool;
+
 struct OScNIFPGAPrivateData
 {
 	char rioResourceName[OScDev_MAX_STR_LEN + 1];
 	NiFpga_Session niFpgaSession;
 	char bitfile[OScDev_MAX_STR_LEN + 1];
 
+	// All FPGA access goes through this (see FpgaBackend.h)
+	const struct FpgaBackend *backend;
+
+	// Replay device only: capture fed through the simulated backend
+	char replayPath[OScDev_MAX_STR_LEN + 1];
+	struct Replay *replay; // Non-null while open
+	bool replayOriginalTiming;
+
 	// Remember last used to avoid unnecessary waveform reloads
 	double lastAcquisitionPixelRateHz;
 	uint32_t lastAcquisitionResolution;
 	double lastAcquisitionZoomFactor;
+	uint32_t lastAcquisitionFramesToAverage;
 	bool settingsChanged;
 	bool reloadWaveformRequired;
+	// Leave the configuration resident on the FPGA when an acquisition is
+	// stopped, so that restarting live view only restarts the scan
+	bool keepArmed;
+	// Set up the FPGA on the acquisition thread instead of in Arm (see
+	// OScNIFPGAArm.h)
+	bool asyncArm;
+	// Reset the FPGA when the device is closed. Otherwise it is left running
+	// with its configuration and waveform, and the next open (possibly by
+	// another process) attaches to it without a reset.
+	bool resetOnClose;
+	// Galvo position at the start of the loaded waveform
+	uint16_t waveformStartX;
+	uint16_t waveformStartY;
+	// The waveform held in FPGA DRAM, which is not uploaded again while it
+	// stays there. The bitfile reads the waveform from a fixed DRAM
+	// address, so this is the only slot.
+	struct
+	{
+		bool valid;
+		uint64_t tag; // WaveformGeometry_Hash() of geometry
+		struct WaveformGeometry geometry;
+	} residentWaveform;
 
 	bool scannerEnabled;
 	bool detectorEnabled;
@@ -44,6 +96,9 @@ struct OScNIFPGAPrivateData
 	// scan phase (uSec) = line delay * bin factor / scan rate
 	uint32_t lineDelay;
 	double offsetXY[2];
+	// Replaces the zoom factor of the acquisition, and can be changed while
+	// scanning; 0 to use the acquisition's
+	double liveZoomFactor;
 
 	enum {
 		CHANNELS_1_,
@@ -55,20 +110,131 @@ struct OScNIFPGAPrivateData
 	} channels;
 
 	bool useProgressiveAveraging;
-	uint16_t filterGain;
+	// Prediction weight of the temporal filter, 0 to 1
+	double filterGain;
 	uint32_t framesToAverage;
+	// Average on the host (see FrameAverager.h) instead of in the firmware
+	bool hostAveraging;
+	// Live-view filter over delivered frames (see TemporalFilter.h)
+	uint32_t temporalFilter; // enum TemporalFilterMode
+	// Also deliver the raw (unaveraged) plane of each channel, as channels
+	// following the averaged ones; read at arm
+	bool deliverRawPlanes;
+	// Deliver all channels pixel-interleaved in one buffer (see
+	// OScNIFPGAFrameLayout.h); read at arm
+	bool interleavedFrames;
+	// Compute per-frame statistics (see OScNIFPGAFrameStats.h)
+	bool frameStatistics;
+	// Dark and flat-field maps, loaded at acquisition start (see
+	// FrameCorrection.h); empty for no correction
+	char correctionDirectory[OScDev_MAX_STR_LEN + 1];
+	// Downsampled previews (see OScNIFPGAPreview.h); 0 levels for none
+	uint32_t previewLevels;
+	bool preview8Bit;
+	int32_t previewDisplayMin;
+	int32_t previewDisplayMax;
+	// Drain each FIFO on its own thread (see FifoReaders.h)
+	bool parallelFifoReaders;
+	// Threads processing each frame (see WorkPool.h); 0 for the processors
+	// divided among the open devices
+	int32_t processingThreads;
+
+	// Geometry of the next acquisition, prepared in advance (see
+	// AcquisitionStager.h); resolution 0 for none
+	uint32_t nextResolution;
+	double nextZoomFactor;
+
+	// Acquisitions run back to back by each arm (see OScNIFPGAQueue.h)
+	char queueText[OScDev_MAX_STR_LEN + 1];
+	struct AcquisitionQueue queue;
+
+	// Scheduling of the acquisition worker, applied at each start
+	enum {
+		ACQUISITION_PRIORITY_NORMAL,
+		ACQUISITION_PRIORITY_ABOVE_NORMAL,
+		ACQUISITION_PRIORITY_HIGHEST,
+		ACQUISITION_PRIORITY_TIME_CRITICAL,
+
+		ACQUISITION_PRIORITY_NUM_VALUES
+	} acquisitionThreadPriority;
+	int32_t acquisitionThreadAffinity; // Processor mask; 0 for any
+
+	// Emit rate-limited per-frame and per-poll trace messages (see Log.h)
+	bool debugTracing;
+
+	// Stream unmodified FIFO words to disk during acquisition (see RawCapture.h)
+	bool rawCaptureEnabled;
+	char rawCaptureDirectory[OScDev_MAX_STR_LEN + 1];
 
 	struct
 	{
 		CRITICAL_SECTION mutex;
+		// Worker that runs each acquisition; lives from Open to Close
 		HANDLE thread;
+		CONDITION_VARIABLE startCondition;
+		bool startRequested;
+		bool armRequested; // Set up the FPGA for the armed acquisition
+		bool exitRequested;
+		// Prepares the next acquisition; lives from Open to Close
+		struct AcquisitionStager *stager;
 		CONDITION_VARIABLE acquisitionFinishCondition;
 		bool running;
 		bool armed; // Valid when running == true
+		// Valid when running == true: an asynchronous arm is setting up
+		bool armPending;
+		OScDev_Error armError; // Of the most recent arm
 		bool started; // Valid when running == true
 		bool stopRequested; // Valid when running == true
 		OScDev_Acquisition *acquisition;
+		// One step, or those of the queue, resolved at arm; step is the one
+		// set up on the FPGA and is changed under mutex
+		struct AcquisitionStep steps[ACQUISITION_QUEUE_MAX_STEPS];
+		uint32_t stepCount;
+		uint32_t step;
+		// Shape of the delivered frames, taken from the settings at arm, as
+		// OpenScan asks for the channel count and sample size only then
+		uint32_t channelCount; // Scanned channels
+		bool deliverRawPlanes;
+		bool interleavedFrames;
+		struct RawCapture *rawCapture; // Non-null while capturing
+		// Buffers of the frame being read and delivered, kept for the step
+		struct
+		{
+			uint32_t *words[4]; // Per FIFO
+			uint16_t *averaged[4]; // Per channel
+			uint16_t *raw[4]; // Per channel, when delivering raw planes
+			uint16_t *interleaved; // When delivering interleaved frames
+		} frameBuffers;
+		struct FrameAverager *averager; // Non-null while host averaging
+		struct TemporalFilter *temporalFilter; // Non-null while filtering
+		OScNIFPGA_FrameStats *frameStats; // Per delivered channel; may be null
+		struct FrameCorrection *correction; // Non-null while correcting
+		struct Preview *preview; // Non-null while building previews
+		struct FifoReaders *fifoReaders; // Non-null while reading in parallel
+		struct WorkPool *workPool; // Non-null while processing in parallel
+		// Per worker of workPool, while it and frameStats are non-null
+		OScNIFPGA_FrameStats *workerStats;
+		struct StagedAcquisition *staged; // Taken at arm; may be null
+		// Non-null while scanning; guarded by mutex (see WaveformUpdater.h)
+		struct WaveformUpdater *waveformUpdater;
+		LARGE_INTEGER armTime;
+		bool reconfigured; // Whether the arm sent parameters to the FPGA
+		LARGE_INTEGER scanStartTime;
+		uint32_t framesAcquired;
 	} acquisition;
+
+	// Throughput of the most recently finished acquisition
+	double lastAcquisitionFramesPerSecond;
+	// Time from arm to scan start of the most recent acquisition
+	double lastStartLatencyMs;
+	// Per step of the most recent acquisition (one step without a queue)
+	struct
+	{
+		double setupMs; // From the end of the previous step to scan start
+		double seconds; // From scan start to the last frame
+		uint32_t framesAcquired;
+	} lastStepTimings[ACQUISITION_QUEUE_MAX_STEPS];
+	uint32_t lastStepCount;
 };
 
 
@@ -78,4 +244,22 @@ static inline struct OScNIFPGAPrivateData *GetData(OScDev_Device *device)
 }
 
 
-OScDev_Error MakeSettings(OScDev_Device *device, OScDev_PtrArray **settings);
\ No newline at end of file
+// Parameters of the acquisition being armed or scanned
+static inline const struct AcquisitionStep *GetScanStep(OScDev_Device *device)
+{
+	return &GetData(device)->acquisition.steps[GetData(device)->acquisition.step];
+}
+
+
+static inline double GetScanZoomFactor(OScDev_Device *device)
+{
+	double liveZoomFactor = GetData(device)->liveZoomFactor;
+	return liveZoomFactor > 0.0 ? liveZoomFactor : GetScanStep(device)->zoomFactor;
+}
+
+
+OScDev_Error MakeSettings(OScDev_Device *device, OScDev_PtrArray **settings);
+
+// Set up the FPGA for the acquisition taken by Arm, and end the arm; on the
+// thread calling Arm, or on the acquisition thread with asyncArm
+OScDev_Error PrepareArm(OScDev_Device *device);
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+// Public interface for applications using the NI FPGA device module
+
+#include "OScNIFPGAApi.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Layout of delivered frames
+//
+// With the FrameLayout setting at "Planar" (the default), each channel is
+// delivered by its own frame callback as width * height uint16 samples.
+// With "Interleaved", a single callback on channel 0 delivers one buffer of
+// width * height pixels of samplesPerPixel uint16 samples each: the
+// averaged channels in order, followed by the raw channels when
+// DeliverRawPlanes is on. The device then reports one channel of
+// 2 * samplesPerPixel bytes per sample.
+//
+// Both settings, like Channels, are read at arm: changing them during an
+// acquisition affects the next one, so that the frames delivered always
+// match the channel count and sample size reported when it was armed.
+
+typedef struct OScNIFPGA_FrameLayout
+{
+	bool interleaved;
+	uint32_t width;
+	uint32_t height;
+	uint32_t samplesPerPixel; // 1 when planar
+	uint32_t averagedChannelCount;
+	bool rawChannels; // Raw samples follow the averaged ones
+} OScNIFPGA_FrameLayout;
+
+
+// Get the layout of the frame being delivered. Valid only when called from
+// within the OpenScan frame callback, on the thread invoking it; returns
+// false elsewhere.
+OSCNIFPGA_API bool OScNIFPGA_GetFrameLayout(OScNIFPGA_FrameLayout *layout);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+// Public interface for applications using the NI FPGA device module
+
+#include "OScNIFPGAApi.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Per-channel statistics of a delivered frame
+//
+// Computed while the frame is unpacked (or filtered), so that display
+// ranges and saturation checks do not need another pass over the image.
+
+#define OSCNIFPGA_HISTOGRAM_BINS 256 // Bin of a value is value >> 8
+#define OSCNIFPGA_SATURATED_VALUE 0xFFFF
+
+typedef struct OScNIFPGA_FrameStats
+{
+	uint32_t pixelCount;
+	uint16_t min;
+	uint16_t max;
+	uint64_t sum;
+	double mean;
+	uint32_t saturatedCount; // Pixels equal to OSCNIFPGA_SATURATED_VALUE
+	uint32_t histogram[OSCNIFPGA_HISTOGRAM_BINS];
+} OScNIFPGA_FrameStats;
+
+
+// Get the statistics of the frame being delivered on the given channel
+// (numbered as in planar delivery, which is also the order of the samples
+// of an interleaved pixel; see OScNIFPGAFrameLayout.h).
+// Valid only when called from within the OpenScan frame callback, on the
+// thread invoking it; returns false elsewhere, or when the FrameStatistics
+// setting is off.
+OSCNIFPGA_API bool OScNIFPGA_GetFrameStats(uint32_t channel,
+	OScNIFPGA_FrameStats *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+// Public interface for applications using the NI FPGA device module
+
+#include "OScNIFPGAApi.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Downsampled previews of delivered frames
+//
+// When the PreviewLevels setting is nonzero, each averaged channel is also
+// reduced by 2x2 box filtering into levels 1 (1/2 size) up to 3 (1/8 size),
+// each level from the one above it. Previews are built while the frame is
+// unpacked and leave the full-resolution frame untouched. With the
+// PreviewFormat setting at "8-bit", levels are converted through a linear
+// lookup table from [PreviewDisplayMin, PreviewDisplayMax] to [0, 255].
+
+#define OSCNIFPGA_MAX_PREVIEW_LEVELS 3
+
+typedef struct OScNIFPGA_PreviewImage
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t bytesPerPixel; // 2 (uint16) or 1 (uint8)
+	const void *pixels; // Row-major, width * height
+} OScNIFPGA_PreviewImage;
+
+
+// Get a preview level (1 to OSCNIFPGA_MAX_PREVIEW_LEVELS) of the frame being
+// delivered on the given averaged channel. The pixels remain valid until the
+// frame callback returns. Valid only when called from within the OpenScan
+// frame callback, on the thread invoking it; returns false elsewhere, or
+// when the level was not built.
+OSCNIFPGA_API bool OScNIFPGA_GetPreview(uint32_t channel, uint32_t level,
+	OScNIFPGA_PreviewImage *image);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+// Public interface for applications using the NI FPGA device module
+
+#include "OScNIFPGAApi.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Acquisition queue
+//
+// When the AcquisitionQueue setting is not empty, a single arm and start
+// runs a sequence of acquisitions back to back, without returning to the
+// application in between. The setting lists the steps separated by ';',
+// each a comma-separated list of key=value pairs:
+//
+//   resolution=512,zoom=2,rate=250000,frames=10,average=4;frames=100
+//
+// resolution is 256, 512, 1024 or 2048; zoom is 0.5 to 40; rate is the
+// pixel rate in Hz, 100 to 500000; frames is the number of delivered
+// frames; average is the number of scanned frames averaged into each one,
+// within the range of AveragingFrameCount. Omitted keys take the value of
+// the armed acquisition (and of AveragingFrameCount for average). A step
+// without a frame count in a live acquisition runs until stopped, so only
+// the last step should be left without one.
+//
+// Frames are delivered through the acquisition's frame callback as usual.
+// A step may change the resolution, in which case OScNIFPGA_GetFrameLayout
+// gives the size of each delivered frame.
+
+
+// Get the index (from 0) of the queue step that the frame being delivered
+// belongs to; 0 when no queue is set. Valid only when called from within
+// the OpenScan frame callback, on the thread invoking it; returns false
+// elsewhere.
+OSCNIFPGA_API bool OScNIFPGA_GetQueueStep(uint32_t *step);
+
+
+#ifdef __cplusplus
+}
+#endif
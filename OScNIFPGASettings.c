@@ -1,4 +1,9 @@
 #include "OScNIFPGADevicePrivate.h"
+#include "OScNIFPGA.h"
+#include "FrameAverager.h"
+#include "OScNIFPGAPreview.h"
+#include "TemporalFilter.h"
+#include "WorkPool.h"
 
 #include "NiFpga_OpenScanFPGAHost.h"
 
@@ -32,10 +37,10 @@ static OScDev_Error GetLineDelay(OScDev_Setting *setting, int32_t *value)
 
 static OScDev_Error SetLineDelay(OScDev_Setting *setting, int32_t value)
 {
-	GetSettingDeviceData(setting)->lineDelay = value;
-
-	GetSettingDeviceData(setting)->settingsChanged = true;
-	GetSettingDeviceData(setting)->reloadWaveformRequired = true;
+	OScDev_Device *device = (OScDev_Device *)OScDev_Setting_GetImplData(setting);
+	BeginWaveformChange(device);
+	GetData(device)->lineDelay = value;
+	EndWaveformChange(device);
 
 	return OScDev_OK;
 }
@@ -75,9 +80,9 @@ static OScDev_Error GetOffset(OScDev_Setting *setting, double *value)
 static OScDev_Error SetOffset(OScDev_Setting *setting, double value)
 {
 	struct OffsetSettingData *data = (struct OffsetSettingData *)OScDev_Setting_GetImplData(setting);
+	BeginWaveformChange(data->device);
 	GetData(data->device)->offsetXY[data->axis] = value;
-	GetData(data->device)->settingsChanged = true;
-	GetData(data->device)->reloadWaveformRequired = true;
+	EndWaveformChange(data->device);
 	return OScDev_OK;
 }
 
@@ -109,6 +114,127 @@ static OScDev_SettingImpl SettingImpl_Offset = {
 };
 
 
+static OScDev_Error GetLiveZoomFactor(OScDev_Setting *setting, double *value)
+{
+	*value = GetSettingDeviceData(setting)->liveZoomFactor;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetLiveZoomFactor(OScDev_Setting *setting, double value)
+{
+	OScDev_Device *device = (OScDev_Device *)OScDev_Setting_GetImplData(setting);
+	BeginWaveformChange(device);
+	GetData(device)->liveZoomFactor = value;
+	EndWaveformChange(device);
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetLiveZoomFactorRange(OScDev_Setting *setting, double *min, double *max)
+{
+	*min = 0.0; // Use the zoom factor of the acquisition
+	*max = 40.0;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_LiveZoomFactor = {
+	.GetFloat64 = GetLiveZoomFactor,
+	.SetFloat64 = SetLiveZoomFactor,
+	.GetNumericConstraintType = GetNumericConstraintTypeImpl_Range,
+	.GetFloat64Range = GetLiveZoomFactorRange,
+};
+
+
+static OScDev_Error GetNextResolution(OScDev_Setting *setting, int32_t *value)
+{
+	*value = (int32_t)GetSettingDeviceData(setting)->nextResolution;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetNextResolution(OScDev_Setting *setting, int32_t value)
+{
+	if (value != 0 && value != 256 && value != 512 && value != 1024 && value != 2048)
+		return OScDev_Error_Illegal_Argument;
+	GetSettingDeviceData(setting)->nextResolution = (uint32_t)value;
+	StageNextAcquisition((OScDev_Device *)OScDev_Setting_GetImplData(setting));
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetNextResolutionRange(OScDev_Setting *setting, int32_t *min, int32_t *max)
+{
+	*min = 0; // Nothing staged
+	*max = 2048;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_NextResolution = {
+	.GetInt32 = GetNextResolution,
+	.SetInt32 = SetNextResolution,
+	.GetNumericConstraintType = GetNumericConstraintTypeImpl_Range,
+	.GetInt32Range = GetNextResolutionRange,
+};
+
+
+static OScDev_Error GetNextZoomFactor(OScDev_Setting *setting, double *value)
+{
+	*value = GetSettingDeviceData(setting)->nextZoomFactor;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetNextZoomFactor(OScDev_Setting *setting, double value)
+{
+	GetSettingDeviceData(setting)->nextZoomFactor = value;
+	StageNextAcquisition((OScDev_Device *)OScDev_Setting_GetImplData(setting));
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetNextZoomFactorRange(OScDev_Setting *setting, double *min, double *max)
+{
+	*min = 0.5;
+	*max = 40.0;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_NextZoomFactor = {
+	.GetFloat64 = GetNextZoomFactor,
+	.SetFloat64 = SetNextZoomFactor,
+	.GetNumericConstraintType = GetNumericConstraintTypeImpl_Range,
+	.GetFloat64Range = GetNextZoomFactorRange,
+};
+
+
+static OScDev_Error GetAcquisitionQueue(OScDev_Setting *setting, char *value)
+{
+	strncpy(value, GetSettingDeviceData(setting)->queueText, OScDev_MAX_STR_LEN);
+	return OScDev_OK;
+}
+
+
+// Takes effect at the next arm (see OScNIFPGAQueue.h)
+static OScDev_Error SetAcquisitionQueue(OScDev_Setting *setting, const char *value)
+{
+	OScDev_Error err;
+	if (OScDev_CHECK(err, AcquisitionQueue_Parse(&(GetSettingDeviceData(setting)->queue), value)))
+		return err;
+	strncpy(GetSettingDeviceData(setting)->queueText, value, OScDev_MAX_STR_LEN);
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_AcquisitionQueue = {
+	.GetString = GetAcquisitionQueue,
+	.SetString = SetAcquisitionQueue,
+};
+
+
 static OScDev_Error GetChannels(OScDev_Setting *setting, uint32_t *value)
 {
 	*value = GetSettingDeviceData(setting)->channels;
@@ -210,6 +336,7 @@ static OScDev_Error SetScannerEnabled(OScDev_Setting *setting, bool value)
 	GetSettingDeviceData(setting)->scannerEnabled = value;
 	GetSettingDeviceData(setting)->settingsChanged = true;
 	GetSettingDeviceData(setting)->reloadWaveformRequired = true;
+	CancelPendingArm((OScDev_Device *)OScDev_Setting_GetImplData(setting));
 	return OScDev_OK;
 }
 
@@ -231,6 +358,7 @@ static OScDev_Error SetDetectorEnabled(OScDev_Setting *setting, bool value)
 	GetSettingDeviceData(setting)->detectorEnabled = value;
 	GetSettingDeviceData(setting)->settingsChanged = true;
 	GetSettingDeviceData(setting)->reloadWaveformRequired = true;
+	CancelPendingArm((OScDev_Device *)OScDev_Setting_GetImplData(setting));
 	return OScDev_OK;
 }
 
@@ -250,7 +378,7 @@ static OScDev_Error GetFilterGain(OScDev_Setting *setting, double *value)
 
 static OScDev_Error SetFilterGain(OScDev_Setting *setting, double value)
 {
-	GetSettingDeviceData(setting)->filterGain = (uint16_t) value;
+	GetSettingDeviceData(setting)->filterGain = value;
 	return OScDev_OK;
 }
 
@@ -271,6 +399,71 @@ static OScDev_SettingImpl SettingImpl_FilterGain = {
 };
 
 
+static const char *const TemporalFilterNames[TEMPORAL_FILTER_NUM_MODES] = {
+	"None",
+	"Exponential",
+	"Kalman",
+	"Median 3",
+	"Median 5",
+};
+
+
+static OScDev_Error GetTemporalFilter(OScDev_Setting *setting, uint32_t *value)
+{
+	*value = GetSettingDeviceData(setting)->temporalFilter;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetTemporalFilter(OScDev_Setting *setting, uint32_t value)
+{
+	GetSettingDeviceData(setting)->temporalFilter = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetTemporalFilterNumValues(OScDev_Setting *setting, uint32_t *count)
+{
+	*count = TEMPORAL_FILTER_NUM_MODES;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetTemporalFilterNameForValue(OScDev_Setting *setting, uint32_t value, char *name)
+{
+	if (value >= TEMPORAL_FILTER_NUM_MODES)
+	{
+		strcpy(name, "");
+		return OScDev_Error_Unknown;
+	}
+	strcpy(name, TemporalFilterNames[value]);
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetTemporalFilterValueForName(OScDev_Setting *setting, uint32_t *value, const char *name)
+{
+	for (uint32_t i = 0; i < TEMPORAL_FILTER_NUM_MODES; ++i)
+	{
+		if (!strcmp(name, TemporalFilterNames[i]))
+		{
+			*value = i;
+			return OScDev_OK;
+		}
+	}
+	return OScDev_Error_Unknown;
+}
+
+
+static OScDev_SettingImpl SettingImpl_TemporalFilter = {
+	.GetEnum = GetTemporalFilter,
+	.SetEnum = SetTemporalFilter,
+	.GetEnumNumValues = GetTemporalFilterNumValues,
+	.GetEnumNameForValue = GetTemporalFilterNameForValue,
+	.GetEnumValueForName = GetTemporalFilterValueForName,
+};
+
+
 static OScDev_Error GetAveragingFrameCount(OScDev_Setting *setting, int32_t *value)
 {
 	*value = GetSettingDeviceData(setting)->framesToAverage;
@@ -282,6 +475,7 @@ static OScDev_Error SetAveragingFrameCount(OScDev_Setting *setting, int32_t valu
 {
 	GetSettingDeviceData(setting)->framesToAverage = value;
 	GetSettingDeviceData(setting)->settingsChanged = true;
+	CancelPendingArm((OScDev_Device *)OScDev_Setting_GetImplData(setting));
 	return OScDev_OK;
 }
 
@@ -289,7 +483,8 @@ static OScDev_Error SetAveragingFrameCount(OScDev_Setting *setting, int32_t valu
 static OScDev_Error GetAveragingFrameCountRange(OScDev_Setting *setting, int32_t *min, int32_t *max)
 {
 	*min = 1;
-	*max = 100;
+	*max = GetSettingDeviceData(setting)->hostAveraging ?
+		FRAME_AVERAGER_MAX_FRAMES : FIRMWARE_MAX_FRAMES_TO_AVERAGE;
 	return OScDev_OK;
 }
 
@@ -302,65 +497,829 @@ static OScDev_SettingImpl SettingImpl_AveragingFrameCount = {
 };
 
 
-OScDev_Error MakeSettings(OScDev_Device *device, OScDev_PtrArray **settings)
+static OScDev_Error GetHostAveraging(OScDev_Setting *setting, bool *value)
 {
-	OScDev_Error err;
-	*settings = OScDev_PtrArray_Create();
+	*value = GetSettingDeviceData(setting)->hostAveraging;
+	return OScDev_OK;
+}
 
-	OScDev_Setting *lineDelay;
-	if (OScDev_CHECK(err, OScDev_Setting_Create(&lineDelay, "Line Delay (pixels)", OScDev_ValueType_Int32,
-		&SettingImpl_LineDelay, device)))
-		goto error;
-	OScDev_PtrArray_Append(*settings, lineDelay);
 
-	for (int i = 0; i < 2; ++i)
+static OScDev_Error SetHostAveraging(OScDev_Setting *setting, bool value)
+{
+	GetSettingDeviceData(setting)->hostAveraging = value;
+	// The firmware cannot average as many frames as the host
+	if (!value && GetSettingDeviceData(setting)->framesToAverage > FIRMWARE_MAX_FRAMES_TO_AVERAGE)
+		GetSettingDeviceData(setting)->framesToAverage = FIRMWARE_MAX_FRAMES_TO_AVERAGE;
+	GetSettingDeviceData(setting)->settingsChanged = true;
+	CancelPendingArm((OScDev_Device *)OScDev_Setting_GetImplData(setting));
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_HostAveraging = {
+	.GetBool = GetHostAveraging,
+	.SetBool = SetHostAveraging,
+};
+
+
+static OScDev_Error GetRawPlanes(OScDev_Setting *setting, bool *value)
+{
+	*value = GetSettingDeviceData(setting)->deliverRawPlanes;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetRawPlanes(OScDev_Setting *setting, bool value)
+{
+	GetSettingDeviceData(setting)->deliverRawPlanes = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_RawPlanes = {
+	.GetBool = GetRawPlanes,
+	.SetBool = SetRawPlanes,
+};
+
+
+static OScDev_Error GetFrameLayout(OScDev_Setting *setting, uint32_t *value)
+{
+	*value = GetSettingDeviceData(setting)->interleavedFrames ? 1 : 0;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetFrameLayout(OScDev_Setting *setting, uint32_t value)
+{
+	GetSettingDeviceData(setting)->interleavedFrames = value == 1;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetFrameLayoutNumValues(OScDev_Setting *setting, uint32_t *count)
+{
+	*count = 2;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetFrameLayoutNameForValue(OScDev_Setting *setting, uint32_t value, char *name)
+{
+	switch (value)
 	{
-		OScDev_Setting *offset;
-		struct OffsetSettingData *data = malloc(sizeof(struct OffsetSettingData));
-		data->device = device;
-		data->axis = i;
-		const char *name = i == 0 ? "GalvoOffsetX" : "GalvoOffsetY";
-		if (OScDev_CHECK(err, OScDev_Setting_Create(&offset, name,
-			OScDev_ValueType_Float64, &SettingImpl_Offset, data)))
-			goto error;
-		OScDev_PtrArray_Append(*settings, offset);
+	case 0:
+		strcpy(name, "Planar");
+		break;
+	case 1:
+		strcpy(name, "Interleaved");
+		break;
+	default:
+		strcpy(name, "");
+		return OScDev_Error_Unknown;
 	}
+	return OScDev_OK;
+}
 
-	OScDev_Setting *channels;
-	if (OScDev_CHECK(err, OScDev_Setting_Create(&channels, "Channels",
-		OScDev_ValueType_Enum, &SettingImpl_Channels, device)))
-		goto error;
-	OScDev_PtrArray_Append(*settings, channels);
 
-	OScDev_Setting *useProgressiveAveraging;
-	if (OScDev_CHECK(err, OScDev_Setting_Create(&useProgressiveAveraging,
-		"AveragingProgressive", OScDev_ValueType_Bool, &SettingImpl_AveragingProgressive, device)))
-		goto error;
-	OScDev_PtrArray_Append(*settings, useProgressiveAveraging);
+static OScDev_Error GetFrameLayoutValueForName(OScDev_Setting *setting, uint32_t *value, const char *name)
+{
+	if (!strcmp(name, "Planar"))
+		*value = 0;
+	else if (!strcmp(name, "Interleaved"))
+		*value = 1;
+	else
+		return OScDev_Error_Unknown;
+	return OScDev_OK;
+}
 
-	OScDev_Setting *scannerEnabled;
-	if (OScDev_CHECK(err, OScDev_Setting_Create(&scannerEnabled,
-		"EnableScanner", OScDev_ValueType_Bool, &SettingImpl_ScannerEnabled, device)))
-		goto error;
-	OScDev_PtrArray_Append(*settings, scannerEnabled);
 
-	OScDev_Setting *detectorEnabled;
-	if (OScDev_CHECK(err, OScDev_Setting_Create(&detectorEnabled,
-		"EnableDetector", OScDev_ValueType_Bool, &SettingImpl_DetectorEnabled, device)))
-		goto error;
-	OScDev_PtrArray_Append(*settings, detectorEnabled);
+static OScDev_SettingImpl SettingImpl_FrameLayout = {
+	.GetEnum = GetFrameLayout,
+	.SetEnum = SetFrameLayout,
+	.GetEnumNumValues = GetFrameLayoutNumValues,
+	.GetEnumNameForValue = GetFrameLayoutNameForValue,
+	.GetEnumValueForName = GetFrameLayoutValueForName,
+};
 
-	OScDev_Setting *filterGain;
-	if (OScDev_CHECK(err, OScDev_Setting_Create(&filterGain,
-		"AveragingFilterGain", OScDev_ValueType_Float64, &SettingImpl_FilterGain, device)))
-		goto error;
-	OScDev_PtrArray_Append(*settings, filterGain);
 
-	OScDev_Setting *framesToAverage;
-	if (OScDev_CHECK(err, OScDev_Setting_Create(&framesToAverage,
-		"AveragingFrameCount", OScDev_ValueType_Int32, &SettingImpl_AveragingFrameCount, device)))
-		goto error;
-	OScDev_PtrArray_Append(*settings, framesToAverage);
+static OScDev_Error GetFrameStatistics(OScDev_Setting *setting, bool *value)
+{
+	*value = GetSettingDeviceData(setting)->frameStatistics;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetFrameStatistics(OScDev_Setting *setting, bool value)
+{
+	GetSettingDeviceData(setting)->frameStatistics = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_FrameStatistics = {
+	.GetBool = GetFrameStatistics,
+	.SetBool = SetFrameStatistics,
+};
+
+
+static OScDev_Error GetCorrectionDirectory(OScDev_Setting *setting, char *value)
+{
+	strncpy(value, GetSettingDeviceData(setting)->correctionDirectory, OScDev_MAX_STR_LEN);
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetCorrectionDirectory(OScDev_Setting *setting, const char *value)
+{
+	strncpy(GetSettingDeviceData(setting)->correctionDirectory, value, OScDev_MAX_STR_LEN);
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_CorrectionDirectory = {
+	.GetString = GetCorrectionDirectory,
+	.SetString = SetCorrectionDirectory,
+};
+
+
+static OScDev_Error GetPreviewLevels(OScDev_Setting *setting, int32_t *value)
+{
+	*value = GetSettingDeviceData(setting)->previewLevels;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetPreviewLevels(OScDev_Setting *setting, int32_t value)
+{
+	GetSettingDeviceData(setting)->previewLevels = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetPreviewLevelsRange(OScDev_Setting *setting, int32_t *min, int32_t *max)
+{
+	*min = 0;
+	*max = OSCNIFPGA_MAX_PREVIEW_LEVELS;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_PreviewLevels = {
+	.GetInt32 = GetPreviewLevels,
+	.SetInt32 = SetPreviewLevels,
+	.GetNumericConstraintType = GetNumericConstraintTypeImpl_Range,
+	.GetInt32Range = GetPreviewLevelsRange,
+};
+
+
+static OScDev_Error GetPreviewFormat(OScDev_Setting *setting, uint32_t *value)
+{
+	*value = GetSettingDeviceData(setting)->preview8Bit ? 1 : 0;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetPreviewFormat(OScDev_Setting *setting, uint32_t value)
+{
+	GetSettingDeviceData(setting)->preview8Bit = value == 1;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetPreviewFormatNumValues(OScDev_Setting *setting, uint32_t *count)
+{
+	*count = 2;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetPreviewFormatNameForValue(OScDev_Setting *setting, uint32_t value, char *name)
+{
+	switch (value)
+	{
+	case 0:
+		strcpy(name, "16-bit");
+		break;
+	case 1:
+		strcpy(name, "8-bit");
+		break;
+	default:
+		strcpy(name, "");
+		return OScDev_Error_Unknown;
+	}
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetPreviewFormatValueForName(OScDev_Setting *setting, uint32_t *value, const char *name)
+{
+	if (!strcmp(name, "16-bit"))
+		*value = 0;
+	else if (!strcmp(name, "8-bit"))
+		*value = 1;
+	else
+		return OScDev_Error_Unknown;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_PreviewFormat = {
+	.GetEnum = GetPreviewFormat,
+	.SetEnum = SetPreviewFormat,
+	.GetEnumNumValues = GetPreviewFormatNumValues,
+	.GetEnumNameForValue = GetPreviewFormatNameForValue,
+	.GetEnumValueForName = GetPreviewFormatValueForName,
+};
+
+
+static OScDev_Error GetPreviewDisplayMin(OScDev_Setting *setting, int32_t *value)
+{
+	*value = GetSettingDeviceData(setting)->previewDisplayMin;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetPreviewDisplayMin(OScDev_Setting *setting, int32_t value)
+{
+	GetSettingDeviceData(setting)->previewDisplayMin = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetPreviewDisplayMax(OScDev_Setting *setting, int32_t *value)
+{
+	*value = GetSettingDeviceData(setting)->previewDisplayMax;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetPreviewDisplayMax(OScDev_Setting *setting, int32_t value)
+{
+	GetSettingDeviceData(setting)->previewDisplayMax = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetPreviewDisplayRange(OScDev_Setting *setting, int32_t *min, int32_t *max)
+{
+	*min = 0;
+	*max = UINT16_MAX;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_PreviewDisplayMin = {
+	.GetInt32 = GetPreviewDisplayMin,
+	.SetInt32 = SetPreviewDisplayMin,
+	.GetNumericConstraintType = GetNumericConstraintTypeImpl_Range,
+	.GetInt32Range = GetPreviewDisplayRange,
+};
+
+
+static OScDev_SettingImpl SettingImpl_PreviewDisplayMax = {
+	.GetInt32 = GetPreviewDisplayMax,
+	.SetInt32 = SetPreviewDisplayMax,
+	.GetNumericConstraintType = GetNumericConstraintTypeImpl_Range,
+	.GetInt32Range = GetPreviewDisplayRange,
+};
+
+
+static OScDev_Error GetKeepArmed(OScDev_Setting *setting, bool *value)
+{
+	*value = GetSettingDeviceData(setting)->keepArmed;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetKeepArmed(OScDev_Setting *setting, bool value)
+{
+	GetSettingDeviceData(setting)->keepArmed = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_KeepArmed = {
+	.GetBool = GetKeepArmed,
+	.SetBool = SetKeepArmed,
+};
+
+
+static OScDev_Error GetAsyncArm(OScDev_Setting *setting, bool *value)
+{
+	*value = GetSettingDeviceData(setting)->asyncArm;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetAsyncArm(OScDev_Setting *setting, bool value)
+{
+	GetSettingDeviceData(setting)->asyncArm = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_AsyncArm = {
+	.GetBool = GetAsyncArm,
+	.SetBool = SetAsyncArm,
+};
+
+
+static OScDev_Error GetResetOnClose(OScDev_Setting *setting, bool *value)
+{
+	*value = GetSettingDeviceData(setting)->resetOnClose;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetResetOnClose(OScDev_Setting *setting, bool value)
+{
+	GetSettingDeviceData(setting)->resetOnClose = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_ResetOnClose = {
+	.GetBool = GetResetOnClose,
+	.SetBool = SetResetOnClose,
+};
+
+
+static OScDev_Error GetParallelFifoReaders(OScDev_Setting *setting, bool *value)
+{
+	*value = GetSettingDeviceData(setting)->parallelFifoReaders;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetParallelFifoReaders(OScDev_Setting *setting, bool value)
+{
+	GetSettingDeviceData(setting)->parallelFifoReaders = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_ParallelFifoReaders = {
+	.GetBool = GetParallelFifoReaders,
+	.SetBool = SetParallelFifoReaders,
+};
+
+
+static OScDev_Error GetProcessingThreads(OScDev_Setting *setting, int32_t *value)
+{
+	*value = GetSettingDeviceData(setting)->processingThreads;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetProcessingThreads(OScDev_Setting *setting, int32_t value)
+{
+	GetSettingDeviceData(setting)->processingThreads = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetProcessingThreadsRange(OScDev_Setting *setting, int32_t *min, int32_t *max)
+{
+	*min = 0; // One per processor
+	*max = WORK_POOL_MAX_WORKERS;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_ProcessingThreads = {
+	.GetInt32 = GetProcessingThreads,
+	.SetInt32 = SetProcessingThreads,
+	.GetNumericConstraintType = GetNumericConstraintTypeImpl_Range,
+	.GetInt32Range = GetProcessingThreadsRange,
+};
+
+
+static const char *const AcquisitionThreadPriorityNames[ACQUISITION_PRIORITY_NUM_VALUES] = {
+	"Normal",
+	"Above Normal",
+	"Highest",
+	"Time Critical",
+};
+
+
+static OScDev_Error GetAcquisitionThreadPriority(OScDev_Setting *setting, uint32_t *value)
+{
+	*value = GetSettingDeviceData(setting)->acquisitionThreadPriority;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetAcquisitionThreadPriority(OScDev_Setting *setting, uint32_t value)
+{
+	GetSettingDeviceData(setting)->acquisitionThreadPriority = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetAcquisitionThreadPriorityNumValues(OScDev_Setting *setting, uint32_t *count)
+{
+	*count = ACQUISITION_PRIORITY_NUM_VALUES;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetAcquisitionThreadPriorityNameForValue(OScDev_Setting *setting, uint32_t value, char *name)
+{
+	if (value >= ACQUISITION_PRIORITY_NUM_VALUES)
+	{
+		strcpy(name, "");
+		return OScDev_Error_Unknown;
+	}
+	strcpy(name, AcquisitionThreadPriorityNames[value]);
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetAcquisitionThreadPriorityValueForName(OScDev_Setting *setting, uint32_t *value, const char *name)
+{
+	for (uint32_t i = 0; i < ACQUISITION_PRIORITY_NUM_VALUES; ++i)
+	{
+		if (!strcmp(name, AcquisitionThreadPriorityNames[i]))
+		{
+			*value = i;
+			return OScDev_OK;
+		}
+	}
+	return OScDev_Error_Unknown;
+}
+
+
+static OScDev_SettingImpl SettingImpl_AcquisitionThreadPriority = {
+	.GetEnum = GetAcquisitionThreadPriority,
+	.SetEnum = SetAcquisitionThreadPriority,
+	.GetEnumNumValues = GetAcquisitionThreadPriorityNumValues,
+	.GetEnumNameForValue = GetAcquisitionThreadPriorityNameForValue,
+	.GetEnumValueForName = GetAcquisitionThreadPriorityValueForName,
+};
+
+
+static OScDev_Error GetAcquisitionThreadAffinity(OScDev_Setting *setting, int32_t *value)
+{
+	*value = GetSettingDeviceData(setting)->acquisitionThreadAffinity;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetAcquisitionThreadAffinity(OScDev_Setting *setting, int32_t value)
+{
+	GetSettingDeviceData(setting)->acquisitionThreadAffinity = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetAcquisitionThreadAffinityRange(OScDev_Setting *setting, int32_t *min, int32_t *max)
+{
+	*min = 0; // Any processor
+	*max = INT32_MAX; // Mask of processors 0 to 30
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_AcquisitionThreadAffinity = {
+	.GetInt32 = GetAcquisitionThreadAffinity,
+	.SetInt32 = SetAcquisitionThreadAffinity,
+	.GetNumericConstraintType = GetNumericConstraintTypeImpl_Range,
+	.GetInt32Range = GetAcquisitionThreadAffinityRange,
+};
+
+
+static OScDev_Error GetDebugTracing(OScDev_Setting *setting, bool *value)
+{
+	*value = GetSettingDeviceData(setting)->debugTracing;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetDebugTracing(OScDev_Setting *setting, bool value)
+{
+	GetSettingDeviceData(setting)->debugTracing = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_DebugTracing = {
+	.GetBool = GetDebugTracing,
+	.SetBool = SetDebugTracing,
+};
+
+
+static OScDev_Error GetRawCaptureEnabled(OScDev_Setting *setting, bool *value)
+{
+	*value = GetSettingDeviceData(setting)->rawCaptureEnabled;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetRawCaptureEnabled(OScDev_Setting *setting, bool value)
+{
+	GetSettingDeviceData(setting)->rawCaptureEnabled = value;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_RawCaptureEnabled = {
+	.GetBool = GetRawCaptureEnabled,
+	.SetBool = SetRawCaptureEnabled,
+};
+
+
+static OScDev_Error GetRawCaptureDirectory(OScDev_Setting *setting, char *value)
+{
+	strncpy(value, GetSettingDeviceData(setting)->rawCaptureDirectory, OScDev_MAX_STR_LEN);
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetRawCaptureDirectory(OScDev_Setting *setting, const char *value)
+{
+	strncpy(GetSettingDeviceData(setting)->rawCaptureDirectory, value, OScDev_MAX_STR_LEN);
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_RawCaptureDirectory = {
+	.GetString = GetRawCaptureDirectory,
+	.SetString = SetRawCaptureDirectory,
+};
+
+
+static OScDev_Error GetReplayTiming(OScDev_Setting *setting, uint32_t *value)
+{
+	*value = GetSettingDeviceData(setting)->replayOriginalTiming ? 0 : 1;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error SetReplayTiming(OScDev_Setting *setting, uint32_t value)
+{
+	GetSettingDeviceData(setting)->replayOriginalTiming = value == 0;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetReplayTimingNumValues(OScDev_Setting *setting, uint32_t *count)
+{
+	*count = 2;
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetReplayTimingNameForValue(OScDev_Setting *setting, uint32_t value, char *name)
+{
+	switch (value)
+	{
+	case 0:
+		strcpy(name, "Original");
+		break;
+	case 1:
+		strcpy(name, "As fast as possible");
+		break;
+	default:
+		strcpy(name, "");
+		return OScDev_Error_Unknown;
+	}
+	return OScDev_OK;
+}
+
+
+static OScDev_Error GetReplayTimingValueForName(OScDev_Setting *setting, uint32_t *value, const char *name)
+{
+	if (!strcmp(name, "Original"))
+		*value = 0;
+	else if (!strcmp(name, "As fast as possible"))
+		*value = 1;
+	else
+		return OScDev_Error_Unknown;
+	return OScDev_OK;
+}
+
+
+static OScDev_SettingImpl SettingImpl_ReplayTiming = {
+	.GetEnum = GetReplayTiming,
+	.SetEnum = SetReplayTiming,
+	.GetEnumNumValues = GetReplayTimingNumValues,
+	.GetEnumNameForValue = GetReplayTimingNameForValue,
+	.GetEnumValueForName = GetReplayTimingValueForName,
+};
+
+
+OScDev_Error MakeSettings(OScDev_Device *device, OScDev_PtrArray **settings)
+{
+	OScDev_Error err;
+	*settings = OScDev_PtrArray_Create();
+
+	OScDev_Setting *lineDelay;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&lineDelay, "Line Delay (pixels)", OScDev_ValueType_Int32,
+		&SettingImpl_LineDelay, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, lineDelay);
+
+	for (int i = 0; i < 2; ++i)
+	{
+		OScDev_Setting *offset;
+		struct OffsetSettingData *data = malloc(sizeof(struct OffsetSettingData));
+		data->device = device;
+		data->axis = i;
+		const char *name = i == 0 ? "GalvoOffsetX" : "GalvoOffsetY";
+		if (OScDev_CHECK(err, OScDev_Setting_Create(&offset, name,
+			OScDev_ValueType_Float64, &SettingImpl_Offset, data)))
+			goto error;
+		OScDev_PtrArray_Append(*settings, offset);
+	}
+
+	OScDev_Setting *liveZoomFactor;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&liveZoomFactor, "LiveZoomFactor",
+		OScDev_ValueType_Float64, &SettingImpl_LiveZoomFactor, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, liveZoomFactor);
+
+	OScDev_Setting *nextResolution;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&nextResolution, "NextResolution",
+		OScDev_ValueType_Int32, &SettingImpl_NextResolution, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, nextResolution);
+
+	OScDev_Setting *nextZoomFactor;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&nextZoomFactor, "NextZoomFactor",
+		OScDev_ValueType_Float64, &SettingImpl_NextZoomFactor, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, nextZoomFactor);
+
+	OScDev_Setting *acquisitionQueue;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&acquisitionQueue, "AcquisitionQueue",
+		OScDev_ValueType_String, &SettingImpl_AcquisitionQueue, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, acquisitionQueue);
+
+	OScDev_Setting *channels;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&channels, "Channels",
+		OScDev_ValueType_Enum, &SettingImpl_Channels, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, channels);
+
+	OScDev_Setting *useProgressiveAveraging;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&useProgressiveAveraging,
+		"AveragingProgressive", OScDev_ValueType_Bool, &SettingImpl_AveragingProgressive, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, useProgressiveAveraging);
+
+	OScDev_Setting *scannerEnabled;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&scannerEnabled,
+		"EnableScanner", OScDev_ValueType_Bool, &SettingImpl_ScannerEnabled, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, scannerEnabled);
+
+	OScDev_Setting *detectorEnabled;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&detectorEnabled,
+		"EnableDetector", OScDev_ValueType_Bool, &SettingImpl_DetectorEnabled, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, detectorEnabled);
+
+	OScDev_Setting *filterGain;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&filterGain,
+		"AveragingFilterGain", OScDev_ValueType_Float64, &SettingImpl_FilterGain, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, filterGain);
+
+	OScDev_Setting *temporalFilter;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&temporalFilter,
+		"TemporalFilter", OScDev_ValueType_Enum, &SettingImpl_TemporalFilter, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, temporalFilter);
+
+	OScDev_Setting *framesToAverage;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&framesToAverage,
+		"AveragingFrameCount", OScDev_ValueType_Int32, &SettingImpl_AveragingFrameCount, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, framesToAverage);
+
+	OScDev_Setting *hostAveraging;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&hostAveraging,
+		"HostAveraging", OScDev_ValueType_Bool, &SettingImpl_HostAveraging, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, hostAveraging);
+
+	OScDev_Setting *rawPlanes;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&rawPlanes,
+		"DeliverRawPlanes", OScDev_ValueType_Bool, &SettingImpl_RawPlanes, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, rawPlanes);
+
+	OScDev_Setting *frameLayout;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&frameLayout,
+		"FrameLayout", OScDev_ValueType_Enum, &SettingImpl_FrameLayout, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, frameLayout);
+
+	OScDev_Setting *frameStatistics;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&frameStatistics,
+		"FrameStatistics", OScDev_ValueType_Bool, &SettingImpl_FrameStatistics, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, frameStatistics);
+
+	OScDev_Setting *correctionDirectory;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&correctionDirectory,
+		"CorrectionMapDirectory", OScDev_ValueType_String, &SettingImpl_CorrectionDirectory, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, correctionDirectory);
+
+	OScDev_Setting *previewLevels;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&previewLevels,
+		"PreviewLevels", OScDev_ValueType_Int32, &SettingImpl_PreviewLevels, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, previewLevels);
+
+	OScDev_Setting *previewFormat;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&previewFormat,
+		"PreviewFormat", OScDev_ValueType_Enum, &SettingImpl_PreviewFormat, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, previewFormat);
+
+	OScDev_Setting *previewDisplayMin;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&previewDisplayMin,
+		"PreviewDisplayMin", OScDev_ValueType_Int32, &SettingImpl_PreviewDisplayMin, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, previewDisplayMin);
+
+	OScDev_Setting *previewDisplayMax;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&previewDisplayMax,
+		"PreviewDisplayMax", OScDev_ValueType_Int32, &SettingImpl_PreviewDisplayMax, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, previewDisplayMax);
+
+	OScDev_Setting *keepArmed;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&keepArmed,
+		"KeepArmed", OScDev_ValueType_Bool, &SettingImpl_KeepArmed, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, keepArmed);
+
+	OScDev_Setting *asyncArm;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&asyncArm,
+		"AsyncArm", OScDev_ValueType_Bool, &SettingImpl_AsyncArm, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, asyncArm);
+
+	OScDev_Setting *resetOnClose;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&resetOnClose,
+		"ResetOnClose", OScDev_ValueType_Bool, &SettingImpl_ResetOnClose, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, resetOnClose);
+
+	OScDev_Setting *parallelFifoReaders;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&parallelFifoReaders,
+		"ParallelFifoReaders", OScDev_ValueType_Bool, &SettingImpl_ParallelFifoReaders, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, parallelFifoReaders);
+
+	OScDev_Setting *processingThreads;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&processingThreads,
+		"ProcessingThreads", OScDev_ValueType_Int32, &SettingImpl_ProcessingThreads, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, processingThreads);
+
+	OScDev_Setting *acquisitionThreadPriority;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&acquisitionThreadPriority,
+		"AcquisitionThreadPriority", OScDev_ValueType_Enum, &SettingImpl_AcquisitionThreadPriority, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, acquisitionThreadPriority);
+
+	OScDev_Setting *acquisitionThreadAffinity;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&acquisitionThreadAffinity,
+		"AcquisitionThreadAffinity", OScDev_ValueType_Int32, &SettingImpl_AcquisitionThreadAffinity, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, acquisitionThreadAffinity);
+
+	OScDev_Setting *debugTracing;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&debugTracing,
+		"DebugTracing", OScDev_ValueType_Bool, &SettingImpl_DebugTracing, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, debugTracing);
+
+	OScDev_Setting *rawCaptureEnabled;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&rawCaptureEnabled,
+		"RawCaptureEnabled", OScDev_ValueType_Bool, &SettingImpl_RawCaptureEnabled, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, rawCaptureEnabled);
+
+	OScDev_Setting *rawCaptureDirectory;
+	if (OScDev_CHECK(err, OScDev_Setting_Create(&rawCaptureDirectory,
+		"RawCaptureDirectory", OScDev_ValueType_String, &SettingImpl_RawCaptureDirectory, device)))
+		goto error;
+	OScDev_PtrArray_Append(*settings, rawCaptureDirectory);
+
+	if (GetData(device)->replayPath[0] != '\0')
+	{
+		OScDev_Setting *replayTiming;
+		if (OScDev_CHECK(err, OScDev_Setting_Create(&replayTiming,
+			"ReplayTiming", OScDev_ValueType_Enum, &SettingImpl_ReplayTiming, device)))
+			goto error;
+		OScDev_PtrArray_Append(*settings, replayTiming);
+	}
 
 	return OScDev_OK;
 
@@ -0,0 +1,199 @@
+#include "Preview.h"
+
+#include <malloc.h>
+#include <stdlib.h>
+
+#include <emmintrin.h>
+
+
+#define MAX_CHANNELS 4
+
+
+struct Preview
+{
+	uint32_t channelCount;
+	uint32_t resolution;
+	uint32_t levels;
+	bool eightBit;
+
+	// Indexed [channel][level - 1]; 16-bit levels are always kept, as
+	// each level is built from the one above
+	uint16_t *images[MAX_CHANNELS][OSCNIFPGA_MAX_PREVIEW_LEVELS];
+	uint8_t *images8[MAX_CHANNELS][OSCNIFPGA_MAX_PREVIEW_LEVELS];
+	uint8_t *lut; // 65536 entries when eightBit
+};
+
+
+// The preview whose frame callbacks are in progress on this thread
+static __declspec(thread) const struct Preview *currentPreview;
+
+
+OScDev_Error Preview_Create(struct Preview **preview,
+	uint32_t channelCount, uint32_t resolution, uint32_t levels,
+	bool eightBit, uint16_t displayMin, uint16_t displayMax)
+{
+	*preview = NULL;
+	if (channelCount == 0 || channelCount > MAX_CHANNELS ||
+		levels == 0 || levels > OSCNIFPGA_MAX_PREVIEW_LEVELS ||
+		resolution % PREVIEW_BAND_ALIGNMENT != 0)
+		return OScDev_Error_Illegal_Argument;
+
+	struct Preview *p = calloc(1, sizeof(struct Preview));
+	if (p == NULL)
+		return OScDev_Error_Out_Of_Memory;
+	p->channelCount = channelCount;
+	p->resolution = resolution;
+	p->levels = levels;
+	p->eightBit = eightBit;
+
+	for (uint32_t ch = 0; ch < channelCount; ++ch)
+	{
+		for (uint32_t level = 1; level <= levels; ++level)
+		{
+			size_t side = resolution >> level;
+			p->images[ch][level - 1] = _aligned_malloc(sizeof(uint16_t) * side * side, 16);
+			if (p->images[ch][level - 1] == NULL)
+				goto error;
+			if (eightBit)
+			{
+				p->images8[ch][level - 1] = _aligned_malloc(side * side, 16);
+				if (p->images8[ch][level - 1] == NULL)
+					goto error;
+			}
+		}
+	}
+
+	if (eightBit)
+	{
+		p->lut = malloc(65536);
+		if (p->lut == NULL)
+			goto error;
+		double range = displayMax > displayMin ? (double)displayMax - displayMin : 1.0;
+		for (uint32_t v = 0; v < 65536; ++v)
+		{
+			double scaled = v <= displayMin ? 0.0 : (v - displayMin) * 255.0 / range;
+			p->lut[v] = (uint8_t)(scaled >= 255.0 ? 255 : scaled + 0.5);
+		}
+	}
+
+	*preview = p;
+	return OScDev_OK;
+
+error:
+	Preview_Destroy(p);
+	return OScDev_Error_Out_Of_Memory;
+}
+
+
+void Preview_Destroy(struct Preview *preview)
+{
+	if (preview == NULL)
+		return;
+	for (uint32_t ch = 0; ch < preview->channelCount; ++ch)
+	{
+		for (uint32_t level = 0; level < preview->levels; ++level)
+		{
+			_aligned_free(preview->images[ch][level]);
+			_aligned_free(preview->images8[ch][level]);
+		}
+	}
+	free(preview->lut);
+	free(preview);
+}
+
+
+// Mean of each 2x2 block of rows a and b (inWidth wide, even), rounded
+static void DownsampleRowPair(const uint16_t *a, const uint16_t *b,
+	uint32_t inWidth, uint16_t *out)
+{
+	const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+	const __m128i two = _mm_set1_epi32(2);
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+	uint32_t outWidth = inWidth / 2;
+	uint32_t x = 0;
+	for (; x + 8 <= outWidth; x += 8)
+	{
+		// Each 32-bit lane holds a horizontal pair of pixels
+		__m128i a0 = _mm_loadu_si128((const __m128i *)(a + 2 * x));
+		__m128i a1 = _mm_loadu_si128((const __m128i *)(a + 2 * x + 8));
+		__m128i b0 = _mm_loadu_si128((const __m128i *)(b + 2 * x));
+		__m128i b1 = _mm_loadu_si128((const __m128i *)(b + 2 * x + 8));
+		__m128i s0 = _mm_add_epi32(
+			_mm_add_epi32(_mm_and_si128(a0, lowMask), _mm_srli_epi32(a0, 16)),
+			_mm_add_epi32(_mm_and_si128(b0, lowMask), _mm_srli_epi32(b0, 16)));
+		__m128i s1 = _mm_add_epi32(
+			_mm_add_epi32(_mm_and_si128(a1, lowMask), _mm_srli_epi32(a1, 16)),
+			_mm_add_epi32(_mm_and_si128(b1, lowMask), _mm_srli_epi32(b1, 16)));
+		s0 = _mm_srli_epi32(_mm_add_epi32(s0, two), 2);
+		s1 = _mm_srli_epi32(_mm_add_epi32(s1, two), 2);
+		_mm_storeu_si128((__m128i *)(out + x), _mm_xor_si128(
+			_mm_packs_epi32(_mm_sub_epi32(s0, bias32), _mm_sub_epi32(s1, bias32)), bias16));
+	}
+	for (; x < outWidth; ++x)
+	{
+		uint32_t sum = (uint32_t)a[2 * x] + a[2 * x + 1] + b[2 * x] + b[2 * x + 1];
+		out[x] = (uint16_t)((sum + 2) >> 2);
+	}
+}
+
+
+void Preview_AddRows(struct Preview *preview, uint32_t channel,
+	const uint16_t *frame, uint32_t firstRow, uint32_t rowCount)
+{
+	if (channel >= preview->channelCount)
+		return;
+
+	const uint16_t *in = frame;
+	uint32_t inWidth = preview->resolution;
+	uint32_t inFirst = firstRow;
+	uint32_t inEnd = firstRow + rowCount;
+	for (uint32_t level = 1; level <= preview->levels; ++level)
+	{
+		uint16_t *out = preview->images[channel][level - 1];
+		uint32_t outWidth = inWidth / 2;
+		uint32_t outFirst = inFirst / 2;
+		uint32_t outEnd = inEnd / 2;
+		for (uint32_t y = outFirst; y < outEnd; ++y)
+		{
+			DownsampleRowPair(in + (size_t)(2 * y) * inWidth,
+				in + (size_t)(2 * y + 1) * inWidth, inWidth,
+				out + (size_t)y * outWidth);
+		}
+
+		if (preview->eightBit)
+		{
+			uint8_t *out8 = preview->images8[channel][level - 1];
+			const uint8_t *lut = preview->lut;
+			size_t end = (size_t)outEnd * outWidth;
+			for (size_t i = (size_t)outFirst * outWidth; i < end; ++i)
+				out8[i] = lut[out[i]];
+		}
+
+		in = out;
+		inWidth = outWidth;
+		inFirst = outFirst;
+		inEnd = outEnd;
+	}
+}
+
+
+void Preview_SetCurrent(const struct Preview *preview)
+{
+	currentPreview = preview;
+}
+
+
+bool OScNIFPGA_GetPreview(uint32_t channel, uint32_t level,
+	OScNIFPGA_PreviewImage *image)
+{
+	const struct Preview *p = currentPreview;
+	if (p == NULL || channel >= p->channelCount || level == 0 || level > p->levels)
+		return false;
+	image->width = image->height = p->resolution >> level;
+	image->bytesPerPixel = p->eightBit ? 1 : 2;
+	image->pixels = p->eightBit ? (const void *)p->images8[channel][level - 1] :
+		(const void *)p->images[channel][level - 1];
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "OScNIFPGAPreview.h"
+
+#include "OpenScanDeviceLib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Preview pyramid builder (see OScNIFPGAPreview.h)
+//
+// Fed with bands of full-resolution rows as they are produced, so that
+// each band is downsampled while it is still in cache.
+
+// Bands passed to Preview_AddRows must start on a multiple of this
+#define PREVIEW_BAND_ALIGNMENT (1 << OSCNIFPGA_MAX_PREVIEW_LEVELS)
+
+struct Preview;
+
+// resolution must be a multiple of PREVIEW_BAND_ALIGNMENT
+OScDev_Error Preview_Create(struct Preview **preview,
+	uint32_t channelCount, uint32_t resolution, uint32_t levels,
+	bool eightBit, uint16_t displayMin, uint16_t displayMax);
+void Preview_Destroy(struct Preview *preview);
+
+// Downsample full-resolution rows [firstRow, firstRow + rowCount) of one
+// channel, given as that band of the frame. Disjoint bands may be added
+// concurrently.
+void Preview_AddRows(struct Preview *preview, uint32_t channel,
+	const uint16_t *frame, uint32_t firstRow, uint32_t rowCount);
+
+// Publish the previews of the frame whose callbacks are about to be called
+// on this thread (NULL to withdraw them)
+void Preview_SetCurrent(const struct Preview *preview);
@@ -0,0 +1,326 @@
+#include "RawCapture.h"
+#include "Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Windows.h>
+
+
+// Segments are sized to hold as many whole frames as fit in this many bytes
+// (but at least one frame). Kept moderate so that the view can be mapped in
+// a 32-bit process.
+#define SEGMENT_TARGET_BYTES (256ULL * 1024 * 1024)
+
+// Attempts at a file name not yet taken
+#define MAX_NAME_SEQUENCE 1000
+
+// Frames that may be waiting for the writer before new frames get dropped
+#define QUEUE_CAPACITY 8
+
+
+// Buffers that may exist at once: the queue plus the one being written
+#define BUFFER_CAPACITY (QUEUE_CAPACITY + 1)
+
+
+struct QueuedFrame
+{
+	uint32_t *words; // All channels, as laid out in the segment
+};
+
+
+struct RawCapture
+{
+	OScDev_Device *device;
+	struct RawCaptureGeometry geometry;
+	char directory[OScDev_MAX_STR_LEN + 1];
+	char startTime[32];
+	char nameSuffix[32];
+	char filePrefix[96]; // Start time, sequence number if needed, suffix
+	size_t planeWords;
+	uint64_t frameBytes;
+	uint32_t framesPerSegment;
+
+	CRITICAL_SECTION mutex;
+	CONDITION_VARIABLE queueCondition;
+	struct QueuedFrame queue[QUEUE_CAPACITY];
+	size_t queueHead;
+	size_t queueCount;
+	// Frame buffers not in use, kept for the next frames
+	uint32_t *freeBuffers[BUFFER_CAPACITY];
+	size_t freeCount;
+	bool finishRequested;
+	HANDLE thread;
+
+	// Accessed by the writer thread only
+	uint32_t segmentIndex;
+	HANDLE file;
+	HANDLE mapping;
+	struct RawCaptureHeader *view;
+	bool failed;
+
+	volatile LONG framesDropped;
+	uint64_t framesCaptured;
+};
+
+
+// Call with mutex held
+static void RecycleFrame(struct RawCapture *capture, struct QueuedFrame *frame)
+{
+	capture->freeBuffers[capture->freeCount++] = frame->words;
+	frame->words = NULL;
+}
+
+
+static void CloseSegment(struct RawCapture *capture)
+{
+	if (capture->view == NULL)
+		return;
+
+	uint64_t usedBytes = capture->view->headerBytes +
+		capture->view->framesWritten * capture->frameBytes;
+	FlushViewOfFile(capture->view, 0);
+	UnmapViewOfFile(capture->view);
+	capture->view = NULL;
+	CloseHandle(capture->mapping);
+	capture->mapping = NULL;
+
+	// Give back the preallocated space that was not used
+	LARGE_INTEGER size;
+	size.QuadPart = (LONGLONG)usedBytes;
+	if (SetFilePointerEx(capture->file, size, NULL, FILE_BEGIN))
+		SetEndOfFile(capture->file);
+	CloseHandle(capture->file);
+	capture->file = INVALID_HANDLE_VALUE;
+	++capture->segmentIndex;
+}
+
+
+static bool OpenSegment(struct RawCapture *capture)
+{
+	char path[MAX_PATH];
+	uint64_t segmentBytes = sizeof(struct RawCaptureHeader) +
+		capture->framesPerSegment * capture->frameBytes;
+
+	// Never overwrite: a capture started in the same millisecond as an
+	// earlier one (or finding its files) numbers its names instead
+	for (uint32_t sequence = 1;; ++sequence)
+	{
+		snprintf(path, sizeof(path), "%s\\%s_%04u%s", capture->directory,
+			capture->filePrefix, capture->segmentIndex, RAW_CAPTURE_FILE_EXTENSION);
+		capture->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+			NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (capture->file != INVALID_HANDLE_VALUE ||
+			GetLastError() != ERROR_FILE_EXISTS ||
+			capture->segmentIndex > 0 || sequence == MAX_NAME_SEQUENCE)
+			break;
+		snprintf(capture->filePrefix, sizeof(capture->filePrefix), "%s-%u%s",
+			capture->startTime, sequence + 1, capture->nameSuffix);
+	}
+	if (capture->file == INVALID_HANDLE_VALUE)
+	{
+		NIFPGA_LOG_ERROR(capture->device, "Cannot create raw capture file %s (error %lu)",
+			path, (unsigned long)GetLastError());
+		return false;
+	}
+
+	// Creating the mapping extends the file to its full size up front, so
+	// that no allocation happens while frames are being written
+	capture->mapping = CreateFileMappingA(capture->file, NULL, PAGE_READWRITE,
+		(DWORD)(segmentBytes >> 32), (DWORD)(segmentBytes & 0xFFFFFFFF), NULL);
+	if (capture->mapping == NULL)
+		goto error;
+	capture->view = MapViewOfFile(capture->mapping, FILE_MAP_WRITE, 0, 0, 0);
+	if (capture->view == NULL)
+		goto error;
+
+	struct RawCaptureHeader *header = capture->view;
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, RAW_CAPTURE_MAGIC, sizeof(header->magic));
+	header->version = RAW_CAPTURE_VERSION;
+	header->headerBytes = sizeof(struct RawCaptureHeader);
+	header->resolution = capture->geometry.resolution;
+	header->lineDelay = capture->geometry.lineDelay;
+	header->pixelRateHz = capture->geometry.pixelRateHz;
+	header->channelCount = capture->geometry.channelCount;
+	header->segmentIndex = capture->segmentIndex;
+	header->framesPerSegment = capture->framesPerSegment;
+	header->framesWritten = 0;
+	header->frameBytes = capture->frameBytes;
+
+	NIFPGA_LOG_DEBUG(capture->device, "Raw capture segment %s (%u frames)",
+		path, capture->framesPerSegment);
+	return true;
+
+error:
+	NIFPGA_LOG_ERROR(capture->device, "Cannot map raw capture file %s (error %lu)",
+		path, (unsigned long)GetLastError());
+	if (capture->mapping != NULL)
+		CloseHandle(capture->mapping);
+	capture->mapping = NULL;
+	CloseHandle(capture->file);
+	capture->file = INVALID_HANDLE_VALUE;
+	return false;
+}
+
+
+static void WriteFrame(struct RawCapture *capture, struct QueuedFrame *frame)
+{
+	if (capture->failed)
+		return;
+
+	if (capture->view != NULL &&
+		capture->view->framesWritten == capture->framesPerSegment)
+		CloseSegment(capture);
+	if (capture->view == NULL && !OpenSegment(capture))
+	{
+		capture->failed = true;
+		return;
+	}
+
+	struct RawCaptureHeader *header = capture->view;
+	char *dest = (char *)header + header->headerBytes +
+		header->framesWritten * capture->frameBytes;
+	memcpy(dest, frame->words, (size_t)capture->frameBytes);
+
+	// Publish the frame only after its data is in place, so that a reader
+	// of a segment still being written never sees a partial frame
+	MemoryBarrier();
+	++header->framesWritten;
+	++capture->framesCaptured;
+}
+
+
+static DWORD WINAPI WriterLoop(void *param)
+{
+	struct RawCapture *capture = param;
+
+	EnterCriticalSection(&capture->mutex);
+	for (;;)
+	{
+		while (capture->queueCount == 0 && !capture->finishRequested)
+			SleepConditionVariableCS(&capture->queueCondition, &capture->mutex, INFINITE);
+		if (capture->queueCount == 0)
+			break; // Finish requested and queue drained
+
+		struct QueuedFrame frame = capture->queue[capture->queueHead];
+		capture->queueHead = (capture->queueHead + 1) % QUEUE_CAPACITY;
+		--capture->queueCount;
+		LeaveCriticalSection(&capture->mutex);
+
+		WriteFrame(capture, &frame);
+
+		EnterCriticalSection(&capture->mutex);
+		RecycleFrame(capture, &frame);
+	}
+	LeaveCriticalSection(&capture->mutex);
+
+	CloseSegment(capture);
+	return 0;
+}
+
+
+OScDev_Error RawCapture_Start(struct RawCapture **capture, OScDev_Device *device,
+	const char *directory, const char *nameSuffix, const struct RawCaptureGeometry *geometry)
+{
+	*capture = NULL;
+	if (geometry->channelCount == 0 ||
+		geometry->channelCount > RAW_CAPTURE_MAX_CHANNELS)
+		return OScDev_Error_Unknown;
+
+	struct RawCapture *c = calloc(1, sizeof(struct RawCapture));
+	if (c == NULL)
+		return OScDev_Error_Unknown;
+	c->device = device;
+	c->geometry = *geometry;
+	strncpy(c->directory, directory, OScDev_MAX_STR_LEN);
+	c->planeWords = (size_t)geometry->resolution * geometry->resolution;
+	c->frameBytes = (uint64_t)c->planeWords * sizeof(uint32_t) * geometry->channelCount;
+	c->framesPerSegment = (uint32_t)(SEGMENT_TARGET_BYTES / c->frameBytes);
+	if (c->framesPerSegment == 0)
+		c->framesPerSegment = 1;
+	c->file = INVALID_HANDLE_VALUE;
+
+	SYSTEMTIME now;
+	GetLocalTime(&now);
+	snprintf(c->startTime, sizeof(c->startTime), "%04u%02u%02u-%02u%02u%02u.%03u",
+		now.wYear, now.wMonth, now.wDay, now.wHour, now.wMinute, now.wSecond,
+		now.wMilliseconds);
+	strncpy(c->nameSuffix, nameSuffix, sizeof(c->nameSuffix) - 1);
+	snprintf(c->filePrefix, sizeof(c->filePrefix), "%s%s", c->startTime, c->nameSuffix);
+
+	InitializeCriticalSection(&c->mutex);
+	InitializeConditionVariable(&c->queueCondition);
+
+	c->thread = CreateThread(NULL, 0, WriterLoop, c, 0, NULL);
+	if (c->thread == NULL)
+	{
+		DeleteCriticalSection(&c->mutex);
+		free(c);
+		return OScDev_Error_Unknown;
+	}
+
+	*capture = c;
+	return OScDev_OK;
+}
+
+
+bool RawCapture_Submit(struct RawCapture *capture, uint32_t *const planes[])
+{
+	// Only the writer takes frames off the queue, so it cannot fill up
+	// between this check and queueing the frame
+	struct QueuedFrame frame = { NULL };
+	EnterCriticalSection(&capture->mutex);
+	bool full = capture->queueCount == QUEUE_CAPACITY;
+	if (!full && capture->freeCount > 0)
+		frame.words = capture->freeBuffers[--capture->freeCount];
+	LeaveCriticalSection(&capture->mutex);
+
+	if (!full && frame.words == NULL)
+		frame.words = malloc((size_t)capture->frameBytes);
+	if (full || frame.words == NULL)
+	{
+		InterlockedIncrement(&capture->framesDropped);
+		return false;
+	}
+
+	for (uint32_t ch = 0; ch < capture->geometry.channelCount; ++ch)
+	{
+		memcpy(frame.words + ch * capture->planeWords, planes[ch],
+			capture->planeWords * sizeof(uint32_t));
+	}
+
+	EnterCriticalSection(&capture->mutex);
+	size_t tail = (capture->queueHead + capture->queueCount) % QUEUE_CAPACITY;
+	capture->queue[tail] = frame;
+	++capture->queueCount;
+	LeaveCriticalSection(&capture->mutex);
+	WakeConditionVariable(&capture->queueCondition);
+	return true;
+}
+
+
+void RawCapture_Finish(struct RawCapture *capture)
+{
+	if (capture == NULL)
+		return;
+
+	EnterCriticalSection(&capture->mutex);
+	capture->finishRequested = true;
+	LeaveCriticalSection(&capture->mutex);
+	WakeConditionVariable(&capture->queueCondition);
+
+	WaitForSingleObject(capture->thread, INFINITE);
+	CloseHandle(capture->thread);
+
+	NIFPGA_LOG_INFO(capture->device,
+		"Raw capture: %llu frames written to %u segment(s), %ld dropped",
+		(unsigned long long)capture->framesCaptured, capture->segmentIndex,
+		(long)capture->framesDropped);
+
+	for (size_t i = 0; i < capture->freeCount; ++i)
+		free(capture->freeBuffers[i]);
+	DeleteCriticalSection(&capture->mutex);
+	free(capture);
+}
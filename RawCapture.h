@@ -0,0 +1,71 @@
+#pragma once
+
+#include "OpenScanDeviceLib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Raw FIFO capture
+//
+// Every frame read from the target-to-host FIFOs is written, unmodified, to a
+// sequence of preallocated, memory-mapped segment files. Each 32-bit word
+// keeps both halves (averaged sample in the high 16 bits, raw sample in the
+// low 16 bits).
+//
+// Segment file layout:
+//   struct RawCaptureHeader
+//   frame 0: channel 0 words[resolution * resolution], channel 1 words, ...
+//   frame 1: ...
+// Frames are stored channel-major in FIFO order. A segment is truncated to
+// header + framesWritten * frameBytes when it is closed.
+
+#define RAW_CAPTURE_MAGIC "OSCNIRAW"
+#define RAW_CAPTURE_VERSION 1
+#define RAW_CAPTURE_FILE_EXTENSION ".oscraw"
+#define RAW_CAPTURE_MAX_CHANNELS 4
+
+#pragma pack(push, 8)
+struct RawCaptureHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerBytes;
+	uint32_t resolution;
+	uint32_t lineDelay;
+	double pixelRateHz;
+	uint32_t channelCount;
+	uint32_t segmentIndex;
+	uint32_t framesPerSegment;
+	volatile uint32_t framesWritten;
+	uint64_t frameBytes;
+	uint32_t reserved[4];
+};
+#pragma pack(pop)
+
+
+struct RawCaptureGeometry
+{
+	uint32_t resolution;
+	uint32_t lineDelay;
+	double pixelRateHz;
+	uint32_t channelCount;
+};
+
+
+struct RawCapture;
+
+// Create the writer thread and the first segment file in directory.
+// nameSuffix (may be empty) follows the start time, to the millisecond, in
+// the file names; existing files are never overwritten, a sequence number
+// being added to the start time instead.
+OScDev_Error RawCapture_Start(struct RawCapture **capture, OScDev_Device *device,
+	const char *directory, const char *nameSuffix, const struct RawCaptureGeometry *geometry);
+
+// Queue a copy of one frame (geometry->channelCount planes of resolution^2
+// words) for writing; the caller keeps the planes. Never blocks; if the
+// writer has fallen behind, the frame is dropped and false is returned.
+bool RawCapture_Submit(struct RawCapture *capture, uint32_t *const planes[]);
+
+// Write out all queued frames, close the segment files and free capture
+void RawCapture_Finish(struct RawCapture *capture);
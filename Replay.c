@@ -0,0 +1,244 @@
+#include "Replay.h"
+#include "Log.h"
+#include "Waveform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Windows.h>
+
+
+#define MAX_SEGMENTS 1024
+
+
+struct Segment
+{
+	HANDLE file;
+	HANDLE mapping;
+	const struct RawCaptureHeader *view;
+	uint64_t firstFrame;
+};
+
+
+struct Replay
+{
+	OScDev_Device *device;
+	struct RawCaptureGeometry geometry;
+	uint64_t frameBytes;
+	struct Segment segments[MAX_SEGMENTS];
+	uint32_t segmentCount;
+	uint64_t frameCount;
+	volatile bool originalTiming;
+};
+
+
+static void UnmapSegment(struct Segment *segment)
+{
+	if (segment->view != NULL)
+		UnmapViewOfFile(segment->view);
+	if (segment->mapping != NULL)
+		CloseHandle(segment->mapping);
+	if (segment->file != INVALID_HANDLE_VALUE)
+		CloseHandle(segment->file);
+}
+
+
+static bool MapSegment(struct Replay *replay, const char *path, struct Segment *segment)
+{
+	segment->mapping = NULL;
+	segment->view = NULL;
+	segment->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (segment->file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(segment->file, &size) ||
+		(uint64_t)size.QuadPart < sizeof(struct RawCaptureHeader))
+		goto error;
+	segment->mapping = CreateFileMappingA(segment->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (segment->mapping == NULL)
+		goto error;
+	segment->view = MapViewOfFile(segment->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (segment->view == NULL)
+		goto error;
+
+	const struct RawCaptureHeader *header = segment->view;
+	if (memcmp(header->magic, RAW_CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != RAW_CAPTURE_VERSION ||
+		header->channelCount == 0 ||
+		header->channelCount > RAW_CAPTURE_MAX_CHANNELS ||
+		header->frameBytes != (uint64_t)header->resolution * header->resolution *
+			sizeof(uint32_t) * header->channelCount ||
+		(uint64_t)size.QuadPart < header->headerBytes +
+			header->framesWritten * header->frameBytes)
+	{
+		NIFPGA_LOG_ERROR(replay->device, "Not a valid raw capture segment: %s", path);
+		goto error;
+	}
+	return true;
+
+error:
+	UnmapSegment(segment);
+	return false;
+}
+
+
+// Build the path of segment index from the path of segment 0
+// ("<prefix>_0000.oscraw")
+static bool SegmentPath(const char *firstPath, uint32_t index, char *path, size_t size)
+{
+	const char *underscore = strrchr(firstPath, '_');
+	if (underscore == NULL)
+		return false;
+	snprintf(path, size, "%.*s_%04u%s", (int)(underscore - firstPath), firstPath,
+		index, RAW_CAPTURE_FILE_EXTENSION);
+	return true;
+}
+
+
+OScDev_Error Replay_Open(struct Replay **replay, OScDev_Device *device,
+	const char *firstSegmentPath)
+{
+	*replay = NULL;
+	struct Replay *r = calloc(1, sizeof(struct Replay));
+	if (r == NULL)
+		return OScDev_Error_Unknown;
+	r->device = device;
+	r->originalTiming = true;
+
+	for (uint32_t i = 0; i < MAX_SEGMENTS; ++i)
+	{
+		char path[MAX_PATH];
+		if (i == 0)
+			strncpy(path, firstSegmentPath, sizeof(path) - 1);
+		else if (!SegmentPath(firstSegmentPath, i, path, sizeof(path)))
+			break;
+		path[sizeof(path) - 1] = '\0';
+
+		struct Segment *segment = &r->segments[i];
+		if (!MapSegment(r, path, segment))
+			break;
+
+		const struct RawCaptureHeader *header = segment->view;
+		if (i == 0)
+		{
+			r->geometry.resolution = header->resolution;
+			r->geometry.lineDelay = header->lineDelay;
+			r->geometry.pixelRateHz = header->pixelRateHz;
+			r->geometry.channelCount = header->channelCount;
+			r->frameBytes = header->frameBytes;
+		}
+		else if (header->frameBytes != r->frameBytes)
+		{
+			UnmapSegment(segment);
+			break;
+		}
+
+		segment->firstFrame = r->frameCount;
+		r->frameCount += header->framesWritten;
+		++r->segmentCount;
+	}
+
+	if (r->frameCount == 0)
+	{
+		NIFPGA_LOG_ERROR(device, "No frames to replay in %s", firstSegmentPath);
+		Replay_Close(r);
+		return OScDev_Error_Unknown;
+	}
+
+	NIFPGA_LOG_INFO(device, "Replaying %llu frames (%u x %u, %u channels) from %u segment(s)",
+		(unsigned long long)r->frameCount, r->geometry.resolution, r->geometry.resolution,
+		r->geometry.channelCount, r->segmentCount);
+	*replay = r;
+	return OScDev_OK;
+}
+
+
+void Replay_Close(struct Replay *replay)
+{
+	if (replay == NULL)
+		return;
+	for (uint32_t i = 0; i < replay->segmentCount; ++i)
+		UnmapSegment(&replay->segments[i]);
+	free(replay);
+}
+
+
+const struct RawCaptureGeometry *Replay_GetGeometry(const struct Replay *replay)
+{
+	return &replay->geometry;
+}
+
+
+void Replay_SetOriginalTiming(struct Replay *replay, bool originalTiming)
+{
+	replay->originalTiming = originalTiming;
+}
+
+
+static void ReplayBeginScan(void *context, const struct SimFpgaScan *scan,
+	double *framePeriodSec)
+{
+	struct Replay *replay = context;
+	if (!replay->originalTiming)
+	{
+		*framePeriodSec = 0.0;
+		return;
+	}
+
+	const struct RawCaptureGeometry *g = &replay->geometry;
+	uint32_t elementsPerLine = g->lineDelay + g->resolution + X_RETRACE_LEN;
+	uint32_t linesPerFrame = g->resolution + Y_RETRACE_LEN;
+	*framePeriodSec = (double)elementsPerLine * linesPerFrame / g->pixelRateHz;
+}
+
+
+static const uint32_t *FramePlane(struct Replay *replay, uint64_t frame, uint32_t channel)
+{
+	// Segments are few; a linear search from the end is cheap
+	uint32_t i = replay->segmentCount - 1;
+	while (replay->segments[i].firstFrame > frame)
+		--i;
+	const struct Segment *segment = &replay->segments[i];
+	const char *data = (const char *)segment->view + segment->view->headerBytes;
+	size_t planeBytes = (size_t)(replay->frameBytes / replay->geometry.channelCount);
+	return (const uint32_t *)(data + (frame - segment->firstFrame) * replay->frameBytes +
+		channel * planeBytes);
+}
+
+
+static void ReplayFill(void *context, uint32_t channel, uint64_t wordIndex,
+	uint32_t *dest, size_t count)
+{
+	struct Replay *replay = context;
+	uint64_t wordsPerFrame = (uint64_t)replay->geometry.resolution * replay->geometry.resolution;
+
+	while (count > 0)
+	{
+		uint64_t frame = (wordIndex / wordsPerFrame) % replay->frameCount;
+		uint64_t offset = wordIndex % wordsPerFrame;
+		size_t n = (size_t)(wordsPerFrame - offset);
+		if (n > count)
+			n = count;
+
+		// Channels that were not recorded read as zero
+		if (channel < replay->geometry.channelCount)
+			memcpy(dest, FramePlane(replay, frame, channel) + offset, n * sizeof(uint32_t));
+		else
+			memset(dest, 0, n * sizeof(uint32_t));
+
+		dest += n;
+		wordIndex += n;
+		count -= n;
+	}
+}
+
+
+void Replay_GetSource(struct Replay *replay, struct SimFpgaSource *source)
+{
+	source->context = replay;
+	source->BeginScan = ReplayBeginScan;
+	source->Fill = ReplayFill;
+}
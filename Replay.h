@@ -0,0 +1,37 @@
+#pragma once
+
+#include "RawCapture.h"
+#include "SimFpga.h"
+
+#include "OpenScanDeviceLib.h"
+
+#include <stdbool.h>
+
+
+// Replay of raw FIFO captures
+//
+// Feeds the words recorded by RawCapture back through a simulated FPGA
+// session, so that the acquisition path (FIFO reads, unpacking, frame
+// delivery) runs exactly as it does with hardware. The recording loops if
+// more frames are acquired than were captured.
+//
+// A "Replay" device is enumerated when this environment variable holds the
+// path of the first segment file of a capture.
+#define REPLAY_ENVIRONMENT_VARIABLE "OSC_NIFPGA_REPLAY"
+
+struct Replay;
+
+// Open the capture whose first segment file is firstSegmentPath; further
+// segments (_0001, _0002, ...) are picked up automatically
+OScDev_Error Replay_Open(struct Replay **replay, OScDev_Device *device,
+	const char *firstSegmentPath);
+void Replay_Close(struct Replay *replay);
+
+const struct RawCaptureGeometry *Replay_GetGeometry(const struct Replay *replay);
+
+// With original timing, frames are delivered at the recorded frame period
+// (from the recorded pixel rate and line delay); otherwise as fast as the
+// host reads them
+void Replay_SetOriginalTiming(struct Replay *replay, bool originalTiming);
+
+void Replay_GetSource(struct Replay *replay, struct SimFpgaSource *source);
@@ -0,0 +1,113 @@
+#include "ResidentWaveform.h"
+
+#include "NiFpga_OpenScanFPGAHost.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <Windows.h>
+
+
+#define RECORD_MAGIC "OScNIWF"
+#define RECORD_VERSION 1
+
+
+struct RecordFile
+{
+	char magic[8];
+	uint32_t version;
+	char signature[36]; // Of the bitfile that was running
+	struct ResidentWaveformRecord record;
+};
+
+
+static bool GetRecordPath(const char *resourceName, char *path, size_t size)
+{
+	char directory[MAX_PATH];
+	DWORD len = GetTempPathA(sizeof(directory), directory);
+	if (len == 0 || len >= sizeof(directory))
+		return false;
+
+	// Resource names may be URLs ("rio://host/RIO0")
+	char name[64];
+	size_t i;
+	for (i = 0; resourceName[i] != '\0' && i < sizeof(name) - 1; ++i)
+	{
+		char c = resourceName[i];
+		bool plain = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+			(c >= 'a' && c <= 'z') || c == '-';
+		name[i] = plain ? c : '_';
+	}
+	name[i] = '\0';
+
+	int n = snprintf(path, size, "%sOScNIFPGA-%s.waveform", directory, name);
+	return n > 0 && (size_t)n < size;
+}
+
+
+bool ResidentWaveform_Load(const char *resourceName,
+	struct ResidentWaveformRecord *record)
+{
+	char path[MAX_PATH];
+	if (!GetRecordPath(resourceName, path, sizeof(path)))
+		return false;
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	struct RecordFile contents;
+	DWORD read;
+	BOOL ok = ReadFile(file, &contents, sizeof(contents), &read, NULL);
+	CloseHandle(file);
+
+	if (!ok || read != sizeof(contents) ||
+		memcmp(contents.magic, RECORD_MAGIC, sizeof(contents.magic)) != 0 ||
+		contents.version != RECORD_VERSION)
+		return false;
+	contents.signature[sizeof(contents.signature) - 1] = '\0';
+	if (strcmp(contents.signature, NiFpga_OpenScanFPGAHost_Signature) != 0)
+		return false;
+	if (contents.record.tag != WaveformGeometry_Hash(&contents.record.geometry))
+		return false;
+
+	*record = contents.record;
+	return true;
+}
+
+
+void ResidentWaveform_Save(const char *resourceName,
+	const struct ResidentWaveformRecord *record)
+{
+	char path[MAX_PATH];
+	if (!GetRecordPath(resourceName, path, sizeof(path)))
+		return;
+
+	struct RecordFile contents;
+	memset(&contents, 0, sizeof(contents));
+	memcpy(contents.magic, RECORD_MAGIC, sizeof(contents.magic));
+	contents.version = RECORD_VERSION;
+	strncpy(contents.signature, NiFpga_OpenScanFPGAHost_Signature,
+		sizeof(contents.signature) - 1);
+	contents.record = *record;
+
+	HANDLE file = CreateFileA(path, GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+	DWORD written;
+	BOOL ok = WriteFile(file, &contents, sizeof(contents), &written, NULL);
+	CloseHandle(file);
+
+	// A partial record would be rejected on load, but don't leave it around
+	if (!ok || written != sizeof(contents))
+		DeleteFileA(path);
+}
+
+
+void ResidentWaveform_Discard(const char *resourceName)
+{
+	char path[MAX_PATH];
+	if (GetRecordPath(resourceName, path, sizeof(path)))
+		DeleteFileA(path);
+}
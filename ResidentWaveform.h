@@ -0,0 +1,35 @@
+#pragma once
+
+#include "WaveformUpdater.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Record of the waveform held in the FPGA DRAM of a RIO resource
+//
+// The record is kept in a file in the temporary directory, so that it
+// outlives the session and the module: when a device is opened again and
+// the FPGA was not reset in between, the waveform need not be uploaded
+// again. The record only says what was uploaded; the caller must check
+// against the FPGA that it is still there before relying on it.
+
+struct ResidentWaveformRecord
+{
+	uint64_t tag; // WaveformGeometry_Hash() of geometry
+	struct WaveformGeometry geometry;
+	// Galvo position at the start of the waveform
+	uint16_t startX;
+	uint16_t startY;
+};
+
+// Returns false if there is no record for resourceName, or it was made
+// with another bitfile
+bool ResidentWaveform_Load(const char *resourceName,
+	struct ResidentWaveformRecord *record);
+
+void ResidentWaveform_Save(const char *resourceName,
+	const struct ResidentWaveformRecord *record);
+
+// Call before the DRAM contents change, or when they become unknown
+void ResidentWaveform_Discard(const char *resourceName);
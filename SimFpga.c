@@ -0,0 +1,530 @@
+#include "SimFpga.h"
+#include "OScNIFPGADevicePrivate.h"
+
+#include "NiFpga_OpenScanFPGAHost.h"
+
+#include <string.h>
+
+#include <Windows.h>
+
+
+#define NUM_CHANNELS 4
+
+// Controls and indicators of the bitfile all live in this address window
+#define REGISTER_BASE 0x10000
+#define NUM_REGISTERS 64
+
+#define FPGA_CLOCK_HZ 40e6
+
+// Elements the host can fall behind before the simulated target stalls
+#define FIFO_DEPTH (1 << 20)
+
+
+struct SimSession
+{
+	bool inUse;
+	char resource[64];
+	bool running;
+	SRWLOCK lock;
+	uint32_t registers[NUM_REGISTERS];
+	uint16_t current;
+	struct SimFpgaSource source;
+	bool hasSource;
+
+	// Stream state; kept after the scan ends so that the host can read out
+	// data that was produced before it stopped
+	bool streaming;
+	bool scanStopped;
+	struct SimFpgaScan scan;
+	double framePeriodSec;
+	LARGE_INTEGER scanStart;
+	uint64_t producedAtStop;
+	uint64_t consumed[NUM_CHANNELS];
+};
+
+
+// What a resource keeps between sessions: a session closed without reset
+// leaves the target running with its controls as they were
+struct SimTarget
+{
+	char resource[64];
+	bool running;
+	uint32_t registers[NUM_REGISTERS];
+};
+
+
+static SRWLOCK g_sessionsLock = SRWLOCK_INIT;
+static struct SimSession g_sessions[SIMFPGA_MAX_SESSIONS];
+static struct SimTarget g_targets[SIMFPGA_MAX_SESSIONS]; // Guarded by g_sessionsLock
+
+
+static struct SimSession *LookUpSession(NiFpga_Session session)
+{
+	if (session == 0 || session > SIMFPGA_MAX_SESSIONS)
+		return NULL;
+	struct SimSession *s = &g_sessions[session - 1];
+	return s->inUse ? s : NULL;
+}
+
+
+static uint32_t *Register(struct SimSession *s, uint32_t address)
+{
+	static uint32_t ignored;
+	uint32_t index = (address - REGISTER_BASE) / 2;
+	if (address < REGISTER_BASE || index >= NUM_REGISTERS)
+		return &ignored;
+	return &s->registers[index];
+}
+
+
+static int FifoToChannel(uint32_t fifo)
+{
+	switch (fifo)
+	{
+	case NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettohostFIFO1:
+		return 0;
+	case NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO2:
+		return 1;
+	case NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO3:
+		return 2;
+	case NiFpga_OpenScanFPGAHost_TargetToHostFifoU32_TargettoHostFIFO4:
+		return 3;
+	default:
+		return -1;
+	}
+}
+
+
+static double SecondsSince(const LARGE_INTEGER *start, const LARGE_INTEGER *end)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (double)(end->QuadPart - start->QuadPart) / freq.QuadPart;
+}
+
+
+static uint64_t WordsPerFrame(const struct SimSession *s)
+{
+	return (uint64_t)s->scan.resolution * s->scan.resolution;
+}
+
+
+// Words produced on each channel since the scan started
+static uint64_t ProducedWords(struct SimSession *s)
+{
+	if (!s->streaming)
+		return 0;
+
+	if (s->scanStopped)
+		return s->producedAtStop;
+
+	uint64_t total = WordsPerFrame(s) * s->scan.numberOfFrames;
+	if (s->framePeriodSec <= 0.0)
+		return total;
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	double frames = SecondsSince(&s->scanStart, &now) / s->framePeriodSec;
+	uint64_t produced = (uint64_t)(frames * WordsPerFrame(s));
+	return produced < total ? produced : total;
+}
+
+
+// Words that a read on the channel can return. The host reads (and checks
+// for leftover data) one frame at a time, so data is handed out only up to
+// the end of the frame currently being read.
+static uint64_t Available(struct SimSession *s, int channel)
+{
+	uint64_t consumed = s->consumed[channel];
+	uint64_t available = ProducedWords(s) - consumed;
+	uint64_t wordsPerFrame = WordsPerFrame(s);
+	if (wordsPerFrame > 0)
+	{
+		uint64_t toFrameEnd = wordsPerFrame - consumed % wordsPerFrame;
+		if (available > toFrameEnd)
+			available = toFrameEnd;
+	}
+	return available < FIFO_DEPTH ? available : FIFO_DEPTH;
+}
+
+
+static void BeginScan(struct SimSession *s)
+{
+	struct SimFpgaScan *scan = &s->scan;
+	scan->resolution = *Register(s, NiFpga_OpenScanFPGAHost_ControlI32_Resolution);
+	scan->elementsPerLine = *Register(s, NiFpga_OpenScanFPGAHost_ControlI32_Elementsperline);
+	uint32_t totalElements = *Register(s, NiFpga_OpenScanFPGAHost_ControlU32_Totalelements);
+	scan->linesPerFrame = scan->elementsPerLine ? totalElements / scan->elementsPerLine : 0;
+	uint32_t pixelTimeTicks = *Register(s, NiFpga_OpenScanFPGAHost_ControlI32_Pixeltimetick);
+	scan->pixelRateHz = pixelTimeTicks ? FPGA_CLOCK_HZ / pixelTimeTicks : 0.0;
+	scan->numberOfFrames = *Register(s, NiFpga_OpenScanFPGAHost_ControlI32_Numberofframes);
+
+	s->framePeriodSec = scan->pixelRateHz > 0.0 ?
+		(double)scan->elementsPerLine * scan->linesPerFrame / scan->pixelRateHz : 0.0;
+	if (s->hasSource && s->source.BeginScan)
+		s->source.BeginScan(s->source.context, scan, &s->framePeriodSec);
+
+	memset(s->consumed, 0, sizeof(s->consumed));
+	s->streaming = true;
+	s->scanStopped = false;
+	QueryPerformanceCounter(&s->scanStart);
+	s->current = FPGA_STATE_SCAN;
+}
+
+
+static void EndScan(struct SimSession *s)
+{
+	if (s->current != FPGA_STATE_SCAN)
+		return;
+	s->producedAtStop = ProducedWords(s);
+	if (s->framePeriodSec <= 0.0)
+	{
+		// Unpaced data is produced on demand; a scan stopped early has
+		// produced no further than the end of the frame being read
+		uint64_t wordsPerFrame = WordsPerFrame(s);
+		uint64_t consumed = 0;
+		for (int ch = 0; ch < NUM_CHANNELS; ++ch)
+		{
+			if (s->consumed[ch] > consumed)
+				consumed = s->consumed[ch];
+		}
+		if (wordsPerFrame > 0)
+			consumed += (wordsPerFrame - consumed % wordsPerFrame) % wordsPerFrame;
+		if (consumed < s->producedAtStop)
+			s->producedAtStop = consumed;
+	}
+	s->scanStopped = true;
+	s->current = FPGA_STATE_IDLE;
+}
+
+
+// Call with g_sessionsLock held
+static struct SimTarget *FindTarget(const char *resource, bool create)
+{
+	struct SimTarget *unused = NULL;
+	for (uint32_t i = 0; i < SIMFPGA_MAX_SESSIONS; ++i)
+	{
+		struct SimTarget *t = &g_targets[i];
+		if (t->resource[0] == '\0')
+		{
+			if (unused == NULL)
+				unused = t;
+		}
+		else if (strcmp(t->resource, resource) == 0)
+		{
+			return t;
+		}
+	}
+	if (!create || unused == NULL)
+		return NULL;
+	strncpy(unused->resource, resource, sizeof(unused->resource) - 1);
+	return unused;
+}
+
+
+static NiFpga_Status SimOpen(const char *bitfile, const char *signature,
+	const char *resource, uint32_t attribute, NiFpga_Session *session)
+{
+	NiFpga_Status stat = NiFpga_Status_InvalidParameter;
+	AcquireSRWLockExclusive(&g_sessionsLock);
+	for (uint32_t i = 0; i < SIMFPGA_MAX_SESSIONS; ++i)
+	{
+		struct SimSession *s = &g_sessions[i];
+		if (s->inUse)
+			continue;
+		memset(s, 0, sizeof(*s));
+		InitializeSRWLock(&s->lock);
+		s->inUse = true;
+		strncpy(s->resource, resource, sizeof(s->resource) - 1);
+		s->running = !(attribute & NiFpga_OpenAttribute_NoRun);
+		s->current = FPGA_STATE_IDLE;
+
+		// As with the hardware, NoRun does not stop a target left running
+		struct SimTarget *t = FindTarget(resource, false);
+		if (t != NULL)
+		{
+			memcpy(s->registers, t->registers, sizeof(s->registers));
+			s->running = s->running || t->running;
+		}
+
+		*session = i + 1;
+		stat = NiFpga_Status_Success;
+		break;
+	}
+	ReleaseSRWLockExclusive(&g_sessionsLock);
+	return stat;
+}
+
+
+static NiFpga_Status SimClose(NiFpga_Session session, uint32_t attribute)
+{
+	AcquireSRWLockExclusive(&g_sessionsLock);
+	struct SimSession *s = LookUpSession(session);
+	if (s != NULL)
+	{
+		s->inUse = false;
+		if (attribute & NiFpga_CloseAttribute_NoResetIfLastSession)
+		{
+			struct SimTarget *t = FindTarget(s->resource, true);
+			if (t != NULL)
+			{
+				t->running = s->running;
+				memcpy(t->registers, s->registers, sizeof(t->registers));
+			}
+		}
+		else
+		{
+			struct SimTarget *t = FindTarget(s->resource, false);
+			if (t != NULL)
+				memset(t, 0, sizeof(*t));
+		}
+	}
+	ReleaseSRWLockExclusive(&g_sessionsLock);
+	return s ? NiFpga_Status_Success : NiFpga_Status_InvalidParameter;
+}
+
+
+static NiFpga_Status SimReset(NiFpga_Session session)
+{
+	struct SimSession *s = LookUpSession(session);
+	if (s == NULL)
+		return NiFpga_Status_InvalidParameter;
+	AcquireSRWLockExclusive(&s->lock);
+	memset(s->registers, 0, sizeof(s->registers));
+	s->current = FPGA_STATE_IDLE;
+	s->streaming = false;
+	s->running = false;
+	ReleaseSRWLockExclusive(&s->lock);
+	return NiFpga_Status_Success;
+}
+
+
+static NiFpga_Status SimRun(NiFpga_Session session, uint32_t attribute)
+{
+	struct SimSession *s = LookUpSession(session);
+	if (s == NULL)
+		return NiFpga_Status_InvalidParameter;
+	AcquireSRWLockExclusive(&s->lock);
+	bool wasRunning = s->running;
+	s->running = true;
+	ReleaseSRWLockExclusive(&s->lock);
+	return wasRunning ? NiFpga_Status_FpgaAlreadyRunning : NiFpga_Status_Success;
+}
+
+
+static NiFpga_Status SimReadU16(NiFpga_Session session, uint32_t indicator, uint16_t *value)
+{
+	struct SimSession *s = LookUpSession(session);
+	if (s == NULL)
+		return NiFpga_Status_InvalidParameter;
+	AcquireSRWLockExclusive(&s->lock);
+	if (indicator == NiFpga_OpenScanFPGAHost_ControlU16_Current)
+	{
+		// The firmware returns to idle once the last frame has been produced
+		if (s->current == FPGA_STATE_SCAN &&
+			ProducedWords(s) == WordsPerFrame(s) * s->scan.numberOfFrames)
+			EndScan(s);
+		*value = s->current;
+	}
+	else
+	{
+		*value = (uint16_t)*Register(s, indicator);
+	}
+	ReleaseSRWLockExclusive(&s->lock);
+	return NiFpga_Status_Success;
+}
+
+
+static NiFpga_Status ReadRegister(NiFpga_Session session, uint32_t indicator, uint32_t *value)
+{
+	struct SimSession *s = LookUpSession(session);
+	if (s == NULL)
+		return NiFpga_Status_InvalidParameter;
+	AcquireSRWLockShared(&s->lock);
+	*value = *Register(s, indicator);
+	ReleaseSRWLockShared(&s->lock);
+	return NiFpga_Status_Success;
+}
+
+
+static NiFpga_Status SimReadI32(NiFpga_Session session, uint32_t indicator, int32_t *value)
+{
+	uint32_t u;
+	NiFpga_Status stat = ReadRegister(session, indicator, &u);
+	*value = (int32_t)u;
+	return stat;
+}
+
+
+static NiFpga_Status SimReadU32(NiFpga_Session session, uint32_t indicator, uint32_t *value)
+{
+	return ReadRegister(session, indicator, value);
+}
+
+
+static NiFpga_Status WriteRegister(NiFpga_Session session, uint32_t control, uint32_t value)
+{
+	struct SimSession *s = LookUpSession(session);
+	if (s == NULL)
+		return NiFpga_Status_InvalidParameter;
+	AcquireSRWLockExclusive(&s->lock);
+	*Register(s, control) = value;
+	if (control == NiFpga_OpenScanFPGAHost_ControlU16_Current)
+	{
+		if (value == FPGA_STATE_SCAN)
+		{
+			if (*Register(s, NiFpga_OpenScanFPGAHost_ControlBool_ReadytoScan))
+				BeginScan(s);
+		}
+		else
+		{
+			// INIT, WRITE and STOP complete immediately
+			EndScan(s);
+			s->current = FPGA_STATE_IDLE;
+		}
+	}
+	else if (control == NiFpga_OpenScanFPGAHost_ControlBool_ReadytoScan && !value)
+	{
+		EndScan(s);
+	}
+	ReleaseSRWLockExclusive(&s->lock);
+	return NiFpga_Status_Success;
+}
+
+
+static NiFpga_Status SimWriteU16(NiFpga_Session session, uint32_t control, uint16_t value)
+{
+	return WriteRegister(session, control, value);
+}
+
+
+static NiFpga_Status SimWriteI32(NiFpga_Session session, uint32_t control, int32_t value)
+{
+	return WriteRegister(session, control, (uint32_t)value);
+}
+
+
+static NiFpga_Status SimWriteU32(NiFpga_Session session, uint32_t control, uint32_t value)
+{
+	return WriteRegister(session, control, value);
+}
+
+
+static NiFpga_Status SimWriteBool(NiFpga_Session session, uint32_t control, NiFpga_Bool value)
+{
+	return WriteRegister(session, control, value ? 1 : 0);
+}
+
+
+static NiFpga_Status SimStartStopFifo(NiFpga_Session session, uint32_t fifo)
+{
+	return LookUpSession(session) ? NiFpga_Status_Success : NiFpga_Status_InvalidParameter;
+}
+
+
+static NiFpga_Status SimReadFifoU32(NiFpga_Session session, uint32_t fifo,
+	uint32_t *data, size_t numberOfElements, uint32_t timeout,
+	size_t *elementsRemaining)
+{
+	struct SimSession *s = LookUpSession(session);
+	int channel = FifoToChannel(fifo);
+	if (s == NULL || channel < 0)
+		return NiFpga_Status_InvalidParameter;
+
+	ULONGLONG startMs = GetTickCount64();
+	for (;;)
+	{
+		AcquireSRWLockExclusive(&s->lock);
+		uint64_t available = Available(s, channel);
+		if (available >= numberOfElements)
+		{
+			uint64_t wordIndex = s->consumed[channel];
+			s->consumed[channel] += numberOfElements;
+			struct SimFpgaSource source = s->source;
+			bool hasSource = s->hasSource;
+			ReleaseSRWLockExclusive(&s->lock);
+
+			// Only this channel's reader advances its stream, so the data
+			// can be produced without holding the lock
+			if (numberOfElements > 0)
+			{
+				if (hasSource)
+					source.Fill(source.context, channel, wordIndex, data, numberOfElements);
+				else
+					memset(data, 0, numberOfElements * sizeof(uint32_t));
+			}
+			if (elementsRemaining)
+				*elementsRemaining = (size_t)(available - numberOfElements);
+			return NiFpga_Status_Success;
+		}
+
+		// Sleep until the requested elements will have been produced
+		double waitSec = 0.001;
+		if (s->streaming && !s->scanStopped && s->framePeriodSec > 0.0)
+			waitSec = (numberOfElements - available) * s->framePeriodSec / WordsPerFrame(s);
+		ReleaseSRWLockExclusive(&s->lock);
+
+		ULONGLONG elapsedMs = GetTickCount64() - startMs;
+		if (timeout != NiFpga_InfiniteTimeout && elapsedMs >= timeout)
+		{
+			if (elementsRemaining)
+				*elementsRemaining = (size_t)available;
+			return NiFpga_Status_FifoTimeout;
+		}
+		DWORD sleepMs = (DWORD)(waitSec * 1000.0);
+		if (sleepMs < 1)
+			sleepMs = 1;
+		if (timeout != NiFpga_InfiniteTimeout && sleepMs > timeout - elapsedMs)
+			sleepMs = (DWORD)(timeout - elapsedMs);
+		Sleep(sleepMs);
+	}
+}
+
+
+static NiFpga_Status SimWriteFifoU32(NiFpga_Session session, uint32_t fifo,
+	const uint32_t *data, size_t numberOfElements, uint32_t timeout,
+	size_t *emptyElementsRemaining)
+{
+	// The waveform is accepted and discarded
+	if (LookUpSession(session) == NULL)
+		return NiFpga_Status_InvalidParameter;
+	if (emptyElementsRemaining)
+		*emptyElementsRemaining = FIFO_DEPTH;
+	return NiFpga_Status_Success;
+}
+
+
+NiFpga_Status SimFpga_SetSource(NiFpga_Session session,
+	const struct SimFpgaSource *source)
+{
+	struct SimSession *s = LookUpSession(session);
+	if (s == NULL)
+		return NiFpga_Status_InvalidParameter;
+	AcquireSRWLockExclusive(&s->lock);
+	s->hasSource = source != NULL;
+	if (source != NULL)
+		s->source = *source;
+	ReleaseSRWLockExclusive(&s->lock);
+	return NiFpga_Status_Success;
+}
+
+
+const struct FpgaBackend SimFpgaBackend = {
+	.name = "Simulated",
+	.usesNiFpgaRuntime = false,
+	.Open = SimOpen,
+	.Close = SimClose,
+	.Reset = SimReset,
+	.Run = SimRun,
+	.ReadU16 = SimReadU16,
+	.ReadI32 = SimReadI32,
+	.ReadU32 = SimReadU32,
+	.WriteU16 = SimWriteU16,
+	.WriteI32 = SimWriteI32,
+	.WriteU32 = SimWriteU32,
+	.WriteBool = SimWriteBool,
+	.StartFifo = SimStartStopFifo,
+	.StopFifo = SimStartStopFifo,
+	.ReadFifoU32 = SimReadFifoU32,
+	.WriteFifoU32 = SimWriteFifoU32,
+};
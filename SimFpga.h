@@ -0,0 +1,61 @@
+#pragma once
+
+#include "FpgaBackend.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Simulated FPGA backend
+//
+// Emulates the OpenScanFPGAHost bitfile closely enough to drive the
+// acquisition code without hardware: controls are stored, the "Current"
+// state machine completes INIT and WRITE immediately, and while scanning
+// each target-to-host FIFO produces resolution^2 words per frame, paced at
+// the frame period implied by the pixel clock and line registers. The FIFO
+// contents come from a pluggable source (zeros if none is set). Closing a
+// session with NiFpga_CloseAttribute_NoResetIfLastSession leaves the
+// resource running with its controls, for the next session to find.
+
+extern const struct FpgaBackend SimFpgaBackend;
+
+// When this environment variable holds a count N, that many simulated
+// devices ("Sim0" .. "Sim<N-1>") are enumerated in addition to hardware
+#define SIMFPGA_ENVIRONMENT_VARIABLE "OSC_NIFPGA_SIMULATED_DEVICES"
+
+// Upper bound on the number of simultaneously open simulated sessions
+#define SIMFPGA_MAX_SESSIONS 16
+
+
+// Scan parameters as programmed into the simulated registers
+struct SimFpgaScan
+{
+	uint32_t resolution;
+	uint32_t elementsPerLine;
+	uint32_t linesPerFrame;
+	double pixelRateHz;
+	uint32_t numberOfFrames; // INT32_MAX for continuous
+};
+
+
+struct SimFpgaSource
+{
+	void *context;
+
+	// Called when scanning starts. *framePeriodSec is preset from the
+	// registers; the source may change it, and 0 disables pacing.
+	void (*BeginScan)(void *context, const struct SimFpgaScan *scan,
+		double *framePeriodSec);
+
+	// Produce count words of the given channel's stream, starting at the
+	// given word index counted from the start of the scan
+	void (*Fill)(void *context, uint32_t channel, uint64_t wordIndex,
+		uint32_t *dest, size_t count);
+};
+
+
+// Replace the FIFO data source of an open simulated session. Pass NULL to
+// revert to zeros. The source must stay valid until replaced or the session
+// is closed.
+NiFpga_Status SimFpga_SetSource(NiFpga_Session session,
+	const struct SimFpgaSource *source);
@@ -0,0 +1,279 @@
+#include "TemporalFilter.h"
+#include "FrameStats.h"
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <emmintrin.h>
+
+
+// Noise variance of the Kalman filter, as in the ImageJ plugin
+#define KALMAN_NOISE_VARIANCE 0.05
+
+#define MAX_CHANNELS 4
+#define MAX_MEDIAN_WINDOW 5
+
+
+struct TemporalFilter
+{
+	enum TemporalFilterMode mode;
+	uint32_t channelCount;
+	size_t pixelsPerFrame;
+
+	// Frames begun so far; 1 while the first frame is being filtered
+	uint64_t frameCount;
+
+	// Exponential and Kalman: the running estimate, per pixel
+	float *estimates[MAX_CHANNELS];
+	double gain;
+	double kalmanPredictedVariance;
+	float weight; // Weight of the new frame, for the current frame
+
+	// Median: the last window frames, as a ring
+	uint16_t *history[MAX_CHANNELS];
+	uint32_t window;
+};
+
+
+OScDev_Error TemporalFilter_Create(struct TemporalFilter **filter,
+	enum TemporalFilterMode mode, double gain,
+	uint32_t channelCount, size_t pixelsPerFrame)
+{
+	*filter = NULL;
+	if (channelCount == 0 || channelCount > MAX_CHANNELS ||
+		mode <= TEMPORAL_FILTER_NONE || mode >= TEMPORAL_FILTER_NUM_MODES)
+		return OScDev_Error_Illegal_Argument;
+
+	struct TemporalFilter *f = calloc(1, sizeof(struct TemporalFilter));
+	if (f == NULL)
+		return OScDev_Error_Out_Of_Memory;
+	f->mode = mode;
+	f->channelCount = channelCount;
+	f->pixelsPerFrame = pixelsPerFrame;
+	f->gain = gain < 0.0 ? 0.0 : gain > 1.0 ? 1.0 : gain;
+	f->kalmanPredictedVariance = KALMAN_NOISE_VARIANCE;
+	f->window = mode == TEMPORAL_FILTER_MEDIAN_3 ? 3 :
+		mode == TEMPORAL_FILTER_MEDIAN_5 ? 5 : 0;
+
+	for (uint32_t ch = 0; ch < channelCount; ++ch)
+	{
+		if (f->window > 0)
+			f->history[ch] = _aligned_malloc(sizeof(uint16_t) * pixelsPerFrame * f->window, 16);
+		else
+			f->estimates[ch] = _aligned_malloc(sizeof(float) * pixelsPerFrame, 16);
+		if (f->history[ch] == NULL && f->estimates[ch] == NULL)
+		{
+			TemporalFilter_Destroy(f);
+			return OScDev_Error_Out_Of_Memory;
+		}
+	}
+
+	*filter = f;
+	return OScDev_OK;
+}
+
+
+void TemporalFilter_Destroy(struct TemporalFilter *filter)
+{
+	if (filter == NULL)
+		return;
+	for (uint32_t ch = 0; ch < filter->channelCount; ++ch)
+	{
+		_aligned_free(filter->estimates[ch]);
+		_aligned_free(filter->history[ch]);
+	}
+	free(filter);
+}
+
+
+void TemporalFilter_BeginFrame(struct TemporalFilter *filter)
+{
+	++filter->frameCount;
+
+	switch (filter->mode)
+	{
+	case TEMPORAL_FILTER_EXPONENTIAL:
+		filter->weight = (float)(1.0 - filter->gain);
+		break;
+
+	case TEMPORAL_FILTER_KALMAN:
+		// The estimate is gain * prediction + (1 - gain) * observation,
+		// corrected by K * (observation - prediction). The variances do not
+		// depend on the data, so K is the same for every pixel.
+		if (filter->frameCount > 1)
+		{
+			double p = filter->kalmanPredictedVariance;
+			double k = p / (p + KALMAN_NOISE_VARIANCE);
+			filter->kalmanPredictedVariance = p * (1.0 - k);
+			double weight = 1.0 - filter->gain + k;
+			filter->weight = (float)(weight > 1.0 ? 1.0 : weight);
+		}
+		break;
+
+	default: // The median filters keep no per-frame state
+		break;
+	}
+}
+
+
+// Pack 8 non-negative int32 values <= 65535 into unsigned 16-bit lanes
+static inline __m128i PackU16(__m128i lo, __m128i hi)
+{
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+	__m128i packed = _mm_packs_epi32(_mm_sub_epi32(lo, bias32), _mm_sub_epi32(hi, bias32));
+	return _mm_xor_si128(packed, bias16);
+}
+
+
+static void ApplyRecursive(struct TemporalFilter *filter, uint32_t channel,
+	uint16_t *pixels, size_t begin, size_t end, struct FrameStatsAccumulator *acc)
+{
+	float *estimates = filter->estimates[channel];
+	size_t i = begin;
+
+	if (filter->frameCount == 1)
+	{
+		for (; i < end; ++i)
+			estimates[i] = pixels[i];
+		if (acc != NULL)
+			FrameStatsAccumulator_AddRange(acc, pixels, begin, end);
+		return;
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 weight = _mm_set1_ps(filter->weight);
+	for (; i + 8 <= end; i += 8)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)(pixels + i));
+		__m128 xLo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(x, zero));
+		__m128 xHi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(x, zero));
+		__m128 eLo = _mm_loadu_ps(estimates + i);
+		__m128 eHi = _mm_loadu_ps(estimates + i + 4);
+		eLo = _mm_add_ps(eLo, _mm_mul_ps(weight, _mm_sub_ps(xLo, eLo)));
+		eHi = _mm_add_ps(eHi, _mm_mul_ps(weight, _mm_sub_ps(xHi, eHi)));
+		_mm_storeu_ps(estimates + i, eLo);
+		_mm_storeu_ps(estimates + i + 4, eHi);
+		// Estimates stay within [0, 65535]; conversion rounds to nearest
+		__m128i out = PackU16(_mm_cvtps_epi32(eLo), _mm_cvtps_epi32(eHi));
+		_mm_storeu_si128((__m128i *)(pixels + i), out);
+		if (acc != NULL)
+			FrameStatsAccumulator_Add8(acc, out);
+	}
+	for (; i < end; ++i)
+	{
+		estimates[i] += filter->weight * (pixels[i] - estimates[i]);
+		pixels[i] = (uint16_t)(estimates[i] + 0.5f);
+		if (acc != NULL)
+			FrameStatsAccumulator_Add1(acc, pixels[i]);
+	}
+}
+
+
+// Unsigned 16-bit min/max via the signed SSE2 instructions, on values
+// biased by 0x8000
+static inline __m128i Median3(__m128i a, __m128i b, __m128i c)
+{
+	__m128i lo = _mm_min_epi16(a, b);
+	__m128i hi = _mm_max_epi16(a, b);
+	return _mm_max_epi16(lo, _mm_min_epi16(hi, c));
+}
+
+
+static inline __m128i Median5(__m128i a, __m128i b, __m128i c, __m128i d, __m128i e)
+{
+	__m128i f = _mm_max_epi16(_mm_min_epi16(a, b), _mm_min_epi16(c, d));
+	__m128i g = _mm_min_epi16(_mm_max_epi16(a, b), _mm_max_epi16(c, d));
+	return Median3(e, f, g);
+}
+
+
+static inline uint16_t ScalarMedian(uint16_t *values, uint32_t n)
+{
+	for (uint32_t i = 1; i < n; ++i)
+	{
+		uint16_t v = values[i];
+		uint32_t j = i;
+		for (; j > 0 && values[j - 1] > v; --j)
+			values[j] = values[j - 1];
+		values[j] = v;
+	}
+	return values[n / 2];
+}
+
+
+static void ApplyMedian(struct TemporalFilter *filter, uint32_t channel,
+	uint16_t *pixels, size_t begin, size_t end, struct FrameStatsAccumulator *acc)
+{
+	size_t n = filter->pixelsPerFrame;
+	uint32_t window = filter->window;
+	uint16_t *history = filter->history[channel];
+
+	// Until the window has filled, the first frame stands in for the
+	// missing ones
+	if (filter->frameCount == 1)
+	{
+		for (uint32_t k = 0; k < window; ++k)
+			memcpy(history + k * n + begin, pixels + begin, (end - begin) * sizeof(uint16_t));
+		if (acc != NULL)
+			FrameStatsAccumulator_AddRange(acc, pixels, begin, end);
+		return;
+	}
+
+	uint32_t slot = (uint32_t)((filter->frameCount - 1) % window);
+	memcpy(history + slot * n + begin, pixels + begin, (end - begin) * sizeof(uint16_t));
+
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m128i v[MAX_MEDIAN_WINDOW];
+		for (uint32_t k = 0; k < window; ++k)
+			v[k] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(history + k * n + i)), bias);
+		__m128i m = window == 3 ? Median3(v[0], v[1], v[2]) :
+			Median5(v[0], v[1], v[2], v[3], v[4]);
+		__m128i out = _mm_xor_si128(m, bias);
+		_mm_storeu_si128((__m128i *)(pixels + i), out);
+		if (acc != NULL)
+			FrameStatsAccumulator_Add8(acc, out);
+	}
+	for (; i < end; ++i)
+	{
+		uint16_t values[MAX_MEDIAN_WINDOW];
+		for (uint32_t k = 0; k < window; ++k)
+			values[k] = history[k * n + i];
+		pixels[i] = ScalarMedian(values, window);
+		if (acc != NULL)
+			FrameStatsAccumulator_Add1(acc, pixels[i]);
+	}
+}
+
+
+void TemporalFilter_Apply(struct TemporalFilter *filter, uint32_t channel,
+	uint16_t *pixels, size_t begin, size_t end, OScNIFPGA_FrameStats *stats)
+{
+	if (channel >= filter->channelCount)
+		return;
+
+	struct FrameStatsAccumulator acc;
+	if (stats != NULL)
+		FrameStatsAccumulator_Begin(&acc, stats);
+
+	switch (filter->mode)
+	{
+	case TEMPORAL_FILTER_EXPONENTIAL:
+	case TEMPORAL_FILTER_KALMAN:
+		ApplyRecursive(filter, channel, pixels, begin, end, stats != NULL ? &acc : NULL);
+		break;
+	case TEMPORAL_FILTER_MEDIAN_3:
+	case TEMPORAL_FILTER_MEDIAN_5:
+		ApplyMedian(filter, channel, pixels, begin, end, stats != NULL ? &acc : NULL);
+		break;
+	default: // Rejected by TemporalFilter_Create
+		break;
+	}
+
+	if (stats != NULL)
+		FrameStatsAccumulator_End(&acc);
+}
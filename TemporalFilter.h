@@ -0,0 +1,51 @@
+#pragma once
+
+#include "OScNIFPGAFrameStats.h"
+
+#include "OpenScanDeviceLib.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Recursive temporal filters for live view
+//
+// Applied in place to each delivered 16-bit frame, so that a continuous
+// acquisition shows a low-noise image without averaging several scanned
+// frames per delivered frame:
+//
+// - Exponential: y = y + (1 - gain) * (x - y)
+// - Kalman: the recursive estimator of the ImageJ "Kalman Stack Filter",
+//   with gain as its prediction weight and a fixed noise variance of 5%;
+//   it starts close to a running mean and settles to the exponential filter
+// - Median 3 / Median 5: per-pixel median of the last 3 or 5 frames
+//
+// State persists from frame to frame and is reset by creating a new filter.
+
+enum TemporalFilterMode
+{
+	TEMPORAL_FILTER_NONE,
+	TEMPORAL_FILTER_EXPONENTIAL,
+	TEMPORAL_FILTER_KALMAN,
+	TEMPORAL_FILTER_MEDIAN_3,
+	TEMPORAL_FILTER_MEDIAN_5,
+
+	TEMPORAL_FILTER_NUM_MODES
+};
+
+struct TemporalFilter;
+
+OScDev_Error TemporalFilter_Create(struct TemporalFilter **filter,
+	enum TemporalFilterMode mode, double gain,
+	uint32_t channelCount, size_t pixelsPerFrame);
+void TemporalFilter_Destroy(struct TemporalFilter *filter);
+
+// Call once per delivered frame, before filtering any of its channels
+void TemporalFilter_BeginFrame(struct TemporalFilter *filter);
+
+// Filter pixels [begin, end) of one channel of the current frame, adding
+// the statistics of the filtered pixels to stats unless it is NULL.
+// Disjoint ranges of the same frame may be filtered concurrently, into
+// separate statistics.
+void TemporalFilter_Apply(struct TemporalFilter *filter, uint32_t channel,
+	uint16_t *pixels, size_t begin, size_t end, OScNIFPGA_FrameStats *stats);
@@ -89,4 +89,14 @@ void SplineInterpolate(int32_t n, double yFirst, double yLast,
 	{
 		result[x] = c[0] * x*x*x + c[1] * x*x + c[2] * x + c[3];
 	}
+}
+
+
+void InterleaveXYRow(const uint16_t *xScaled, uint16_t yScaled,
+	uint32_t elementsPerLine, uint32_t *xy)
+{
+	for (uint32_t i = 0; i < elementsPerLine; ++i)
+	{
+		xy[i] = ((uint32_t)xScaled[i] << 16) | yScaled;
+	}
 }
\ No newline at end of file
@@ -12,5 +12,9 @@ void GenerateGalvoWaveform(int32_t effectiveScanLen, int32_t retraceLen,
 	int32_t undershootLen, double scanStart, double scanEnd, double *waveform);
 void SplineInterpolate(int32_t n, double yFirst, double yLast,
 	double slopeFirst, double slopeLast, double* result);
+// Pack one line of the scan into the words written to the DAC FIFO:
+// X in the high 16 bits, Y (constant within the line) in the low 16 bits
+void InterleaveXYRow(const uint16_t *xScaled, uint16_t yScaled,
+	uint32_t elementsPerLine, uint32_t *xy);
 // int SaveWaveformData(uint16_t *xScaled, uint16_t *yScaled, 
 //	uint16_t elementsPerLine, uint16_t elementsPerRow);
\ No newline at end of file
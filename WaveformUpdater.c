@@ -0,0 +1,205 @@
+#include "WaveformUpdater.h"
+#include "Log.h"
+#include "Waveform.h"
+
+#include <stdlib.h>
+
+#include <Windows.h>
+
+
+struct WaveformUpdater
+{
+	OScDev_Device *device;
+	HANDLE thread;
+
+	CRITICAL_SECTION mutex;
+	CONDITION_VARIABLE requested;
+	uint64_t generation; // Incremented for each request
+	struct WaveformGeometry geometry; // Of the latest request
+	bool stopRequested;
+
+	struct PreparedWaveform *ready; // Of readyGeneration; may be null
+	uint64_t readyGeneration;
+};
+
+
+bool WaveformGeometry_IsEqual(const struct WaveformGeometry *a,
+	const struct WaveformGeometry *b)
+{
+	return a->resolution == b->resolution && a->zoomFactor == b->zoomFactor &&
+		a->lineDelay == b->lineDelay &&
+		a->offsetX == b->offsetX && a->offsetY == b->offsetY;
+}
+
+
+static uint64_t HashBytes(uint64_t hash, const void *bytes, size_t count)
+{
+	const unsigned char *p = bytes;
+	for (size_t i = 0; i < count; ++i)
+	{
+		hash ^= p[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+
+uint64_t WaveformGeometry_Hash(const struct WaveformGeometry *geometry)
+{
+	// Field by field, as the struct may have padding
+	uint64_t hash = 0xCBF29CE484222325ull;
+	hash = HashBytes(hash, &geometry->resolution, sizeof(geometry->resolution));
+	hash = HashBytes(hash, &geometry->zoomFactor, sizeof(geometry->zoomFactor));
+	hash = HashBytes(hash, &geometry->lineDelay, sizeof(geometry->lineDelay));
+	hash = HashBytes(hash, &geometry->offsetX, sizeof(geometry->offsetX));
+	hash = HashBytes(hash, &geometry->offsetY, sizeof(geometry->offsetY));
+	return hash;
+}
+
+
+OScDev_Error PreparedWaveform_Create(struct PreparedWaveform **waveform,
+	const struct WaveformGeometry *geometry)
+{
+	*waveform = NULL;
+	struct PreparedWaveform *w = calloc(1, sizeof(struct PreparedWaveform));
+	if (w == NULL)
+		return OScDev_Error_Out_Of_Memory;
+	w->geometry = *geometry;
+	w->elementsPerLine = geometry->lineDelay + geometry->resolution + X_RETRACE_LEN;
+	w->elementsPerRow = geometry->resolution + Y_RETRACE_LEN;
+	w->xScaled = malloc(sizeof(uint16_t) * w->elementsPerLine);
+	w->yScaled = malloc(sizeof(uint16_t) * w->elementsPerRow);
+	if (w->xScaled == NULL || w->yScaled == NULL)
+	{
+		PreparedWaveform_Destroy(w);
+		return OScDev_Error_Out_Of_Memory;
+	}
+
+	if (GenerateScaledWaveforms(geometry->resolution, 0.25 * geometry->zoomFactor,
+		geometry->lineDelay, w->xScaled, w->yScaled,
+		geometry->offsetX, geometry->offsetY) != 0)
+	{
+		PreparedWaveform_Destroy(w);
+		return OScDev_Error_Waveform_Out_Of_Range;
+	}
+
+	*waveform = w;
+	return OScDev_OK;
+}
+
+
+void PreparedWaveform_Destroy(struct PreparedWaveform *waveform)
+{
+	if (waveform == NULL)
+		return;
+	free(waveform->xScaled);
+	free(waveform->yScaled);
+	free(waveform);
+}
+
+
+static DWORD WINAPI UpdaterLoop(void *param)
+{
+	struct WaveformUpdater *updater = param;
+	uint64_t seen = 0;
+
+	EnterCriticalSection(&updater->mutex);
+	for (;;)
+	{
+		while (updater->generation == seen && !updater->stopRequested)
+			SleepConditionVariableCS(&updater->requested, &updater->mutex, INFINITE);
+		if (updater->stopRequested)
+			break;
+		seen = updater->generation;
+		struct WaveformGeometry geometry = updater->geometry;
+		LeaveCriticalSection(&updater->mutex);
+
+		struct PreparedWaveform *waveform;
+		OScDev_Error err = PreparedWaveform_Create(&waveform, &geometry);
+		if (err != OScDev_OK)
+			NIFPGA_LOG_WARNING(updater->device,
+				"Cannot prepare waveform (error %d); scan continues unchanged", (int)err);
+
+		EnterCriticalSection(&updater->mutex);
+		if (waveform != NULL && updater->generation == seen)
+		{
+			PreparedWaveform_Destroy(updater->ready);
+			updater->ready = waveform;
+			updater->readyGeneration = seen;
+		}
+		else
+		{
+			// Superseded while being prepared
+			PreparedWaveform_Destroy(waveform);
+		}
+	}
+	LeaveCriticalSection(&updater->mutex);
+	return 0;
+}
+
+
+OScDev_Error WaveformUpdater_Start(struct WaveformUpdater **updater, OScDev_Device *device)
+{
+	*updater = NULL;
+	struct WaveformUpdater *u = calloc(1, sizeof(struct WaveformUpdater));
+	if (u == NULL)
+		return OScDev_Error_Out_Of_Memory;
+	u->device = device;
+	InitializeCriticalSection(&u->mutex);
+	InitializeConditionVariable(&u->requested);
+
+	u->thread = CreateThread(NULL, 0, UpdaterLoop, u, 0, NULL);
+	if (u->thread == NULL)
+	{
+		DeleteCriticalSection(&u->mutex);
+		free(u);
+		return OScDev_Error_Unknown;
+	}
+
+	*updater = u;
+	return OScDev_OK;
+}
+
+
+void WaveformUpdater_Stop(struct WaveformUpdater *updater)
+{
+	if (updater == NULL)
+		return;
+
+	EnterCriticalSection(&updater->mutex);
+	updater->stopRequested = true;
+	LeaveCriticalSection(&updater->mutex);
+	WakeConditionVariable(&updater->requested);
+
+	WaitForSingleObject(updater->thread, INFINITE);
+	CloseHandle(updater->thread);
+
+	PreparedWaveform_Destroy(updater->ready);
+	DeleteCriticalSection(&updater->mutex);
+	free(updater);
+}
+
+
+void WaveformUpdater_Request(struct WaveformUpdater *updater,
+	const struct WaveformGeometry *geometry)
+{
+	EnterCriticalSection(&updater->mutex);
+	updater->geometry = *geometry;
+	++updater->generation;
+	LeaveCriticalSection(&updater->mutex);
+	WakeConditionVariable(&updater->requested);
+}
+
+
+struct PreparedWaveform *WaveformUpdater_TakeReady(struct WaveformUpdater *updater)
+{
+	struct PreparedWaveform *waveform = NULL;
+	EnterCriticalSection(&updater->mutex);
+	if (updater->ready != NULL && updater->readyGeneration == updater->generation)
+	{
+		waveform = updater->ready;
+		updater->ready = NULL;
+	}
+	LeaveCriticalSection(&updater->mutex);
+	return waveform;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "OpenScanDeviceLib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Galvo waveforms prepared off the acquisition thread
+//
+// While a scan runs, changes to the offset, line delay or zoom are handed
+// to a background thread, which computes the new waveform. The acquisition
+// thread picks it up at the next frame boundary and only has to upload it,
+// though the scan pauses for the upload (see ApplyWaveformUpdate()).
+// Requests made while one is being prepared are coalesced, so only the
+// latest geometry is ever swapped in.
+
+struct WaveformGeometry
+{
+	uint32_t resolution;
+	double zoomFactor;
+	uint32_t lineDelay;
+	double offsetX;
+	double offsetY;
+};
+
+bool WaveformGeometry_IsEqual(const struct WaveformGeometry *a,
+	const struct WaveformGeometry *b);
+
+// Tag identifying the waveform of geometry (FNV-1a over its values)
+uint64_t WaveformGeometry_Hash(const struct WaveformGeometry *geometry);
+
+struct PreparedWaveform
+{
+	struct WaveformGeometry geometry;
+	uint32_t elementsPerLine;
+	uint32_t elementsPerRow;
+	uint16_t *xScaled; // elementsPerLine values
+	uint16_t *yScaled; // elementsPerRow values, one per line
+};
+
+// Returns OScDev_Error_Waveform_Out_Of_Range if the geometry exceeds the
+// galvo range
+OScDev_Error PreparedWaveform_Create(struct PreparedWaveform **waveform,
+	const struct WaveformGeometry *geometry);
+void PreparedWaveform_Destroy(struct PreparedWaveform *waveform);
+
+struct WaveformUpdater;
+
+OScDev_Error WaveformUpdater_Start(struct WaveformUpdater **updater, OScDev_Device *device);
+void WaveformUpdater_Stop(struct WaveformUpdater *updater);
+
+// Prepare the waveform for geometry, replacing any earlier request
+void WaveformUpdater_Request(struct WaveformUpdater *updater,
+	const struct WaveformGeometry *geometry);
+
+// The waveform of the latest request, if it is ready, or null. The caller
+// owns the result.
+struct PreparedWaveform *WaveformUpdater_TakeReady(struct WaveformUpdater *updater);
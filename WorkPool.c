@@ -0,0 +1,227 @@
+#include "WorkPool.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <Windows.h>
+
+
+// The unclaimed tasks of one worker, as begin << 32 | end, so that the
+// owner (taking from the front) and thieves (taking from the back) claim
+// tasks with a single compare-exchange
+struct Share
+{
+	volatile LONG64 range;
+	char padding[64 - sizeof(LONG64)]; // Keep shares on separate cache lines
+};
+
+struct Worker
+{
+	struct WorkPool *pool;
+	uint32_t index;
+	HANDLE thread;
+};
+
+struct WorkPool
+{
+	struct Share shares[WORK_POOL_MAX_WORKERS];
+	struct Worker workers[WORK_POOL_MAX_WORKERS];
+	uint32_t workerCount;
+	uint32_t threadCount; // Started threads, for cleanup
+
+	CRITICAL_SECTION mutex;
+	CONDITION_VARIABLE runRequested;
+	CONDITION_VARIABLE runDone;
+	uint64_t generation; // Incremented for each run
+	uint32_t pending; // Threads yet to finish the current run
+	bool stopRequested;
+
+	// Current run
+	WorkPool_TaskFunc func;
+	void *context;
+};
+
+
+static inline LONG64 MakeRange(uint32_t begin, uint32_t end)
+{
+	return (LONG64)(((uint64_t)begin << 32) | end);
+}
+
+
+static bool TakeFront(struct Share *share, uint32_t *task)
+{
+	for (;;)
+	{
+		LONG64 range = share->range;
+		uint32_t begin = (uint32_t)((uint64_t)range >> 32);
+		uint32_t end = (uint32_t)range;
+		if (begin >= end)
+			return false;
+		if (InterlockedCompareExchange64(&share->range,
+			MakeRange(begin + 1, end), range) == range)
+		{
+			*task = begin;
+			return true;
+		}
+	}
+}
+
+
+static bool TakeBack(struct Share *share, uint32_t *task)
+{
+	for (;;)
+	{
+		LONG64 range = share->range;
+		uint32_t begin = (uint32_t)((uint64_t)range >> 32);
+		uint32_t end = (uint32_t)range;
+		if (begin >= end)
+			return false;
+		if (InterlockedCompareExchange64(&share->range,
+			MakeRange(begin, end - 1), range) == range)
+		{
+			*task = end - 1;
+			return true;
+		}
+	}
+}
+
+
+static void Work(struct WorkPool *pool, uint32_t worker)
+{
+	uint32_t task;
+	while (TakeFront(&pool->shares[worker], &task))
+		pool->func(pool->context, task, worker);
+
+	// Steal until every share is empty; a share does not refill during a run
+	for (uint32_t k = 1; k < pool->workerCount; ++k)
+	{
+		struct Share *victim = &pool->shares[(worker + k) % pool->workerCount];
+		while (TakeBack(victim, &task))
+			pool->func(pool->context, task, worker);
+	}
+}
+
+
+static DWORD WINAPI WorkerLoop(void *param)
+{
+	struct Worker *worker = param;
+	struct WorkPool *pool = worker->pool;
+	uint64_t seen = 0;
+
+	EnterCriticalSection(&pool->mutex);
+	for (;;)
+	{
+		while (pool->generation == seen && !pool->stopRequested)
+			SleepConditionVariableCS(&pool->runRequested, &pool->mutex, INFINITE);
+		if (pool->stopRequested)
+			break;
+		seen = pool->generation;
+		LeaveCriticalSection(&pool->mutex);
+
+		Work(pool, worker->index);
+
+		EnterCriticalSection(&pool->mutex);
+		if (--pool->pending == 0)
+			WakeConditionVariable(&pool->runDone);
+	}
+	LeaveCriticalSection(&pool->mutex);
+	return 0;
+}
+
+
+OScDev_Error WorkPool_Create(struct WorkPool **pool, uint32_t workerCount)
+{
+	*pool = NULL;
+	if (workerCount == 0 || workerCount > WORK_POOL_MAX_WORKERS)
+		return OScDev_Error_Illegal_Argument;
+
+	struct WorkPool *p = calloc(1, sizeof(struct WorkPool));
+	if (p == NULL)
+		return OScDev_Error_Out_Of_Memory;
+	p->workerCount = workerCount;
+	InitializeCriticalSection(&p->mutex);
+	InitializeConditionVariable(&p->runRequested);
+	InitializeConditionVariable(&p->runDone);
+
+	for (uint32_t i = 0; i < workerCount; ++i)
+	{
+		p->workers[i].pool = p;
+		p->workers[i].index = i;
+	}
+	for (uint32_t i = 1; i < workerCount; ++i)
+	{
+		p->workers[i].thread = CreateThread(NULL, 0, WorkerLoop, &p->workers[i], 0, NULL);
+		if (p->workers[i].thread == NULL)
+		{
+			WorkPool_Destroy(p);
+			return OScDev_Error_Unknown;
+		}
+		++p->threadCount;
+	}
+
+	*pool = p;
+	return OScDev_OK;
+}
+
+
+void WorkPool_Destroy(struct WorkPool *pool)
+{
+	if (pool == NULL)
+		return;
+
+	EnterCriticalSection(&pool->mutex);
+	pool->stopRequested = true;
+	LeaveCriticalSection(&pool->mutex);
+	WakeAllConditionVariable(&pool->runRequested);
+
+	for (uint32_t i = 1; i <= pool->threadCount; ++i)
+	{
+		WaitForSingleObject(pool->workers[i].thread, INFINITE);
+		CloseHandle(pool->workers[i].thread);
+	}
+
+	DeleteCriticalSection(&pool->mutex);
+	free(pool);
+}
+
+
+uint32_t WorkPool_GetWorkerCount(const struct WorkPool *pool)
+{
+	return pool->workerCount;
+}
+
+
+void WorkPool_Run(struct WorkPool *pool, uint32_t taskCount,
+	WorkPool_TaskFunc func, void *context)
+{
+	uint32_t workerCount = pool->workerCount;
+	for (uint32_t i = 0; i < workerCount; ++i)
+	{
+		uint32_t begin = (uint32_t)((uint64_t)taskCount * i / workerCount);
+		uint32_t end = (uint32_t)((uint64_t)taskCount * (i + 1) / workerCount);
+		pool->shares[i].range = MakeRange(begin, end);
+	}
+
+	if (workerCount == 1)
+	{
+		pool->func = func;
+		pool->context = context;
+		Work(pool, 0);
+		return;
+	}
+
+	EnterCriticalSection(&pool->mutex);
+	pool->func = func;
+	pool->context = context;
+	pool->pending = workerCount - 1;
+	++pool->generation;
+	LeaveCriticalSection(&pool->mutex);
+	WakeAllConditionVariable(&pool->runRequested);
+
+	Work(pool, 0);
+
+	EnterCriticalSection(&pool->mutex);
+	while (pool->pending > 0)
+		SleepConditionVariableCS(&pool->runDone, &pool->mutex, INFINITE);
+	LeaveCriticalSection(&pool->mutex);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "OpenScanDeviceLib.h"
+
+#include <stdint.h>
+
+
+// Persistent worker threads for splitting per-frame processing
+//
+// A run hands out task indices 0 to taskCount - 1. Each worker starts on
+// its own contiguous share of the indices and, once that is exhausted,
+// steals from the far end of the others' shares, so an uneven split (or a
+// worker that the scheduler delays) does not hold up the frame. The
+// calling thread takes part as worker 0.
+
+#define WORK_POOL_MAX_WORKERS 16
+
+struct WorkPool;
+
+// Called for each task, on the thread of the given worker (0 to
+// workerCount - 1); tasks of one run may run concurrently
+typedef void (*WorkPool_TaskFunc)(void *context, uint32_t task, uint32_t worker);
+
+// workerCount includes the calling thread, so workerCount - 1 threads are
+// started
+OScDev_Error WorkPool_Create(struct WorkPool **pool, uint32_t workerCount);
+void WorkPool_Destroy(struct WorkPool *pool);
+
+uint32_t WorkPool_GetWorkerCount(const struct WorkPool *pool);
+
+// Run all tasks and return when they have finished. Not reentrant.
+void WorkPool_Run(struct WorkPool *pool, uint32_t taskCount,
+	WorkPool_TaskFunc func, void *context);
@@ -0,0 +1,770 @@
+// End-to-end acquisition benchmark on a simulated FPGA
+//
+// Drives Arm -> Start -> Wait through OpenScan_NIFPGA_Device_Impl, exactly
+// as OpenScan does, against the simulated backend (SimFpga.h) fed with
+// synthetic detector data. For each point of a resolution x channels x
+// pixel rate x frames-to-average matrix it reports arm latency, time to the
+// first delivered frame, sustained frame rate against the rate implied by
+// the pixel clock ticks, and process CPU time per delivered frame.
+//
+// Usage: AcquisitionBench [--paced] [--interleaved] [--parallel-readers]
+//                         [--processing-threads N] [--keep-armed]
+//                         [--async-arm] [--restart] [--frames N]
+//                         [--queue STEPS] [--boards N] [--output file.csv]
+//                         [--verbose]
+//
+// By default the simulated FPGA produces data as fast as the host drains it,
+// so the frame rate measures the capacity of the host pipeline; a ratio to
+// the theoretical rate below 1 means the host could not keep up with real
+// hardware at that pixel rate. With --paced, data arrives at the real frame
+// period and the ratio should stay at 1. CPU time includes generating the
+// synthetic FIFO data, which is small next to the acquisition path.
+// --interleaved delivers each frame as one channel-interleaved buffer.
+// --parallel-readers drains each FIFO on its own thread.
+// --processing-threads sets the ProcessingThreads setting (default 0, one
+// per processor; 1 processes each frame on the acquisition thread).
+// --restart also measures restarting live view: a continuous acquisition is
+// stopped after its first frame and started again, and the arm latency and
+// time to the first frame of the restart are reported. --keep-armed sets
+// the KeepArmed setting, which the restart benefits from. --async-arm sets
+// the AsyncArm setting, so that the arm latency only covers checking the
+// acquisition and the setup moves into the time to the first frame.
+// --queue runs the given AcquisitionQueue (see OScNIFPGAQueue.h) on a
+// 512 x 512 acquisition of --frames frames instead of the matrix, then the
+// same steps as separate acquisitions, and reports for each step the gap
+// between the last frame of the previous step and its first frame both ways.
+// --boards opens N simulated boards and, instead of the matrix, runs the
+// same acquisition on 1 to N of them at once, reporting the combined frame
+// rate and its ratio to that many times the rate of one board alone. Use
+// it with --paced, as the real boards produce data at the pixel rate.
+
+#include "BenchHost.h"
+
+#include "OScNIFPGADevicePrivate.h"
+#include "OScNIFPGAQueue.h"
+#include "SimFpga.h"
+#include "Waveform.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Windows.h>
+
+
+static const uint32_t resolutions[] = { 256, 512, 1024 };
+static const uint32_t channelCounts[] = { 1, 2, 4 };
+static const double pixelRatesHz[] = { 125000, 500000 };
+static const int32_t framesToAverages[] = { 1, 4 };
+
+
+struct Options
+{
+	bool paced;
+	bool interleaved;
+	bool parallelReaders;
+	int32_t processingThreads;
+	bool keepArmed;
+	bool asyncArm;
+	bool restart;
+	uint32_t frames;
+	const char *queue; // Null to run the matrix
+	uint32_t boards; // 0 to run on one board
+	const char *outputPath;
+	bool verbose;
+};
+
+
+struct SyntheticSource
+{
+	bool paced;
+};
+
+
+static void SyntheticBeginScan(void *context, const struct SimFpgaScan *scan,
+	double *framePeriodSec)
+{
+	struct SyntheticSource *source = context;
+	if (!source->paced)
+		*framePeriodSec = 0.0;
+}
+
+
+static void SyntheticFill(void *context, uint32_t channel, uint64_t wordIndex,
+	uint32_t *dest, size_t count)
+{
+	// Cheap hash so that frames are not constant
+	uint32_t seed = (uint32_t)wordIndex + channel * 0x9E3779B9u;
+	for (size_t i = 0; i < count; ++i)
+		dest[i] = (seed + (uint32_t)i) * 2654435761u;
+}
+
+
+struct FrameTimes
+{
+	LARGE_INTEGER first;
+	LARGE_INTEGER last;
+	volatile uint32_t frames; // Polled by MeasureRestart
+};
+
+
+static bool FrameReceived(void *context, uint32_t channel, void *pixels)
+{
+	struct FrameTimes *times = context;
+	if (channel != 0)
+		return true;
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	if (times->frames == 0)
+		times->first = now;
+	times->last = now;
+	++times->frames;
+	return true;
+}
+
+
+static LARGE_INTEGER frequency;
+
+
+static double Milliseconds(LARGE_INTEGER start, LARGE_INTEGER end)
+{
+	return (double)(end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+}
+
+
+static double ProcessCpuMilliseconds(void)
+{
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		return 0.0;
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (double)(k.QuadPart + u.QuadPart) / 10000.0; // 100 ns units
+}
+
+
+// Delivered frame rate implied by the tick math in SetPixelParameters and
+// the line and frame lengths in SetResolutionParameters. Every scanned frame
+// is delivered with progressive averaging; otherwise one per framesToAverage.
+static double TheoreticalFramesPerSecond(uint32_t resolution, uint32_t lineDelay,
+	double pixelRateHz, uint32_t framesToAverage, bool progressive)
+{
+	double pixelTimeTicks = round(40e6 / pixelRateHz);
+	double elementsPerLine = lineDelay + resolution + X_RETRACE_LEN;
+	double elementsPerRow = resolution + Y_RETRACE_LEN;
+	double scanFps = 40e6 / (pixelTimeTicks * elementsPerLine * elementsPerRow);
+	return progressive ? scanFps : scanFps / framesToAverage;
+}
+
+
+struct Case
+{
+	uint32_t resolution;
+	uint32_t channels;
+	double pixelRateHz;
+	int32_t framesToAverage;
+};
+
+
+static bool WaitForFirstFrame(const struct FrameTimes *times, DWORD timeoutMs)
+{
+	DWORD start = GetTickCount();
+	while (times->frames == 0)
+	{
+		if (GetTickCount() - start > timeoutMs)
+			return false;
+		Sleep(1);
+	}
+	return true;
+}
+
+
+// Start a continuous acquisition, stop it after its first frame, as live
+// view does, and time arming and the first frame of a second one
+static OScDev_Error MeasureRestart(OScDev_Device *device, const struct Case *c,
+	double *armMs, double *firstFrameMs)
+{
+	OScDev_DeviceImpl *impl = BenchHost_GetDeviceImpl(device);
+	*armMs = *firstFrameMs = NAN;
+
+	OScDev_Error err = OScDev_OK;
+	for (int run = 0; run < 2 && err == OScDev_OK; ++run)
+	{
+		struct FrameTimes times = { 0 };
+		struct OScDev_Acquisition acq = {
+			.resolution = c->resolution,
+			.pixelRateHz = c->pixelRateHz,
+			.zoomFactor = 1.0,
+			.numberOfFrames = INT32_MAX,
+			.frameCallback = FrameReceived,
+			.callbackContext = &times,
+		};
+
+		LARGE_INTEGER armBegin, armEnd;
+		QueryPerformanceCounter(&armBegin);
+		err = impl->Arm(device, &acq);
+		QueryPerformanceCounter(&armEnd);
+		if (err == OScDev_OK)
+			err = impl->Start(device);
+		if (err == OScDev_OK && !WaitForFirstFrame(&times, 60000))
+			err = OScDev_Error_Unknown;
+		impl->Stop(device);
+
+		if (err == OScDev_OK && run == 1)
+		{
+			*armMs = Milliseconds(armBegin, armEnd);
+			*firstFrameMs = Milliseconds(armBegin, times.first);
+		}
+	}
+	return err;
+}
+
+
+static bool RunCase(OScDev_Device *device, OScDev_PtrArray *settings,
+	const struct Options *options, const struct Case *c, FILE *csv)
+{
+	OScDev_DeviceImpl *impl = BenchHost_GetDeviceImpl(device);
+
+	OScDev_Error err;
+	int32_t lineDelay = 0;
+	bool progressive = false;
+	if (OScDev_CHECK(err, BenchHost_SetEnum(settings, "Channels", c->channels - 1)) ||
+		OScDev_CHECK(err, BenchHost_SetEnum(settings, "FrameLayout", options->interleaved ? 1 : 0)) ||
+		OScDev_CHECK(err, BenchHost_SetBool(settings, "ParallelFifoReaders", options->parallelReaders)) ||
+		OScDev_CHECK(err, BenchHost_SetInt32(settings, "ProcessingThreads", options->processingThreads)) ||
+		OScDev_CHECK(err, BenchHost_SetBool(settings, "KeepArmed", options->keepArmed)) ||
+		OScDev_CHECK(err, BenchHost_SetBool(settings, "AsyncArm", options->asyncArm)) ||
+		OScDev_CHECK(err, BenchHost_SetInt32(settings, "AveragingFrameCount", c->framesToAverage)) ||
+		OScDev_CHECK(err, BenchHost_GetInt32(settings, "Line Delay (pixels)", &lineDelay)) ||
+		OScDev_CHECK(err, BenchHost_GetBool(settings, "AveragingProgressive", &progressive)))
+	{
+		fprintf(stderr, "Failed to apply settings: %d\n", (int)err);
+		return false;
+	}
+
+	struct FrameTimes times = { 0 };
+	struct OScDev_Acquisition acq = {
+		.resolution = c->resolution,
+		.pixelRateHz = c->pixelRateHz,
+		.zoomFactor = 1.0,
+		.numberOfFrames = options->frames,
+		.frameCallback = FrameReceived,
+		.callbackContext = &times,
+	};
+
+	LARGE_INTEGER armBegin, armEnd, startTime, endTime;
+	QueryPerformanceCounter(&armBegin);
+	err = impl->Arm(device, &acq);
+	QueryPerformanceCounter(&armEnd);
+
+	double cpuBegin = ProcessCpuMilliseconds();
+	QueryPerformanceCounter(&startTime);
+	if (err == OScDev_OK)
+		err = impl->Start(device);
+	if (err == OScDev_OK)
+		err = impl->Wait(device);
+	QueryPerformanceCounter(&endTime);
+	double cpuMs = ProcessCpuMilliseconds() - cpuBegin;
+
+	double armMs = Milliseconds(armBegin, armEnd);
+	double firstFrameMs = times.frames > 0 ? Milliseconds(startTime, times.first) : NAN;
+	double fps = NAN;
+	if (times.frames > 1)
+		fps = (times.frames - 1) * 1000.0 / Milliseconds(times.first, times.last);
+	else if (times.frames == 1)
+		fps = 1000.0 / firstFrameMs;
+	double theoreticalFps = TheoreticalFramesPerSecond(c->resolution, lineDelay,
+		c->pixelRateHz, c->framesToAverage, progressive);
+	double cpuMsPerFrame = times.frames > 0 ? cpuMs / times.frames : NAN;
+
+	double restartArmMs = NAN, restartFirstFrameMs = NAN;
+	if (err == OScDev_OK && options->restart)
+		err = MeasureRestart(device, c, &restartArmMs, &restartFirstFrameMs);
+
+	const char *status = err != OScDev_OK ? "error" :
+		times.frames < options->frames ? "incomplete" : "ok";
+
+	printf("%5u %2u %7.0f %3d %9.2f %9.2f %9.2f %9.2f %6.2f %8.2f %9.2f %9.2f %s\n",
+		c->resolution, c->channels, c->pixelRateHz, (int)c->framesToAverage,
+		armMs, firstFrameMs, fps, theoreticalFps, fps / theoreticalFps,
+		cpuMsPerFrame, restartArmMs, restartFirstFrameMs, status);
+	fprintf(csv, "%u,%u,%.0f,%d,%u,%u,%d,%.3f,%.3f,%.3f,%.3f,%.4f,%.3f,%.3f,%.3f,%s\n",
+		c->resolution, c->channels, c->pixelRateHz, (int)c->framesToAverage,
+		options->frames, times.frames, options->paced ? 1 : 0,
+		armMs, firstFrameMs, fps, theoreticalFps, fps / theoreticalFps,
+		cpuMsPerFrame, restartArmMs, restartFirstFrameMs, status);
+	fflush(csv);
+
+	return err == OScDev_OK;
+}
+
+
+struct StepTimes
+{
+	LARGE_INTEGER first[ACQUISITION_QUEUE_MAX_STEPS];
+	LARGE_INTEGER last[ACQUISITION_QUEUE_MAX_STEPS];
+	uint32_t frames[ACQUISITION_QUEUE_MAX_STEPS];
+	uint32_t step; // When not delivered by a queue
+};
+
+
+static bool StepFrameReceived(void *context, uint32_t channel, void *pixels)
+{
+	struct StepTimes *times = context;
+	if (channel != 0)
+		return true;
+
+	// Each separate acquisition is step 0 to the module
+	uint32_t step;
+	if (!OScNIFPGA_GetQueueStep(&step) || step == 0)
+		step = times->step;
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	if (times->frames[step] == 0)
+		times->first[step] = now;
+	times->last[step] = now;
+	++times->frames[step];
+	return true;
+}
+
+
+static OScDev_Error RunAcquisition(OScDev_Device *device, struct OScDev_Acquisition *acq)
+{
+	OScDev_DeviceImpl *impl = BenchHost_GetDeviceImpl(device);
+	OScDev_Error err = impl->Arm(device, acq);
+	if (err == OScDev_OK)
+		err = impl->Start(device);
+	if (err == OScDev_OK)
+		err = impl->Wait(device);
+	return err;
+}
+
+
+// Run the acquisition on the first boardCount devices at the same time; each
+// has its own worker thread, so only Wait is called in turn
+static OScDev_Error RunOnBoards(OScDev_Device **boards, uint32_t boardCount,
+	struct OScDev_Acquisition *acqs)
+{
+	OScDev_Error err = OScDev_OK;
+	uint32_t armed = 0;
+	for (; armed < boardCount && err == OScDev_OK; ++armed)
+		err = BenchHost_GetDeviceImpl(boards[armed])->Arm(boards[armed], &acqs[armed]);
+	if (err != OScDev_OK)
+		--armed;
+	for (uint32_t i = 0; i < armed && err == OScDev_OK; ++i)
+		err = BenchHost_GetDeviceImpl(boards[i])->Start(boards[i]);
+	for (uint32_t i = 0; i < armed; ++i)
+	{
+		OScDev_DeviceImpl *impl = BenchHost_GetDeviceImpl(boards[i]);
+		if (err != OScDev_OK)
+			impl->Stop(boards[i]);
+		OScDev_Error waitErr = impl->Wait(boards[i]);
+		if (err == OScDev_OK)
+			err = waitErr;
+	}
+	return err;
+}
+
+
+// Frame rate of each board as RunCase computes it, NAN if none was delivered
+static double BoardFramesPerSecond(const struct FrameTimes *times)
+{
+	if (times->frames > 1)
+		return (times->frames - 1) * 1000.0 / Milliseconds(times->first, times->last);
+	return NAN;
+}
+
+
+// Run the same acquisition on 1, 2, ... boardCount boards at once and
+// compare the combined frame rate with that of a single board
+static bool RunBoards(OScDev_Device **boards, OScDev_PtrArray **settings,
+	uint32_t boardCount, const struct Options *options, FILE *csv)
+{
+	const uint32_t channels = 2;
+	const double pixelRateHz = 500000;
+
+	OScDev_Error err;
+	int32_t lineDelay = 0;
+	for (uint32_t b = 0; b < boardCount; ++b)
+	{
+		if (OScDev_CHECK(err, BenchHost_SetEnum(settings[b], "Channels", channels - 1)) ||
+			OScDev_CHECK(err, BenchHost_SetEnum(settings[b], "FrameLayout", options->interleaved ? 1 : 0)) ||
+			OScDev_CHECK(err, BenchHost_SetBool(settings[b], "ParallelFifoReaders", options->parallelReaders)) ||
+			OScDev_CHECK(err, BenchHost_SetInt32(settings[b], "ProcessingThreads", options->processingThreads)) ||
+			OScDev_CHECK(err, BenchHost_GetInt32(settings[b], "Line Delay (pixels)", &lineDelay)))
+		{
+			fprintf(stderr, "Failed to apply settings: %d\n", (int)err);
+			return false;
+		}
+	}
+
+	fprintf(csv, "boards,resolution,channels,pixel_rate_hz,frames_requested,paced,"
+		"combined_frames_per_second,min_board_frames_per_second,"
+		"theoretical_frames_per_second,scaling,status\n");
+	printf("%6s %5s %2s %7s %9s %9s %9s %7s %s\n",
+		"boards", "res", "ch", "rate", "fps", "min fps", "theo fps", "scaling", "status");
+
+	bool ok = true;
+	for (size_t r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); ++r)
+	{
+		double singleFps = NAN;
+		for (uint32_t n = 1; n <= boardCount; ++n)
+		{
+			struct FrameTimes times[SIMFPGA_MAX_SESSIONS] = { 0 };
+			struct OScDev_Acquisition acqs[SIMFPGA_MAX_SESSIONS];
+			for (uint32_t b = 0; b < n; ++b)
+			{
+				struct OScDev_Acquisition acq = {
+					.resolution = resolutions[r],
+					.pixelRateHz = pixelRateHz,
+					.zoomFactor = 1.0,
+					.numberOfFrames = options->frames,
+					.frameCallback = FrameReceived,
+					.callbackContext = &times[b],
+				};
+				acqs[b] = acq;
+			}
+			err = RunOnBoards(boards, n, acqs);
+
+			double combinedFps = 0.0, minFps = INFINITY;
+			bool complete = true;
+			for (uint32_t b = 0; b < n; ++b)
+			{
+				double fps = BoardFramesPerSecond(&times[b]);
+				combinedFps += fps;
+				if (!(fps >= minFps))
+					minFps = fps;
+				if (times[b].frames < options->frames)
+					complete = false;
+			}
+			if (n == 1)
+				singleFps = combinedFps;
+			double scaling = combinedFps / (n * singleFps);
+			double theoreticalFps = TheoreticalFramesPerSecond(resolutions[r], lineDelay,
+				pixelRateHz, 1, false);
+
+			const char *status = err != OScDev_OK ? "error" :
+				!complete ? "incomplete" : "ok";
+			if (err != OScDev_OK || !complete)
+				ok = false;
+
+			printf("%6u %5u %2u %7.0f %9.2f %9.2f %9.2f %7.2f %s\n",
+				n, resolutions[r], channels, pixelRateHz, combinedFps, minFps,
+				theoreticalFps, scaling, status);
+			fprintf(csv, "%u,%u,%u,%.0f,%u,%d,%.3f,%.3f,%.3f,%.4f,%s\n",
+				n, resolutions[r], channels, pixelRateHz, options->frames,
+				options->paced ? 1 : 0, combinedFps, minFps, theoreticalFps,
+				scaling, status);
+			fflush(csv);
+		}
+	}
+	return ok;
+}
+
+
+// Run options->queue in one acquisition, then its steps one acquisition
+// each, and compare the transitions
+static bool RunQueue(OScDev_Device *device, OScDev_PtrArray *settings,
+	const struct Options *options, FILE *csv)
+{
+	OScDev_Error err;
+	if (OScDev_CHECK(err, BenchHost_SetEnum(settings, "FrameLayout", options->interleaved ? 1 : 0)) ||
+		OScDev_CHECK(err, BenchHost_SetBool(settings, "ParallelFifoReaders", options->parallelReaders)) ||
+		OScDev_CHECK(err, BenchHost_SetInt32(settings, "ProcessingThreads", options->processingThreads)) ||
+		OScDev_CHECK(err, BenchHost_SetString(settings, "AcquisitionQueue", options->queue)))
+	{
+		fprintf(stderr, "Failed to apply settings: %d\n", (int)err);
+		return false;
+	}
+
+	struct StepTimes queued = { 0 };
+	struct OScDev_Acquisition acq = {
+		.resolution = 512,
+		.pixelRateHz = 500000,
+		.zoomFactor = 1.0,
+		.numberOfFrames = options->frames,
+		.frameCallback = StepFrameReceived,
+		.callbackContext = &queued,
+	};
+	if (OScDev_CHECK(err, RunAcquisition(device, &acq)))
+	{
+		fprintf(stderr, "Queued acquisition failed: %d\n", (int)err);
+		return false;
+	}
+
+	// As resolved at arm
+	uint32_t stepCount = GetData(device)->acquisition.stepCount;
+	struct AcquisitionStep steps[ACQUISITION_QUEUE_MAX_STEPS];
+	memcpy(steps, GetData(device)->acquisition.steps, sizeof(steps));
+	double setupMs[ACQUISITION_QUEUE_MAX_STEPS];
+	for (uint32_t i = 0; i < stepCount; ++i)
+		setupMs[i] = GetData(device)->lastStepTimings[i].setupMs;
+
+	struct StepTimes separate = { 0 };
+	if (OScDev_CHECK(err, BenchHost_SetString(settings, "AcquisitionQueue", "")))
+		return false;
+	for (uint32_t i = 0; i < stepCount && err == OScDev_OK; ++i)
+	{
+		separate.step = i;
+		struct OScDev_Acquisition stepAcq = {
+			.resolution = steps[i].resolution,
+			.pixelRateHz = steps[i].pixelRateHz,
+			.zoomFactor = steps[i].zoomFactor,
+			.numberOfFrames = steps[i].numberOfFrames,
+			.frameCallback = StepFrameReceived,
+			.callbackContext = &separate,
+		};
+		if (OScDev_CHECK(err, BenchHost_SetInt32(settings, "AveragingFrameCount",
+			steps[i].framesToAverage)) ||
+			OScDev_CHECK(err, RunAcquisition(device, &stepAcq)))
+			fprintf(stderr, "Acquisition of step %u failed: %d\n", i + 1, (int)err);
+	}
+
+	fprintf(csv, "step,resolution,zoom,pixel_rate_hz,frames_to_average,frames_requested,"
+		"frames_delivered,setup_ms,queued_gap_ms,separate_gap_ms,status\n");
+	printf("%4s %5s %5s %7s %3s %6s %6s %9s %9s %9s %s\n",
+		"step", "res", "zoom", "rate", "avg", "frames", "got", "setup ms",
+		"gap ms", "sep ms", "status");
+	bool ok = err == OScDev_OK;
+	for (uint32_t i = 0; i < stepCount; ++i)
+	{
+		double queuedGapMs = NAN, separateGapMs = NAN;
+		if (i > 0 && queued.frames[i] > 0 && queued.frames[i - 1] > 0)
+			queuedGapMs = Milliseconds(queued.last[i - 1], queued.first[i]);
+		if (i > 0 && separate.frames[i] > 0 && separate.frames[i - 1] > 0)
+			separateGapMs = Milliseconds(separate.last[i - 1], separate.first[i]);
+		const char *status = queued.frames[i] < steps[i].numberOfFrames ? "incomplete" : "ok";
+		if (queued.frames[i] < steps[i].numberOfFrames)
+			ok = false;
+
+		printf("%4u %5u %5.2f %7.0f %3u %6u %6u %9.2f %9.2f %9.2f %s\n",
+			i + 1, steps[i].resolution, steps[i].zoomFactor, steps[i].pixelRateHz,
+			steps[i].framesToAverage, steps[i].numberOfFrames, queued.frames[i],
+			setupMs[i], queuedGapMs, separateGapMs, status);
+		fprintf(csv, "%u,%u,%.3f,%.0f,%u,%u,%u,%.3f,%.3f,%.3f,%s\n",
+			i + 1, steps[i].resolution, steps[i].zoomFactor, steps[i].pixelRateHz,
+			steps[i].framesToAverage, steps[i].numberOfFrames, queued.frames[i],
+			setupMs[i], queuedGapMs, separateGapMs, status);
+	}
+	fflush(csv);
+	return ok;
+}
+
+
+static bool ParseOptions(int argc, char *argv[], struct Options *options)
+{
+	options->paced = false;
+	options->interleaved = false;
+	options->parallelReaders = false;
+	options->processingThreads = 0;
+	options->keepArmed = false;
+	options->asyncArm = false;
+	options->restart = false;
+	options->frames = 10;
+	options->queue = NULL;
+	options->boards = 0;
+	options->outputPath = "AcquisitionBench.csv";
+	options->verbose = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--paced") == 0)
+			options->paced = true;
+		else if (strcmp(argv[i], "--interleaved") == 0)
+			options->interleaved = true;
+		else if (strcmp(argv[i], "--parallel-readers") == 0)
+			options->parallelReaders = true;
+		else if (strcmp(argv[i], "--keep-armed") == 0)
+			options->keepArmed = true;
+		else if (strcmp(argv[i], "--async-arm") == 0)
+			options->asyncArm = true;
+		else if (strcmp(argv[i], "--restart") == 0)
+			options->restart = true;
+		else if (strcmp(argv[i], "--verbose") == 0)
+			options->verbose = true;
+		else if (strcmp(argv[i], "--processing-threads") == 0 && i + 1 < argc)
+			options->processingThreads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			options->frames = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc)
+			options->queue = argv[++i];
+		else if (strcmp(argv[i], "--boards") == 0 && i + 1 < argc)
+			options->boards = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			options->outputPath = argv[++i];
+		else
+			return false;
+	}
+	return options->frames > 0 && options->boards <= SIMFPGA_MAX_SESSIONS;
+}
+
+
+// Open Sim0 .. Sim<count-1>; returns false, with none left open, on failure
+static bool OpenSimulatedDevices(OScDev_PtrArray **devices, uint32_t count,
+	OScDev_Device **opened)
+{
+	OScDev_DeviceImpl *impl = &OpenScan_NIFPGA_Device_Impl;
+
+	char simCount[16];
+	snprintf(simCount, sizeof(simCount), "%u", count);
+	SetEnvironmentVariableA(SIMFPGA_ENVIRONMENT_VARIABLE, simCount);
+	OScDev_Error err;
+	if (OScDev_CHECK(err, impl->EnumerateInstances(devices)))
+	{
+		fprintf(stderr, "Failed to enumerate devices: %d\n", (int)err);
+		return false;
+	}
+
+	uint32_t openCount = 0;
+	for (uint32_t b = 0; b < count; ++b)
+	{
+		char wanted[16];
+		snprintf(wanted, sizeof(wanted), "Sim%u", b);
+		opened[b] = NULL;
+		for (size_t i = 0; i < OScDev_PtrArray_Size(*devices); ++i)
+		{
+			OScDev_Device *device = OScDev_PtrArray_At(*devices, i);
+			char name[OScDev_MAX_STR_LEN + 1];
+			impl->GetName(device, name);
+			if (strcmp(name, wanted) == 0)
+				opened[b] = device;
+		}
+		if (opened[b] == NULL)
+		{
+			fprintf(stderr, "Simulated device %s was not enumerated\n", wanted);
+			break;
+		}
+		if (OScDev_CHECK(err, impl->Open(opened[b])))
+		{
+			fprintf(stderr, "Failed to open %s: %d\n", wanted, (int)err);
+			break;
+		}
+		++openCount;
+	}
+
+	if (openCount == count)
+		return true;
+	for (uint32_t b = 0; b < openCount; ++b)
+		impl->Close(opened[b]);
+	return false;
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct Options options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		fprintf(stderr, "Usage: AcquisitionBench [--paced] [--interleaved] [--parallel-readers] "
+			"[--processing-threads N] [--keep-armed] [--async-arm] [--restart] [--frames N] "
+			"[--queue STEPS] [--boards N] [--output file.csv] [--verbose]\n");
+		return 2;
+	}
+	BenchHost_SetLogLevel(options.verbose ? 0 : 2);
+	QueryPerformanceFrequency(&frequency);
+
+	FILE *csv = fopen(options.outputPath, "w");
+	if (csv == NULL)
+	{
+		fprintf(stderr, "Cannot open %s for writing\n", options.outputPath);
+		return 1;
+	}
+
+	uint32_t boardCount = options.boards > 0 ? options.boards : 1;
+	OScDev_PtrArray *devices = NULL;
+	OScDev_Device *boards[SIMFPGA_MAX_SESSIONS];
+	if (!OpenSimulatedDevices(&devices, boardCount, boards))
+	{
+		fclose(csv);
+		return 1;
+	}
+	OScDev_Device *device = boards[0];
+	OScDev_DeviceImpl *impl = BenchHost_GetDeviceImpl(device);
+
+	struct SyntheticSource synthetic = { .paced = options.paced };
+	struct SimFpgaSource source = {
+		.context = &synthetic,
+		.BeginScan = SyntheticBeginScan,
+		.Fill = SyntheticFill,
+	};
+	for (uint32_t b = 0; b < boardCount; ++b)
+		SimFpga_SetSource(GetData(boards[b])->niFpgaSession, &source);
+
+	OScDev_PtrArray *boardSettings[SIMFPGA_MAX_SESSIONS] = { NULL };
+	OScDev_Error err;
+	int ret = 0;
+	for (uint32_t b = 0; b < boardCount; ++b)
+	{
+		if (OScDev_CHECK(err, impl->MakeSettings(boards[b], &boardSettings[b])))
+		{
+			fprintf(stderr, "Failed to create settings: %d\n", (int)err);
+			ret = 1;
+			goto cleanup;
+		}
+	}
+	OScDev_PtrArray *settings = boardSettings[0];
+
+	if (options.boards > 0)
+	{
+		if (!RunBoards(boards, boardSettings, boardCount, &options, csv))
+			ret = 1;
+		printf("Results written to %s\n", options.outputPath);
+		goto cleanup;
+	}
+
+	if (options.queue != NULL)
+	{
+		if (!RunQueue(device, settings, &options, csv))
+			ret = 1;
+		printf("Results written to %s\n", options.outputPath);
+		goto cleanup;
+	}
+
+	fprintf(csv, "resolution,channels,pixel_rate_hz,frames_to_average,frames_requested,"
+		"frames_delivered,paced,arm_latency_ms,first_frame_ms,frames_per_second,"
+		"theoretical_frames_per_second,rate_ratio,cpu_ms_per_frame,"
+		"restart_arm_latency_ms,restart_first_frame_ms,status\n");
+	printf("%5s %2s %7s %3s %9s %9s %9s %9s %6s %8s %9s %9s %s\n",
+		"res", "ch", "rate", "avg", "arm ms", "first ms", "fps", "theo fps",
+		"ratio", "cpu ms", "rarm ms", "rfirst ms", "status");
+
+	for (size_t r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); ++r)
+	{
+		for (size_t ch = 0; ch < sizeof(channelCounts) / sizeof(channelCounts[0]); ++ch)
+		{
+			for (size_t p = 0; p < sizeof(pixelRatesHz) / sizeof(pixelRatesHz[0]); ++p)
+			{
+				for (size_t a = 0; a < sizeof(framesToAverages) / sizeof(framesToAverages[0]); ++a)
+				{
+					struct Case c = {
+						.resolution = resolutions[r],
+						.channels = channelCounts[ch],
+						.pixelRateHz = pixelRatesHz[p],
+						.framesToAverage = framesToAverages[a],
+					};
+					if (!RunCase(device, settings, &options, &c, csv))
+						ret = 1;
+				}
+			}
+		}
+	}
+	printf("Results written to %s\n", options.outputPath);
+
+cleanup:
+	for (uint32_t b = 0; b < boardCount; ++b)
+	{
+		BenchHost_DestroySettings(boardSettings[b]);
+		impl->Close(boards[b]);
+	}
+	for (size_t i = 0; i < OScDev_PtrArray_Size(devices); ++i)
+		BenchHost_DestroyDevice(OScDev_PtrArray_At(devices, i));
+	OScDev_PtrArray_Destroy(devices);
+	fclose(csv);
+	return ret;
+}
@@ -0,0 +1,363 @@
+#include "BenchHost.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct OScDev_Device
+{
+	OScDev_DeviceImpl *impl;
+	void *data;
+};
+
+
+struct OScDev_Setting
+{
+	char name[OScDev_MAX_STR_LEN + 1];
+	OScDev_ValueType valueType;
+	OScDev_SettingImpl *impl;
+	void *data;
+};
+
+
+struct OScDev_PtrArray
+{
+	void **ptrs;
+	size_t size;
+	size_t capacity;
+};
+
+
+// Ranges are only created and destroyed by the module; nothing is kept
+struct OScDev_NumRange
+{
+	int unused;
+};
+
+
+static int g_logLevel = 2;
+
+
+void BenchHost_SetLogLevel(int level)
+{
+	g_logLevel = level;
+}
+
+
+static void Log(int level, const char *levelName, OScDev_Device *device,
+	const char *message)
+{
+	if (level < g_logLevel)
+		return;
+	char name[OScDev_MAX_STR_LEN + 1] = "";
+	if (device != NULL)
+		device->impl->GetName(device, name);
+	fprintf(stderr, "[%s] %s: %s\n", levelName, name, message);
+}
+
+
+void OScDev_Log_Debug(OScDev_Device *device, const char *message)
+{
+	Log(0, "debug", device, message);
+}
+
+
+void OScDev_Log_Info(OScDev_Device *device, const char *message)
+{
+	Log(1, "info", device, message);
+}
+
+
+void OScDev_Log_Warning(OScDev_Device *device, const char *message)
+{
+	Log(2, "warning", device, message);
+}
+
+
+void OScDev_Log_Error(OScDev_Device *device, const char *message)
+{
+	Log(3, "error", device, message);
+}
+
+
+OScDev_Error OScDev_Device_Create(OScDev_Device **device, OScDev_DeviceImpl *impl, void *data)
+{
+	*device = calloc(1, sizeof(OScDev_Device));
+	if (*device == NULL)
+		return OScDev_Error_Out_Of_Memory;
+	(*device)->impl = impl;
+	(*device)->data = data;
+	return OScDev_OK;
+}
+
+
+void *OScDev_Device_GetImplData(OScDev_Device *device)
+{
+	return device->data;
+}
+
+
+OScDev_DeviceImpl *BenchHost_GetDeviceImpl(OScDev_Device *device)
+{
+	return device->impl;
+}
+
+
+void BenchHost_DestroyDevice(OScDev_Device *device)
+{
+	device->impl->ReleaseInstance(device);
+	free(device);
+}
+
+
+OScDev_PtrArray *OScDev_PtrArray_Create(void)
+{
+	return calloc(1, sizeof(OScDev_PtrArray));
+}
+
+
+void OScDev_PtrArray_Destroy(const OScDev_PtrArray *arr)
+{
+	if (arr == NULL)
+		return;
+	free(arr->ptrs);
+	free((OScDev_PtrArray *)arr);
+}
+
+
+void OScDev_PtrArray_Append(OScDev_PtrArray *arr, void *obj)
+{
+	if (arr->size == arr->capacity)
+	{
+		size_t capacity = arr->capacity ? 2 * arr->capacity : 8;
+		void **ptrs = realloc(arr->ptrs, capacity * sizeof(void *));
+		if (ptrs == NULL)
+			return;
+		arr->ptrs = ptrs;
+		arr->capacity = capacity;
+	}
+	arr->ptrs[arr->size++] = obj;
+}
+
+
+size_t OScDev_PtrArray_Size(const OScDev_PtrArray *arr)
+{
+	return arr->size;
+}
+
+
+void *OScDev_PtrArray_At(const OScDev_PtrArray *arr, size_t index)
+{
+	return index < arr->size ? arr->ptrs[index] : NULL;
+}
+
+
+bool OScDev_PtrArray_IsEmpty(const OScDev_PtrArray *arr)
+{
+	return arr->size == 0;
+}
+
+
+OScDev_NumRange *OScDev_NumRange_CreateContinuous(double rMin, double rMax)
+{
+	return calloc(1, sizeof(OScDev_NumRange));
+}
+
+
+OScDev_NumRange *OScDev_NumRange_CreateDiscreteFromNaNTerminated(const double *values)
+{
+	return calloc(1, sizeof(OScDev_NumRange));
+}
+
+
+void OScDev_NumRange_Destroy(OScDev_NumRange *range)
+{
+	free(range);
+}
+
+
+OScDev_Error OScDev_Setting_Create(OScDev_Setting **setting, const char *name,
+	OScDev_ValueType valueType, OScDev_SettingImpl *impl, void *data)
+{
+	*setting = calloc(1, sizeof(OScDev_Setting));
+	if (*setting == NULL)
+		return OScDev_Error_Out_Of_Memory;
+	strncpy((*setting)->name, name, OScDev_MAX_STR_LEN);
+	(*setting)->valueType = valueType;
+	(*setting)->impl = impl;
+	(*setting)->data = data;
+	return OScDev_OK;
+}
+
+
+void OScDev_Setting_Destroy(OScDev_Setting *setting)
+{
+	if (setting == NULL)
+		return;
+	if (setting->impl->Release != NULL)
+		setting->impl->Release(setting);
+	free(setting);
+}
+
+
+void *OScDev_Setting_GetImplData(OScDev_Setting *setting)
+{
+	return setting->data;
+}
+
+
+static OScDev_Setting *FindSetting(OScDev_PtrArray *settings, const char *name,
+	OScDev_ValueType valueType)
+{
+	for (size_t i = 0; i < settings->size; ++i)
+	{
+		OScDev_Setting *setting = settings->ptrs[i];
+		if (strcmp(setting->name, name) == 0 && setting->valueType == valueType)
+			return setting;
+	}
+	fprintf(stderr, "No setting named %s of the expected type\n", name);
+	return NULL;
+}
+
+
+OScDev_Error BenchHost_SetBool(OScDev_PtrArray *settings, const char *name, bool value)
+{
+	OScDev_Setting *setting = FindSetting(settings, name, OScDev_ValueType_Bool);
+	if (setting == NULL)
+		return OScDev_Error_Illegal_Argument;
+	return setting->impl->SetBool(setting, value);
+}
+
+
+OScDev_Error BenchHost_GetBool(OScDev_PtrArray *settings, const char *name, bool *value)
+{
+	OScDev_Setting *setting = FindSetting(settings, name, OScDev_ValueType_Bool);
+	if (setting == NULL)
+		return OScDev_Error_Illegal_Argument;
+	return setting->impl->GetBool(setting, value);
+}
+
+
+OScDev_Error BenchHost_SetInt32(OScDev_PtrArray *settings, const char *name, int32_t value)
+{
+	OScDev_Setting *setting = FindSetting(settings, name, OScDev_ValueType_Int32);
+	if (setting == NULL)
+		return OScDev_Error_Illegal_Argument;
+	return setting->impl->SetInt32(setting, value);
+}
+
+
+OScDev_Error BenchHost_GetInt32(OScDev_PtrArray *settings, const char *name, int32_t *value)
+{
+	OScDev_Setting *setting = FindSetting(settings, name, OScDev_ValueType_Int32);
+	if (setting == NULL)
+		return OScDev_Error_Illegal_Argument;
+	return setting->impl->GetInt32(setting, value);
+}
+
+
+OScDev_Error BenchHost_SetString(OScDev_PtrArray *settings, const char *name, const char *value)
+{
+	OScDev_Setting *setting = FindSetting(settings, name, OScDev_ValueType_String);
+	if (setting == NULL)
+		return OScDev_Error_Illegal_Argument;
+	return setting->impl->SetString(setting, value);
+}
+
+
+OScDev_Error BenchHost_SetEnum(OScDev_PtrArray *settings, const char *name, uint32_t value)
+{
+	OScDev_Setting *setting = FindSetting(settings, name, OScDev_ValueType_Enum);
+	if (setting == NULL)
+		return OScDev_Error_Illegal_Argument;
+	return setting->impl->SetEnum(setting, value);
+}
+
+
+void BenchHost_DestroySettings(OScDev_PtrArray *settings)
+{
+	if (settings == NULL)
+		return;
+	for (size_t i = 0; i < settings->size; ++i)
+		OScDev_Setting_Destroy(settings->ptrs[i]);
+	OScDev_PtrArray_Destroy(settings);
+}
+
+
+uint32_t OScDev_Acquisition_GetNumberOfFrames(OScDev_Acquisition *acq)
+{
+	return acq->numberOfFrames;
+}
+
+
+double OScDev_Acquisition_GetPixelRate(OScDev_Acquisition *acq)
+{
+	return acq->pixelRateHz;
+}
+
+
+uint32_t OScDev_Acquisition_GetResolution(OScDev_Acquisition *acq)
+{
+	return acq->resolution;
+}
+
+
+double OScDev_Acquisition_GetZoomFactor(OScDev_Acquisition *acq)
+{
+	return acq->zoomFactor;
+}
+
+
+void OScDev_Acquisition_GetROI(OScDev_Acquisition *acq,
+	uint32_t *xOffset, uint32_t *yOffset, uint32_t *width, uint32_t *height)
+{
+	*xOffset = *yOffset = 0;
+	*width = *height = acq->resolution;
+}
+
+
+OScDev_Error OScDev_Acquisition_IsClockRequested(OScDev_Acquisition *acq, bool *isRequested)
+{
+	*isRequested = true;
+	return OScDev_OK;
+}
+
+
+OScDev_Error OScDev_Acquisition_IsScannerRequested(OScDev_Acquisition *acq, bool *isRequested)
+{
+	*isRequested = true;
+	return OScDev_OK;
+}
+
+
+OScDev_Error OScDev_Acquisition_IsDetectorRequested(OScDev_Acquisition *acq, bool *isRequested)
+{
+	*isRequested = true;
+	return OScDev_OK;
+}
+
+
+OScDev_Error OScDev_Acquisition_GetClockStartTriggerSource(OScDev_Acquisition *acq,
+	OScDev_TriggerSource *startTrigger)
+{
+	*startTrigger = OScDev_TriggerSource_Software;
+	return OScDev_OK;
+}
+
+
+OScDev_Error OScDev_Acquisition_GetClockSource(OScDev_Acquisition *acq,
+	OScDev_ClockSource *clockSource)
+{
+	*clockSource = OScDev_ClockSource_Internal;
+	return OScDev_OK;
+}
+
+
+bool OScDev_Acquisition_CallFrameCallback(OScDev_Acquisition *acq,
+	uint32_t channel, void *pixels)
+{
+	if (acq->frameCallback == NULL)
+		return true;
+	return acq->frameCallback(acq->callbackContext, channel, pixels);
+}
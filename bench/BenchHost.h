@@ -0,0 +1,48 @@
+#pragma once
+
+#include "OpenScanDeviceLib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Minimal stand-in for the OpenScan host
+//
+// Implements the OScDev_* functions that the device module calls, so that
+// benchmarks can link the module sources directly and drive them through
+// OpenScan_NIFPGA_Device_Impl without OpenScanLib or a GUI. It is not a
+// complete host: number ranges are not introspectable and settings can only
+// be reached through the helpers below.
+
+
+// The host owns the acquisition; benchmarks fill this in before arming
+struct OScDev_Acquisition
+{
+	uint32_t resolution;
+	double pixelRateHz;
+	double zoomFactor;
+	uint32_t numberOfFrames;
+
+	// Called for each delivered channel image; return false to stop
+	bool (*frameCallback)(void *context, uint32_t channel, void *pixels);
+	void *callbackContext;
+};
+
+
+// Log messages at or above this level are printed to stderr
+// (0 = debug, 1 = info, 2 = warning, 3 = error)
+void BenchHost_SetLogLevel(int level);
+
+OScDev_DeviceImpl *BenchHost_GetDeviceImpl(OScDev_Device *device);
+
+// Release the module's instance data and the host's device object
+void BenchHost_DestroyDevice(OScDev_Device *device);
+
+// Settings as returned by the device's MakeSettings
+OScDev_Error BenchHost_SetBool(OScDev_PtrArray *settings, const char *name, bool value);
+OScDev_Error BenchHost_GetBool(OScDev_PtrArray *settings, const char *name, bool *value);
+OScDev_Error BenchHost_SetInt32(OScDev_PtrArray *settings, const char *name, int32_t value);
+OScDev_Error BenchHost_GetInt32(OScDev_PtrArray *settings, const char *name, int32_t *value);
+OScDev_Error BenchHost_SetString(OScDev_PtrArray *settings, const char *name, const char *value);
+OScDev_Error BenchHost_SetEnum(OScDev_PtrArray *settings, const char *name, uint32_t value);
+void BenchHost_DestroySettings(OScDev_PtrArray *settings);
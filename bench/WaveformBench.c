@@ -0,0 +1,277 @@
+// Benchmark of scan waveform generation and DAC conversion
+//
+// Times the stages that WriteWaveforms runs at every arm (waveform
+// generation, spline retrace, conversion to DAC units and the XY interleave
+// into FIFO words) over a sweep of resolution, line delay and zoom.
+//
+// Usage: WaveformBench [output.csv]
+//
+// Results are printed and written as CSV (default WaveformBench.csv), one
+// row per stage and sweep point, so that runs from different releases can
+// be compared directly.
+//
+// The memory column is the growth of the working set over the stage: the
+// working set is trimmed before each stage, so the growth counts the pages
+// the stage touches (its buffers, code and stack). The process-wide peak
+// working set cannot be reset and would only show the largest stage so far.
+
+#include "Waveform.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Windows.h>
+#include <psapi.h>
+
+
+// Each measurement repeats the stage until at least this much time has
+// passed, so that short stages are not dominated by timer resolution
+#define MIN_MEASURE_SECONDS 0.1
+#define MIN_REPETITIONS 3
+
+static const uint32_t resolutions[] = { 256, 512, 1024, 2048 };
+static const uint32_t lineDelays[] = { 1, 50, 200 };
+static const double zooms[] = { 0.5, 1.0, 4.0, 40.0 };
+
+
+struct SweepPoint
+{
+	uint32_t resolution;
+	uint32_t lineDelay;
+	double zoom;
+
+	uint32_t elementsPerLine;
+	uint32_t elementsPerRow;
+};
+
+
+struct Measurement
+{
+	const char *stage;
+	uint64_t repetitions;
+	uint64_t samplesPerCall;
+	uint64_t bytesPerCall;
+	double nsPerSample;
+	size_t workingSetGrowthBytes;
+	bool ok;
+};
+
+
+// Keeps the optimizer from discarding the results of a stage
+static volatile uint32_t sink;
+
+static LARGE_INTEGER frequency;
+
+
+static double Seconds(LARGE_INTEGER start, LARGE_INTEGER end)
+{
+	return (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+}
+
+
+static size_t WorkingSet(void)
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	counters.cb = sizeof(counters);
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.WorkingSetSize;
+}
+
+
+// Each Run* function performs one call of the stage and returns false if the
+// stage reported an error
+
+static bool RunScaledWaveforms(const struct SweepPoint *p, void *buffers[])
+{
+	uint16_t *xScaled = buffers[0];
+	uint16_t *yScaled = buffers[1];
+	// WriteWaveforms passes a quarter of the acquisition zoom factor
+	if (GenerateScaledWaveforms(p->resolution, 0.25 * p->zoom, p->lineDelay,
+		xScaled, yScaled, 0.0, 0.0) != 0)
+		return false;
+	sink += xScaled[p->elementsPerLine - 1] + yScaled[p->elementsPerRow - 1];
+	return true;
+}
+
+
+static bool RunGalvoWaveform(const struct SweepPoint *p, void *buffers[])
+{
+	double *waveform = buffers[2];
+	GenerateGalvoWaveform(p->resolution, X_RETRACE_LEN, p->lineDelay,
+		-0.5, 0.5, waveform);
+	sink += (uint32_t)(waveform[p->elementsPerLine - 1] * 1000.0);
+	return true;
+}
+
+
+static bool RunSplineInterpolate(const struct SweepPoint *p, void *buffers[])
+{
+	double *retrace = buffers[2];
+	double step = 1.0 / (p->resolution - 1);
+	double undershootStart = -0.5 - p->lineDelay * step;
+	SplineInterpolate(X_RETRACE_LEN, 0.5, undershootStart, step, step, retrace);
+	sink += (uint32_t)(retrace[X_RETRACE_LEN - 1] * 1000.0);
+	return true;
+}
+
+
+static bool RunInterleave(const struct SweepPoint *p, void *buffers[])
+{
+	const uint16_t *xScaled = buffers[0];
+	const uint16_t *yScaled = buffers[1];
+	uint32_t *xy = buffers[3];
+	// One line buffer reused for every row, as in WriteWaveforms
+	for (uint32_t j = 0; j < p->elementsPerRow; ++j)
+	{
+		InterleaveXYRow(xScaled, yScaled[j], p->elementsPerLine, xy);
+		sink += xy[j % p->elementsPerLine];
+	}
+	return true;
+}
+
+
+static void Measure(const struct SweepPoint *p, void *buffers[],
+	bool (*run)(const struct SweepPoint *, void *[]),
+	struct Measurement *m)
+{
+	// Pages left from earlier stages would hide those this one touches
+	SetProcessWorkingSetSize(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1);
+	size_t workingSetBefore = WorkingSet();
+
+	m->ok = run(p, buffers); // Warm up caches and fault in the buffers
+	m->repetitions = 0;
+	m->workingSetGrowthBytes = 0;
+	m->nsPerSample = 0.0;
+	if (!m->ok)
+		return;
+
+	LARGE_INTEGER start, now;
+	QueryPerformanceCounter(&start);
+	double elapsed;
+	do
+	{
+		if (!run(p, buffers))
+		{
+			m->ok = false;
+			return;
+		}
+		++m->repetitions;
+		QueryPerformanceCounter(&now);
+		elapsed = Seconds(start, now);
+	} while (elapsed < MIN_MEASURE_SECONDS || m->repetitions < MIN_REPETITIONS);
+
+	m->nsPerSample = elapsed * 1e9 / ((double)m->repetitions * m->samplesPerCall);
+	size_t workingSetAfter = WorkingSet();
+	m->workingSetGrowthBytes = workingSetAfter > workingSetBefore ?
+		workingSetAfter - workingSetBefore : 0;
+}
+
+
+static void Report(FILE *csv, const struct SweepPoint *p, const struct Measurement *m)
+{
+	printf("%-24s %5u %4u %5.1f %10.3f %12llu %12llu %8s\n",
+		m->stage, p->resolution, p->lineDelay, p->zoom, m->nsPerSample,
+		(unsigned long long)m->bytesPerCall,
+		(unsigned long long)m->workingSetGrowthBytes,
+		m->ok ? "ok" : "error");
+	fprintf(csv, "%s,%u,%u,%g,%u,%u,%llu,%llu,%.4f,%llu,%llu,%s\n",
+		m->stage, p->resolution, p->lineDelay, p->zoom,
+		p->elementsPerLine, p->elementsPerRow,
+		(unsigned long long)m->repetitions,
+		(unsigned long long)m->samplesPerCall, m->nsPerSample,
+		(unsigned long long)m->bytesPerCall,
+		(unsigned long long)m->workingSetGrowthBytes,
+		m->ok ? "ok" : "error");
+}
+
+
+static bool RunSweepPoint(FILE *csv, struct SweepPoint *p)
+{
+	p->elementsPerLine = p->lineDelay + p->resolution + X_RETRACE_LEN;
+	p->elementsPerRow = p->resolution + Y_RETRACE_LEN;
+
+	void *buffers[4];
+	buffers[0] = malloc(sizeof(uint16_t) * p->elementsPerLine);
+	buffers[1] = malloc(sizeof(uint16_t) * p->elementsPerRow);
+	buffers[2] = malloc(sizeof(double) * p->elementsPerLine);
+	buffers[3] = malloc(sizeof(uint32_t) * p->elementsPerLine);
+	bool ok = buffers[0] && buffers[1] && buffers[2] && buffers[3];
+	if (!ok)
+	{
+		fprintf(stderr, "Out of memory\n");
+		goto cleanup;
+	}
+
+	uint64_t scaledSamples = (uint64_t)p->elementsPerLine + p->elementsPerRow;
+	uint64_t frameSamples = (uint64_t)p->elementsPerLine * p->elementsPerRow;
+	struct Measurement measurements[] = {
+		{ .stage = "GenerateScaledWaveforms", .samplesPerCall = scaledSamples,
+			.bytesPerCall = scaledSamples * sizeof(uint16_t) },
+		{ .stage = "GenerateGalvoWaveform", .samplesPerCall = p->elementsPerLine,
+			.bytesPerCall = (uint64_t)p->elementsPerLine * sizeof(double) },
+		{ .stage = "SplineInterpolate", .samplesPerCall = X_RETRACE_LEN,
+			.bytesPerCall = (uint64_t)X_RETRACE_LEN * sizeof(double) },
+		{ .stage = "InterleaveXY", .samplesPerCall = frameSamples,
+			.bytesPerCall = frameSamples * sizeof(uint32_t) },
+	};
+	bool (*runs[])(const struct SweepPoint *, void *[]) = {
+		RunScaledWaveforms, RunGalvoWaveform, RunSplineInterpolate, RunInterleave,
+	};
+
+	// The interleave needs valid DAC values; if the zoom puts the waveform
+	// out of range, they stay zero, which does not affect its timing
+	for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); ++i)
+	{
+		Measure(p, buffers, runs[i], &measurements[i]);
+		Report(csv, p, &measurements[i]);
+	}
+
+cleanup:
+	for (int i = 0; i < 4; ++i)
+		free(buffers[i]);
+	return ok;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *outputPath = argc > 1 ? argv[1] : "WaveformBench.csv";
+	FILE *csv = fopen(outputPath, "w");
+	if (csv == NULL)
+	{
+		fprintf(stderr, "Cannot open %s for writing\n", outputPath);
+		return 1;
+	}
+
+	QueryPerformanceFrequency(&frequency);
+
+	fprintf(csv, "stage,resolution,line_delay,zoom,elements_per_line,elements_per_row,"
+		"repetitions,samples_per_call,ns_per_sample,bytes_per_call,"
+		"working_set_growth_bytes,status\n");
+	printf("%-24s %5s %4s %5s %10s %12s %12s %8s\n",
+		"stage", "res", "dly", "zoom", "ns/sample", "bytes", "WS growth", "status");
+
+	int ret = 0;
+	for (size_t r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); ++r)
+	{
+		for (size_t d = 0; d < sizeof(lineDelays) / sizeof(lineDelays[0]); ++d)
+		{
+			for (size_t z = 0; z < sizeof(zooms) / sizeof(zooms[0]); ++z)
+			{
+				struct SweepPoint p = {
+					.resolution = resolutions[r],
+					.lineDelay = lineDelays[d],
+					.zoom = zooms[z],
+				};
+				if (!RunSweepPoint(csv, &p))
+					ret = 1;
+			}
+		}
+	}
+
+	fclose(csv);
+	printf("Results written to %s\n", outputPath);
+	return ret;
+}
@@ -0,0 +1,138 @@
+// Check of the host frame average against a scalar integer reference
+//
+// Adds FRAME_AVERAGER_MAX_FRAMES frames of pseudo-random and full-scale
+// samples to a FrameAverager and compares every mean it writes with
+// (sum + count / 2) / count computed in integers, for frame sizes that end
+// with and without a partial vector. A few frames past the limit must get
+// the mean of the first FRAME_AVERAGER_MAX_FRAMES. Also checks that the
+// raw low halves are left as they were.
+//
+// Usage: FrameAveragerTest
+//
+// Prints the first mismatches and returns nonzero if there are any.
+
+#include "FrameAverager.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+static const size_t pixelCounts[] = { 1024, 1027 };
+
+// Stop reporting after this many mismatches
+#define MAX_REPORTED 10
+// Frames added past FRAME_AVERAGER_MAX_FRAMES
+#define EXTRA_FRAMES 3
+
+
+static uint32_t NextRandom(uint32_t *state)
+{
+	// xorshift32
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+
+// Sample of pixel i in frame: full scale, zero, alternating between the
+// two (so that the mean sits on a rounding tie after every even count) or
+// random
+static uint16_t Sample(size_t i, uint32_t frame, uint32_t *random)
+{
+	switch (i % 4)
+	{
+	case 0:
+		return 0xFFFF;
+	case 1:
+		return 0;
+	case 2:
+		return frame % 2 == 0 ? 0xFFFF : 0;
+	default:
+		return (uint16_t)NextRandom(random);
+	}
+}
+
+
+static bool CheckPixelCount(size_t pixelCount, unsigned *mismatches)
+{
+	struct FrameAverager *averager;
+	if (FrameAverager_Create(&averager, 1, pixelCount) != OScDev_OK)
+	{
+		fprintf(stderr, "Failed to create averager\n");
+		return false;
+	}
+	uint32_t *words = malloc(sizeof(uint32_t) * pixelCount);
+	uint16_t *raws = malloc(sizeof(uint16_t) * pixelCount);
+	uint64_t *sums = calloc(pixelCount, sizeof(uint64_t));
+	if (words == NULL || raws == NULL || sums == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		free(words);
+		free(raws);
+		free(sums);
+		FrameAverager_Destroy(averager);
+		return false;
+	}
+
+	uint32_t random = 2463534242u;
+	FrameAverager_Reset(averager);
+	for (uint32_t frame = 0; frame < FRAME_AVERAGER_MAX_FRAMES + EXTRA_FRAMES; ++frame)
+	{
+		bool counted = frame < FRAME_AVERAGER_MAX_FRAMES;
+		for (size_t i = 0; i < pixelCount; ++i)
+		{
+			raws[i] = Sample(i, frame, &random);
+			if (counted)
+				sums[i] += raws[i];
+			// Garbage in the high half, as left by the firmware
+			words[i] = 0xA5A50000u | raws[i];
+		}
+		FrameAverager_Add(averager, 0, words);
+
+		uint64_t count = counted ? frame + 1 : FRAME_AVERAGER_MAX_FRAMES;
+		for (size_t i = 0; i < pixelCount; ++i)
+		{
+			uint32_t expected = (uint32_t)((sums[i] + count / 2) / count);
+			uint32_t mean = words[i] >> 16;
+			uint16_t raw = (uint16_t)(words[i] & 0xFFFF);
+			if (mean == expected && raw == raws[i])
+				continue;
+			if (++*mismatches <= MAX_REPORTED)
+			{
+				printf("%zu pixels, frame %u, pixel %zu: mean %u, expected %u; "
+					"raw %u, expected %u\n", pixelCount, frame + 1, i,
+					mean, expected, raw, raws[i]);
+			}
+		}
+	}
+
+	free(words);
+	free(raws);
+	free(sums);
+	FrameAverager_Destroy(averager);
+	return true;
+}
+
+
+int main(void)
+{
+	unsigned mismatches = 0;
+	for (size_t p = 0; p < sizeof(pixelCounts) / sizeof(pixelCounts[0]); ++p)
+	{
+		if (!CheckPixelCount(pixelCounts[p], &mismatches))
+			return 2;
+	}
+
+	if (mismatches > 0)
+	{
+		printf("FAILED: %u mismatches\n", mismatches);
+		return 1;
+	}
+	printf("OK: means match the integer reference up to %u frames\n",
+		FRAME_AVERAGER_MAX_FRAMES + EXTRA_FRAMES);
+	return 0;
+}